@@ -0,0 +1,92 @@
+#include <KdTree.h>
+#include <KdTreeLinear.h>
+#include <BVHSplit.h>
+#include <AABB.h>
+#include <Timing.h>
+#include <JobSystem.h>
+#include <chrono>
+#include <memory>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace fly;
+
+namespace
+{
+  struct Object
+  {
+    AABB _bv;
+    inline const AABB& getBV() const { return _bv; }
+    inline float getLargestObjectBVSize() const { return _bv.size2(); }
+  };
+
+  /**
+  * Objects of varying size, scattered in clusters like the meshes of an outdoor scene.
+  */
+  std::vector<Object> createObjects(unsigned num_objects)
+  {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> cluster_dist(-2000.f, 2000.f);
+    std::normal_distribution<float> offset_dist(0.f, 50.f);
+    std::uniform_real_distribution<float> size_dist(0.5f, 10.f);
+    std::vector<Object> objects(num_objects);
+    Vec3f cluster_center;
+    for (unsigned i = 0; i < num_objects; i++) {
+      if (i % 256u == 0) {
+        cluster_center = Vec3f(cluster_dist(gen), cluster_dist(gen) * 0.05f, cluster_dist(gen));
+      }
+      Vec3f center = cluster_center + Vec3f(offset_dist(gen), offset_dist(gen) * 0.1f, offset_dist(gen));
+      Vec3f extent(size_dist(gen));
+      objects[i]._bv = AABB(center - extent, center + extent);
+    }
+    return objects;
+  }
+  template<typename BVH>
+  std::unique_ptr<BVH> build(const std::vector<Object*>& objects, bool parallel, unsigned& build_ms)
+  {
+    auto objects_copy = objects; // The build reorders the objects
+    BVH::setParallelBuild(parallel);
+    Timing timing;
+    auto bvh = std::make_unique<BVH>(objects_copy);
+    build_ms = timing.duration<std::chrono::milliseconds>();
+    return bvh;
+  }
+  /**
+  * Builds the tree serially and in parallel, both builds result in the same tree.
+  */
+  template<typename BVH>
+  void benchmark(const char* name, const std::vector<Object*>& objects)
+  {
+    unsigned serial_ms, parallel_ms;
+    build<BVH>(objects, false, serial_ms);
+    auto bvh = build<BVH>(objects, true, parallel_ms);
+    unsigned internal_nodes = 0, leaf_nodes = 0;
+    bvh->countNodes(internal_nodes, leaf_nodes);
+    auto quality = bvh->getQuality();
+    std::cout << "  " << name << ": serial " << serial_ms << " ms, parallel " << parallel_ms << " ms, " << internal_nodes << " internal nodes, "
+      << leaf_nodes << " leaf nodes, SAH cost " << quality._sahCost << ", overlap " << quality._overlap << std::endl;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  using T = Object*;
+  using GetBV = DefaultGetBoundingVolume<T, AABB>;
+  using GetSize = DefaultGetLargestBVSize<T>;
+  std::cout << "Job system threads: " << JobSystem::getInstance().getNumThreads() << std::endl;
+  for (unsigned num_objects : { 10000u, 100000u, 1000000u }) {
+    auto objects = createObjects(num_objects);
+    std::vector<T> object_ptrs;
+    object_ptrs.reserve(num_objects);
+    for (auto& o : objects) {
+      object_ptrs.push_back(&o);
+    }
+    std::cout << num_objects << " objects:" << std::endl;
+    benchmark<KdTree<T, AABB>>("KdTree, median split", object_ptrs);
+    benchmark<KdTree<T, AABB, GetBV, GetSize, BinnedSAHSplit<T, GetBV>>>("KdTree, binned SAH", object_ptrs);
+    benchmark<KdTreeLinear<T, AABB>>("KdTreeLinear, median split", object_ptrs);
+    benchmark<KdTreeLinear<T, AABB, GetBV, GetSize, BinnedSAHSplit<T, GetBV>>>("KdTreeLinear, binned SAH", object_ptrs);
+  }
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include <StackPOD.h>
+#include <FrameArena.h>
+#include <Timing.h>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+using namespace fly;
+
+namespace
+{
+  const unsigned num_frames = 200;
+  const unsigned num_elements = 100000;
+  const unsigned num_chunks = 8;
+
+  /**
+  * Like the culling and render list code, clears the container every frame and fills it again.
+  */
+  template<typename Container>
+  unsigned pushBack(Container& container)
+  {
+    Timing timing;
+    size_t checksum = 0;
+    for (unsigned frame = 0; frame < num_frames; frame++) {
+      container.clear();
+      for (unsigned i = 0; i < num_elements; i++) {
+        container.push_back(reinterpret_cast<int*>(size_t(i) * 8u));
+      }
+      checksum += container.size();
+    }
+    auto duration = timing.duration<std::chrono::microseconds>();
+    if (checksum != size_t(num_frames) * num_elements) {
+      std::cout << "Wrong number of elements" << std::endl;
+    }
+    return duration;
+  }
+  /**
+  * Fills a fresh container with geometric growth every frame, which is what happens with a cleared arena stack.
+  */
+  template<typename MakeContainer>
+  unsigned pushBackFresh(MakeContainer make_container)
+  {
+    Timing timing;
+    size_t checksum = 0;
+    for (unsigned frame = 0; frame < num_frames; frame++) {
+      auto container = make_container();
+      for (unsigned i = 0; i < num_elements; i++) {
+        container.push_back_secure(reinterpret_cast<int*>(size_t(i) * 8u));
+      }
+      checksum += container.size();
+    }
+    auto duration = timing.duration<std::chrono::microseconds>();
+    if (checksum != size_t(num_frames) * num_elements) {
+      std::cout << "Wrong number of elements" << std::endl;
+    }
+    return duration;
+  }
+  /**
+  * Merges per job chunks into one list, as done for the parallel cull results.
+  */
+  template<typename Container, typename Append>
+  unsigned appendChunks(const std::vector<Container>& chunks, Container& merged, Append append)
+  {
+    Timing timing;
+    for (unsigned frame = 0; frame < num_frames; frame++) {
+      merged.clear();
+      for (const auto& c : chunks) {
+        append(merged, c);
+      }
+    }
+    return timing.duration<std::chrono::microseconds>();
+  }
+  void print(const char* name, unsigned stack_pod_us, unsigned vector_us)
+  {
+    std::cout << name << ": StackPOD " << stack_pod_us / num_frames << " us, std::vector " << vector_us / num_frames << " us per frame" << std::endl;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  {
+    StackPOD<int*> stack;
+    stack.reserve(num_elements);
+    std::vector<int*> vec;
+    vec.reserve(num_elements);
+    print("push_back into reserved storage", pushBack(stack), pushBack(vec));
+  }
+  {
+    FrameArena arena(num_elements * sizeof(int*) * 4u);
+    auto stack_us = pushBackFresh([&arena]() {
+      arena.reset();
+      return StackPOD<int*>(arena);
+    });
+    auto heap_us = pushBackFresh([]() {
+      return StackPOD<int*>();
+    });
+    Timing timing;
+    for (unsigned frame = 0; frame < num_frames; frame++) {
+      std::vector<int*> vec;
+      for (unsigned i = 0; i < num_elements; i++) {
+        vec.push_back(reinterpret_cast<int*>(size_t(i) * 8u));
+      }
+    }
+    auto vector_us = timing.duration<std::chrono::microseconds>();
+    print("push_back with growth, arena", stack_us, vector_us);
+    print("push_back with growth, heap", heap_us, vector_us);
+  }
+  {
+    std::vector<StackPOD<int*>> stack_chunks(num_chunks);
+    std::vector<std::vector<int*>> vector_chunks(num_chunks);
+    for (unsigned c = 0; c < num_chunks; c++) {
+      for (unsigned i = 0; i < num_elements / num_chunks; i++) {
+        stack_chunks[c].push_back_secure(reinterpret_cast<int*>(size_t(i) * 8u));
+        vector_chunks[c].push_back(reinterpret_cast<int*>(size_t(i) * 8u));
+      }
+    }
+    StackPOD<int*> stack;
+    std::vector<int*> vec;
+    auto stack_us = appendChunks(stack_chunks, stack, [](StackPOD<int*>& merged, const StackPOD<int*>& chunk) {
+      merged.append(chunk);
+    });
+    auto vector_us = appendChunks(vector_chunks, vec, [](std::vector<int*>& merged, const std::vector<int*>& chunk) {
+      merged.insert(merged.end(), chunk.begin(), chunk.end());
+    });
+    print("append chunks", stack_us, vector_us);
+  }
+  return 0;
+}
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <vector>
 #include <iostream>
 #include <limits>
+#include <algorithm>
 
 namespace fly
 {
@@ -68,6 +69,14 @@ namespace fly
     {
       return isLargeEnough(cam_pos, thresh, size2());
     }
+    /**
+    * Conservative variant that returns true if the bounding box may be large enough for any camera position within cam_tolerance of cam_pos.
+    */
+    inline bool isLargeEnough(const Vec3f& cam_pos, float thresh, float size2, float cam_tolerance) const
+    {
+      float dist = std::max(distance(closestPoint(cam_pos), cam_pos) - cam_tolerance, 0.f);
+      return size2 > thresh * dist * dist;
+    }
     inline Vec3f closestPoint(const Vec3f& point) const
     {
       return clamp(point, _bbMin, _bbMax);
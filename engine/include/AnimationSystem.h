@@ -10,6 +10,10 @@ namespace fly
   class Entity;
   class Animation;
 
+  /**
+  * The update functions of the animations run as part of update(), they may move objects of the scene (see System::sceneData()).
+  * Other data they modify, e.g. a light that is read by the renderer, has to be declared with addWrite().
+  */
   class AnimationSystem : public System
   {
   public:
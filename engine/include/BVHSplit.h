@@ -0,0 +1,150 @@
+#ifndef BVHSPLIT_H
+#define BVHSPLIT_H
+
+#include <AABB.h>
+#include <Sphere.h>
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <limits>
+
+namespace fly
+{
+  /**
+  * Quality metrics of a BVH, both are relative to the surface area of the root node. The SAH cost is the expected
+  * cost of a query with a random ray (one unit per visited node and per tested object), the overlap is the summed
+  * surface area of the intersections of sibling nodes. Lower is better for both metrics.
+  */
+  struct BVHQuality
+  {
+    float _sahCost = 0.f;
+    float _overlap = 0.f;
+  };
+
+  namespace BVHMetrics
+  {
+    static inline float surfaceArea(const AABB& aabb)
+    {
+      auto extent = maximum(aabb.getMax() - aabb.getMin(), Vec3f(0.f));
+      return 2.f * (extent[0] * extent[1] + extent[0] * extent[2] + extent[1] * extent[2]);
+    }
+    static inline float surfaceArea(const Sphere& sphere)
+    {
+      return 4.f * glm::pi<float>() * sphere.radius() * sphere.radius();
+    }
+    static inline float overlap(const AABB& a, const AABB& b)
+    {
+      return surfaceArea(a.getIntersection(b));
+    }
+    static inline float overlap(const Sphere& a, const Sphere& b)
+    {
+      return overlap(AABB(a.getMin(), a.getMax()), AABB(b.getMin(), b.getMax()));
+    }
+  }
+
+  /**
+  * Split policies decide how the objects of an internal BVH node are distributed among its two children.
+  * operator() reorders the objects in the range [begin, end), which contains at least three objects, and
+  * returns the number of objects that go to the left child. bv is the union of the bounding volumes of all objects in the range.
+  */
+
+  /**
+  * Splits the objects at the median along the longest axis of the node, this results in a perfectly balanced tree.
+  * Only a partial ordering is required, hence nth_element is used instead of a full sort, which makes the build O(n log n).
+  */
+  template<typename T, typename GetBoundingVolume>
+  struct MedianSplit
+  {
+    template<typename BV>
+    inline unsigned operator()(T* begin, T* end, const BV& bv, unsigned depth) const
+    {
+      auto axis = bv.getLongestAxis();
+      unsigned num_objects_left = static_cast<unsigned>(end - begin) / 2u;
+      std::nth_element(begin, begin + num_objects_left, end, [&axis](const T& o1, const T& o2) {
+        return GetBoundingVolume()(o1).center(axis) > GetBoundingVolume()(o2).center(axis);
+      });
+      return num_objects_left;
+    }
+  };
+
+  /**
+  * Binned surface area heuristic (SAH). The object centers are sorted into num_bins equally sized bins along each axis,
+  * and the split between two bins that minimizes the summed surface area of the children weighted by their number of objects is chosen.
+  * Compared to median splits, the children overlap less if the object sizes vary a lot, so fewer nodes are visited during culling.
+  * Falls back to a median split if no valid split is found or the tree gets deeper than maxDepth, which keeps the depth bounded.
+  */
+  template<typename T, typename GetBoundingVolume, unsigned num_bins = 16>
+  struct BinnedSAHSplit
+  {
+    static const unsigned maxDepth = 32;
+    template<typename BV>
+    inline unsigned operator()(T* begin, T* end, const BV& bv, unsigned depth) const
+    {
+      if (depth >= maxDepth) {
+        return MedianSplit<T, GetBoundingVolume>()(begin, end, bv, depth);
+      }
+      Vec3f center_min(std::numeric_limits<float>::max());
+      Vec3f center_max(std::numeric_limits<float>::lowest());
+      for (auto it = begin; it != end; it++) {
+        auto center = GetBoundingVolume()(*it).center();
+        center_min = minimum(center_min, center);
+        center_max = maximum(center_max, center);
+      }
+      float best_cost = std::numeric_limits<float>::max();
+      unsigned best_axis = 0;
+      unsigned best_bin = num_bins;
+      for (unsigned char axis = 0; axis < 3; axis++) {
+        float extent = center_max[axis] - center_min[axis];
+        if (extent <= 0.f) {
+          continue;
+        }
+        BV bin_bvs[num_bins];
+        unsigned bin_counts[num_bins] = {};
+        for (auto it = begin; it != end; it++) {
+          auto bin = binIndex(GetBoundingVolume()(*it), axis, center_min[axis], extent);
+          bin_bvs[bin] = bin_bvs[bin].getUnion(GetBoundingVolume()(*it));
+          bin_counts[bin]++;
+        }
+        float right_areas[num_bins];
+        unsigned right_counts[num_bins];
+        BV right_bv;
+        unsigned right_count = 0;
+        for (unsigned i = num_bins - 1u; i > 0; i--) {
+          right_bv = right_bv.getUnion(bin_bvs[i]);
+          right_count += bin_counts[i];
+          right_areas[i] = right_count ? BVHMetrics::surfaceArea(right_bv) : 0.f;
+          right_counts[i] = right_count;
+        }
+        BV left_bv;
+        unsigned left_count = 0;
+        for (unsigned i = 0; i < num_bins - 1u; i++) {
+          left_bv = left_bv.getUnion(bin_bvs[i]);
+          left_count += bin_counts[i];
+          if (left_count && right_counts[i + 1u]) {
+            float cost = BVHMetrics::surfaceArea(left_bv) * left_count + right_areas[i + 1u] * right_counts[i + 1u];
+            if (cost < best_cost) {
+              best_cost = cost;
+              best_axis = axis;
+              best_bin = i;
+            }
+          }
+        }
+      }
+      if (best_bin == num_bins) {
+        return MedianSplit<T, GetBoundingVolume>()(begin, end, bv, depth);
+      }
+      float extent = center_max[best_axis] - center_min[best_axis];
+      auto mid = std::partition(begin, end, [&](const T& o) {
+        return binIndex(GetBoundingVolume()(o), best_axis, center_min[best_axis], extent) <= best_bin;
+      });
+      return static_cast<unsigned>(mid - begin);
+    }
+  private:
+    template<typename BV>
+    static inline unsigned binIndex(const BV& bv, unsigned char axis, float center_min, float extent)
+    {
+      return std::min(static_cast<unsigned>((bv.center()[axis] - center_min) / extent * num_bins), num_bins - 1u);
+    }
+  };
+}
+
+#endif // !BVHSPLIT_H
@@ -11,6 +11,7 @@ namespace fly
   * Controls the speed of the camera, depending if the camera intersects any of the scenes static geometry.
   * This class is only used for demonstration purposes on how to perform intersection tests with a 
   * Bounding Volume Hierarchy (BVH)
+  * The camera controller has to exist when the system is constructed, because the system declares that it modifies it.
   */
   template<typename API, typename BV>
   class CamSpeedSystem : public System
@@ -20,6 +21,9 @@ namespace fly
       _bvhStatic(renderer.getStaticBVH()),
       _camController(camera_controller)
     {
+      addRead(&renderer);
+      addRead(camera_controller->getCamera().get());
+      addWrite(camera_controller.get());
     }
     virtual ~CamSpeedSystem() = default;
     virtual void update() override
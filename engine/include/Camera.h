@@ -9,6 +9,7 @@ namespace fly
 {
   class AABB;
   class Sphere;
+  class SoftwareOcclusionCuller;
 
   class Camera
   {
@@ -41,8 +42,41 @@ namespace fly
       float _thresh;
       std::array<Vec4f, 6> _frustumPlanes;
       float _lodRange;
+      /**
+      * Occlusion buffer of this view, the occluders must be rasterized with the same view projection matrix. nullptr disables occlusion culling.
+      */
+      SoftwareOcclusionCuller const * _occlusionCuller = nullptr;
     };
     CullingParams getCullingParams() const;
+    /**
+    * Culling parameters with frustum planes extracted from vp, the camera's own frustum planes are not modified.
+    */
+    CullingParams getCullingParams(const Mat4f& vp, ZNearMapping z_near_mapping) const;
+    /**
+    * Culling parameters for several views that are culled in a single BVH traversal, e.g. the camera view and all shadow cascades.
+    * All views share the detail culling parameters, only the frustum planes differ.
+    */
+    struct MultiViewCullingParams
+    {
+      static const unsigned maxViews = 8;
+      Vec3f _camPos;
+      float _thresh;
+      unsigned _numViews;
+      std::array<std::array<Vec4f, 6>, maxViews> _frustumPlanes;
+    };
+    /**
+    * Conservative culling parameters that stay valid while the camera moves less than _tolerance and no frustum plane moves
+    * more than _tolerance. Objects inside the inner frustum stay visible, objects outside of the outer frustum stay invisible.
+    * Both frustums are the frustum of the camera, shrunk and expanded by _tolerance.
+    */
+    struct TemporalCullingParams
+    {
+      Vec3f _camPos;
+      float _thresh;
+      float _tolerance;
+      std::array<Vec4f, 6> _innerFrustumPlanes;
+      std::array<Vec4f, 6> _outerFrustumPlanes;
+    };
     struct Params
     {
       float _near;
@@ -63,6 +97,7 @@ namespace fly
     float _detailCullingThreshold = 0.000175f;
     float _lodRangeMultiplier = 128.f;
     Params _params;
+    static void extractFrustumPlanes(const Mat4f& vp, ZNearMapping z_near_mapping, std::array<Vec4f, 6>& frustum_planes);
   };
 }
 
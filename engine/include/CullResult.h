@@ -2,6 +2,7 @@
 #define CULLRESULT_H
 
 #include <StackPOD.h>
+#include <vector>
 
 namespace fly
 {
@@ -10,6 +11,11 @@ namespace fly
   {
     StackPOD<T> _fullyVisibleObjects;
     StackPOD<T> _probablyVisibleObjects;
+    /**
+    * Per BVH node, the frustum plane that rejected the node during the last culling pass. Kept across passes, so each
+    * cull result should be used for a single view. Indexed by the node index, the BVH resizes it as needed.
+    */
+    std::vector<unsigned char> _rejectingPlanes;
     inline void reserve(size_t size)
     {
       _fullyVisibleObjects.reserve(size);
@@ -29,6 +35,85 @@ namespace fly
       return _fullyVisibleObjects.size() + _probablyVisibleObjects.size();
     }
   };
+
+  /**
+  * Result of a parallel BVH traversal for a single view. Each subtree job appends to its own chunk, the chunks are processed
+  * one by one instead of being merged into a single list. Chunks are kept across traversals, so their memory is reused.
+  * The rejecting planes are shared by all chunks, because each node is visited by one job only.
+  */
+  template<typename T>
+  struct ParallelCullResult
+  {
+    std::vector<unsigned char> _rejectingPlanes;
+    /**
+    * Clears the chunks and makes sure there are at least num_chunks. Must be called before references to the chunks are taken.
+    */
+    inline void setNumChunks(unsigned num_chunks)
+    {
+      if (_chunks.size() < num_chunks) {
+        _chunks.resize(num_chunks);
+      }
+      for (unsigned i = 0; i < num_chunks; i++) {
+        _chunks[i].clear();
+      }
+      _numChunks = num_chunks;
+    }
+    inline unsigned getNumChunks() const
+    {
+      return _numChunks;
+    }
+    inline CullResult<T>& getChunk(unsigned i)
+    {
+      return _chunks[i];
+    }
+    inline const CullResult<T>& getChunk(unsigned i) const
+    {
+      return _chunks[i];
+    }
+    inline size_t size()
+    {
+      size_t size = 0;
+      for (unsigned i = 0; i < _numChunks; i++) {
+        size += _chunks[i].size();
+      }
+      return size;
+    }
+  private:
+    std::vector<CullResult<T>> _chunks;
+    unsigned _numChunks = 0;
+  };
+
+  /**
+  * Result of culling several views in a single BVH traversal. Every object is stored once, together with bitmasks of
+  * the views in which it is fully visible and the views in which it is probably visible, bit i corresponds to view i.
+  */
+  template<typename T>
+  struct MultiViewCullResult
+  {
+    struct Entry
+    {
+      T _object;
+      unsigned char _fullyVisibleViews;
+      unsigned char _probablyVisibleViews;
+    };
+    StackPOD<Entry> _objects;
+    inline void reserve(size_t size)
+    {
+      _objects.reserve(size);
+    }
+    inline void clear()
+    {
+      _objects.clear();
+    }
+    inline size_t size()
+    {
+      return _objects.size();
+    }
+    inline void add(const T& object, unsigned char fully_visible_views, unsigned char probably_visible_views)
+    {
+      _objects.push_back({ object, fully_visible_views, probably_visible_views });
+    }
+  };
 }
 
 #endif // !CULLRESULT_H
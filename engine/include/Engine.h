@@ -2,9 +2,12 @@
 #define ENGINE_H
 
 #include <Leakcheck.h>
+#include <exception>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <GameTimer.h>
+#include <JobSystem.h>
 
 namespace fly
 {
@@ -16,11 +19,48 @@ namespace fly
     Engine();
     void addSystem(const std::shared_ptr<System>& system);
     void removeSystem(const std::shared_ptr<System>& system);
+    /**
+    * Updates all systems. The systems form a dependency graph, built from the data they declare and their explicit dependencies
+    * (see System). If parallel updates are enabled, systems that don't depend on each other are updated concurrently on the JobSystem.
+    * If a system throws, the systems that were not started yet are skipped and the first exception is rethrown once the others finished.
+    */
     void update();
     GameTimer * getGameTimer();
+    void setParallelUpdates(bool enabled);
+    bool getParallelUpdates() const;
+    const std::vector<std::shared_ptr<System>>& getSystems() const;
+    /**
+    * Duration of the last update of each system in microseconds, in the same order as getSystems().
+    */
+    const std::vector<unsigned>& getSystemMicroSeconds() const;
   private:
     std::vector<std::shared_ptr<System>> _systems;
     GameTimer _gameTimer;
+    /**
+    * Off by default, systems of applications may not declare all the data they access yet.
+    */
+    bool _parallelUpdates = false;
+    /**
+    * Per system, the indices of the systems that have to be updated before it. Rebuilt whenever systems are added or removed.
+    */
+    std::vector<std::vector<unsigned>> _predecessors;
+    /**
+    * Topological order of the systems, ties are broken by the order in which the systems were added.
+    */
+    std::vector<unsigned> _order;
+    std::vector<unsigned> _systemMicroSeconds;
+    std::vector<JobSystem::JobHandle> _jobs;
+    std::vector<JobSystem::JobHandle> _dependencyJobs;
+    /**
+    * First exception that a system threw during a parallel update.
+    */
+    std::exception_ptr _updateException;
+    std::mutex _updateExceptionMutex;
+    /**
+    * Throws if the systems depend on each other, directly or through a cycle. The previous graph is kept in that case.
+    */
+    void buildDependencyGraph();
+    void updateSystem(unsigned index);
   };
 }
 
@@ -11,7 +11,8 @@ namespace fly
     MR_ALPHA_MAP = 4,
     MR_HEIGHT_MAP = 8,
     MR_WIND = 16,
-    MR_REFLECTIVE = 32
+    MR_REFLECTIVE = 32,
+    MR_MULTI_DRAW = 64
   };
 
   enum ShaderSetupFlags : unsigned
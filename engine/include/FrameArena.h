@@ -0,0 +1,86 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace fly
+{
+  /**
+  * Linear allocator for memory that only lives until the end of a frame. Every thread of the job system bumps its own
+  * sub-arena, so allocations need no synchronization, and reset() releases all of them at once.
+  * A sub-arena that runs out of memory takes further blocks from the heap. The next reset() replaces all blocks by a single one
+  * that is large enough for the whole frame, so the heap is only touched until the peak usage is reached.
+  * All threads outside of the job system share one sub-arena, only one of them may allocate at a time, usually the render thread.
+  */
+  class FrameArena
+  {
+  public:
+    /**
+    * If num_threads is zero, there is one sub-arena per thread of the job system.
+    */
+    FrameArena(size_t initial_bytes_per_thread = 1u << 16, unsigned num_threads = 0);
+    ~FrameArena();
+    FrameArena(const FrameArena& other) = delete;
+    FrameArena& operator=(const FrameArena& other) = delete;
+    inline void* allocate(size_t num_bytes, size_t alignment = alignof(std::max_align_t))
+    {
+      auto& sub_arena = _subArenas[threadIndex()];
+      auto ptr = align(sub_arena._ptr, alignment);
+      if (ptr + num_bytes > sub_arena._end) {
+        return allocateBlock(sub_arena, num_bytes, alignment);
+      }
+      sub_arena._ptr = ptr + num_bytes;
+      return ptr;
+    }
+    template<typename T>
+    inline T* allocate(size_t count)
+    {
+      return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+    /**
+    * Invalidates all memory that was allocated since the last reset. Must not be called while other threads allocate.
+    */
+    void reset();
+    /**
+    * Heap allocations of the arena since the last reset, including the ones reset() needed to grow the sub-arenas. Zero once the arena
+    * has grown to the peak usage, but it says nothing about heap allocations outside of the arena, e.g. of the job system.
+    */
+    unsigned getNumHeapAllocations() const;
+    /**
+    * Bytes that are owned by the arena, summed over all sub-arenas.
+    */
+    size_t getCapacity() const;
+  private:
+    /**
+    * Padded to a cache line, because every sub-arena is written by its own thread.
+    */
+    struct alignas(64) SubArena
+    {
+      char* _ptr = nullptr;
+      char* _end = nullptr;
+      std::unique_ptr<char[]> _block;
+      size_t _blockSize = 0;
+      /**
+      * Blocks that were taken from the heap after _block was exhausted, merged into _block by the next reset().
+      */
+      std::vector<std::unique_ptr<char[]>> _overflowBlocks;
+      size_t _overflowBytes = 0;
+    };
+    std::unique_ptr<SubArena[]> _subArenas;
+    unsigned _numSubArenas;
+    std::atomic<unsigned> _numHeapAllocations{ 0u };
+    unsigned threadIndex() const;
+    void* allocateBlock(SubArena& sub_arena, size_t num_bytes, size_t alignment);
+    static inline char* align(char* ptr, size_t alignment)
+    {
+      auto address = reinterpret_cast<uintptr_t>(ptr);
+      return ptr + ((alignment - address % alignment) % alignment);
+    }
+  };
+}
+
+#endif
\ No newline at end of file
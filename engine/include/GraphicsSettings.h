@@ -24,6 +24,10 @@ namespace fly
       virtual void gammaChanged(GraphicsSettings const * gs) = 0;
       virtual void screenSpaceReflectionsChanged(GraphicsSettings const * gs) = 0;
       virtual void godRaysChanged(GraphicsSettings const * gs) = 0;
+      /**
+      * Only the shaders of the meshes depend on this setting.
+      */
+      virtual void multiDrawIndirectChanged(GraphicsSettings const * gs) = 0;
     };
     GraphicsSettings();
     void addListener(const std::shared_ptr<Listener>& listener);
@@ -98,6 +102,25 @@ namespace fly
     bool getMultithreadedCulling() const;
     void setMultithreadedDetailCulling(bool enabled);
     bool getMultithreadedDetailCulling() const;
+    void setMultithreadedBVHTraversal(bool enabled);
+    bool getMultithreadedBVHTraversal() const;
+    void setMultithreadedCommandRecording(bool enabled);
+    bool getMultithreadedCommandRecording() const;
+    void setMultiDrawIndirect(bool enabled);
+    bool getMultiDrawIndirect() const;
+    void setPipelinedRendering(bool enabled);
+    bool getPipelinedRendering() const;
+    void setOcclusionCulling(bool enabled);
+    bool getOcclusionCulling() const;
+    void setTemporalCulling(bool enabled);
+    bool getTemporalCulling() const;
+    void setTemporalCullingTolerance(float tolerance);
+    float getTemporalCullingTolerance() const;
+    /**
+    * If enabled, shaders are rebuilt in the background when settings change and the old shaders are used until the new ones are ready.
+    */
+    void setAsyncShaderRebuild(bool enabled);
+    bool getAsyncShaderRebuild() const;
     void setGodRays(bool enabled);
     bool getGodRays() const;
     void setGodRaySteps(float steps);
@@ -146,6 +169,14 @@ namespace fly
     float _shadowPolygonOffsetUnits = 1.f;
     bool _multithreadedCulling = false;
     bool _multithreadedDetailCulling = false;
+    bool _multithreadedBVHTraversal = false;
+    bool _multithreadedCommandRecording = false;
+    bool _multiDrawIndirect = false;
+    bool _pipelinedRendering = false;
+    bool _occlusionCulling = false;
+    bool _temporalCulling = false;
+    float _temporalCullingTolerance = 0.5f;
+    bool _asyncShaderRebuild = false;
     bool _godRays = true;
     float _godRaySteps = 64.f;
     float _godRayScaleFactor = 0.5f;
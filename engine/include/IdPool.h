@@ -0,0 +1,41 @@
+#ifndef IDPOOL_H
+#define IDPOOL_H
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace fly
+{
+  /**
+  * Hands out the smallest id that is not in use, so ids stay dense while objects are created and destroyed. Thread safe.
+  */
+  class IdPool
+  {
+  public:
+    unsigned acquire()
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (_freeIds.empty()) {
+        return _nextId++;
+      }
+      std::pop_heap(_freeIds.begin(), _freeIds.end(), std::greater<unsigned>());
+      auto id = _freeIds.back();
+      _freeIds.pop_back();
+      return id;
+    }
+    void release(unsigned id)
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _freeIds.push_back(id);
+      std::push_heap(_freeIds.begin(), _freeIds.end(), std::greater<unsigned>());
+    }
+  private:
+    std::mutex _mutex;
+    std::vector<unsigned> _freeIds; // Min heap
+    unsigned _nextId = 0;
+  };
+}
+
+#endif
\ No newline at end of file
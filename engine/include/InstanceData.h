@@ -0,0 +1,21 @@
+#ifndef INSTANCEDATA_H
+#define INSTANCEDATA_H
+
+#include <math/FlyMath.h>
+
+namespace fly
+{
+  /**
+  * Per instance data in a storage buffer, matches the InstanceData struct of the GLSL shaders.
+  * Also used for the per draw data of multi draw batches.
+  */
+  struct InstanceData
+  {
+    Mat4f _modelMatrix;
+    Mat4f _modelMatrixInverse;
+    unsigned _index; // Currently an index into a color array
+    unsigned _padding[3];
+  };
+}
+
+#endif // !INSTANCEDATA_H
@@ -4,6 +4,7 @@
 #include <AABB.h>
 #include <Sphere.h>
 #include <array>
+#include <xmmintrin.h>
 
 namespace fly
 {
@@ -12,6 +13,63 @@ namespace fly
     OUTSIDE, INSIDE, INTERSECTING
   };
 
+  /**
+  * Frustum planes in structure-of-arrays layout. Every plane component is broadcast to all four SSE lanes,
+  * so that four bounding volumes can be classified against the frustum with a single pass over the planes.
+  * Should be set up once per culling pass, see IntersectionTests::frustumIntersectsBoundingVolumes().
+  */
+  struct FrustumPlanesSIMD
+  {
+    __m128 _x[6], _y[6], _z[6], _w[6];
+    __m128 _absX[6], _absY[6], _absZ[6];
+    FrustumPlanesSIMD(const std::array<Vec4f, 6>& frustum_planes)
+    {
+      for (unsigned i = 0; i < 6; i++) {
+        _x[i] = _mm_set1_ps(frustum_planes[i][0]);
+        _y[i] = _mm_set1_ps(frustum_planes[i][1]);
+        _z[i] = _mm_set1_ps(frustum_planes[i][2]);
+        _w[i] = _mm_set1_ps(frustum_planes[i][3]);
+        _absX[i] = _mm_set1_ps(std::abs(frustum_planes[i][0]));
+        _absY[i] = _mm_set1_ps(std::abs(frustum_planes[i][1]));
+        _absZ[i] = _mm_set1_ps(std::abs(frustum_planes[i][2]));
+      }
+    }
+  };
+
+  /**
+  * Frustum planes of up to eight views in structure-of-arrays layout, lane i of group g holds the planes of view 4 * g + i.
+  * Unused lanes repeat the last view. Used to classify a single bounding volume against all views at once,
+  * see IntersectionTests::frustumsIntersectBoundingVolume().
+  */
+  struct MultiFrustumPlanesSIMD
+  {
+    static const unsigned maxViews = 8;
+    __m128 _x[2][6], _y[2][6], _z[2][6], _w[2][6];
+    __m128 _absX[2][6], _absY[2][6], _absZ[2][6];
+    unsigned _numViews;
+    unsigned _numGroups;
+    MultiFrustumPlanesSIMD(std::array<Vec4f, 6> const * frustum_planes, unsigned num_views) :
+      _numViews(num_views),
+      _numGroups((num_views + 3u) / 4u)
+    {
+      for (unsigned g = 0; g < _numGroups; g++) {
+        std::array<Vec4f, 6> const * views[4];
+        for (unsigned i = 0; i < 4; i++) {
+          views[i] = frustum_planes + std::min(g * 4u + i, num_views - 1u);
+        }
+        for (unsigned i = 0; i < 6; i++) {
+          _x[g][i] = _mm_setr_ps((*views[0])[i][0], (*views[1])[i][0], (*views[2])[i][0], (*views[3])[i][0]);
+          _y[g][i] = _mm_setr_ps((*views[0])[i][1], (*views[1])[i][1], (*views[2])[i][1], (*views[3])[i][1]);
+          _z[g][i] = _mm_setr_ps((*views[0])[i][2], (*views[1])[i][2], (*views[2])[i][2], (*views[3])[i][2]);
+          _w[g][i] = _mm_setr_ps((*views[0])[i][3], (*views[1])[i][3], (*views[2])[i][3], (*views[3])[i][3]);
+          _absX[g][i] = _mm_setr_ps(std::abs((*views[0])[i][0]), std::abs((*views[1])[i][0]), std::abs((*views[2])[i][0]), std::abs((*views[3])[i][0]));
+          _absY[g][i] = _mm_setr_ps(std::abs((*views[0])[i][1]), std::abs((*views[1])[i][1]), std::abs((*views[2])[i][1]), std::abs((*views[3])[i][1]));
+          _absZ[g][i] = _mm_setr_ps(std::abs((*views[0])[i][2]), std::abs((*views[1])[i][2]), std::abs((*views[2])[i][2]), std::abs((*views[3])[i][2]));
+        }
+      }
+    }
+  };
+
   namespace IntersectionTests
   {
     static inline IntersectionResult planeIntersectsAABB(const Vec4f& plane, const Vec3f& half_diagonal, const Vec4f& center)
@@ -78,6 +136,174 @@ namespace fly
       }
       return intersecting ? IntersectionResult::INTERSECTING : IntersectionResult::INSIDE;
     }
+    /**
+    * Hierarchical variant of frustumIntersectsBoundingVolume(). Only the planes in plane_mask (bit i corresponds to plane i) are tested,
+    * planes that fully contain the bounding volume are removed from plane_mask, so that children of a BVH node don't test them again.
+    * The plane rejecting_plane is tested first, it is updated with the plane that rejected the bounding volume. With a slowly moving camera,
+    * the plane that rejected a node in the last frame most likely rejects it again.
+    */
+    static inline IntersectionResult frustumIntersectsBoundingVolume(const AABB& aabb, const std::array<Vec4f, 6>& frustum_planes,
+      unsigned char& plane_mask, unsigned char& rejecting_plane)
+    {
+      auto half_diagonal = (aabb.getMax() - aabb.getMin()) * 0.5f;
+      Vec4f center(aabb.center(), 1.f);
+      if ((plane_mask & (1u << rejecting_plane)) && aabbOutsideFrustum(frustum_planes[rejecting_plane], half_diagonal, center)) {
+        return IntersectionResult::OUTSIDE;
+      }
+      for (unsigned char i = 0; i < 6; i++) {
+        if (plane_mask & (1u << i)) {
+          auto result = planeIntersectsAABB(frustum_planes[i], half_diagonal, center);
+          if (result == IntersectionResult::OUTSIDE) {
+            rejecting_plane = i;
+            return IntersectionResult::OUTSIDE;
+          }
+          else if (result == IntersectionResult::INSIDE) {
+            plane_mask &= ~(1u << i);
+          }
+        }
+      }
+      return plane_mask ? IntersectionResult::INTERSECTING : IntersectionResult::INSIDE;
+    }
+    static inline IntersectionResult frustumIntersectsBoundingVolume(const Sphere& sphere, const std::array<Vec4f, 6>& frustum_planes,
+      unsigned char& plane_mask, unsigned char& rejecting_plane)
+    {
+      if ((plane_mask & (1u << rejecting_plane)) && planeIntersectsSphere(frustum_planes[rejecting_plane], sphere) == IntersectionResult::OUTSIDE) {
+        return IntersectionResult::OUTSIDE;
+      }
+      for (unsigned char i = 0; i < 6; i++) {
+        if (plane_mask & (1u << i)) {
+          auto result = planeIntersectsSphere(frustum_planes[i], sphere);
+          if (result == IntersectionResult::OUTSIDE) {
+            rejecting_plane = i;
+            return IntersectionResult::OUTSIDE;
+          }
+          else if (result == IntersectionResult::INSIDE) {
+            plane_mask &= ~(1u << i);
+          }
+        }
+      }
+      return plane_mask ? IntersectionResult::INTERSECTING : IntersectionResult::INSIDE;
+    }
+    /**
+    * Bounding volumes of a batch in structure-of-arrays layout, the extent is the half diagonal for AABBs
+    * and the radius for spheres.
+    */
+    struct BoundingVolumesSoA
+    {
+      alignas(16) float _centerX[4];
+      alignas(16) float _centerY[4];
+      alignas(16) float _centerZ[4];
+      alignas(16) float _extentX[4];
+      alignas(16) float _extentY[4];
+      alignas(16) float _extentZ[4];
+    };
+    static inline void loadSoA(const AABB& aabb, unsigned lane, BoundingVolumesSoA& soa)
+    {
+      auto center = aabb.center();
+      auto half_diagonal = (aabb.getMax() - aabb.getMin()) * 0.5f;
+      soa._centerX[lane] = center[0];
+      soa._centerY[lane] = center[1];
+      soa._centerZ[lane] = center[2];
+      soa._extentX[lane] = half_diagonal[0];
+      soa._extentY[lane] = half_diagonal[1];
+      soa._extentZ[lane] = half_diagonal[2];
+    }
+    static inline void loadSoA(const Sphere& sphere, unsigned lane, BoundingVolumesSoA& soa)
+    {
+      soa._centerX[lane] = sphere.center()[0];
+      soa._centerY[lane] = sphere.center()[1];
+      soa._centerZ[lane] = sphere.center()[2];
+      soa._extentX[lane] = sphere.radius();
+      soa._extentY[lane] = sphere.radius();
+      soa._extentZ[lane] = sphere.radius();
+    }
+    /**
+    * Projected extent of the bounding volumes onto the plane normal.
+    */
+    static inline __m128 projectedExtent(const BoundingVolumesSoA& soa, const FrustumPlanesSIMD& fp, unsigned plane, AABB const *)
+    {
+      return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(soa._extentX), fp._absX[plane]),
+        _mm_mul_ps(_mm_load_ps(soa._extentY), fp._absY[plane])), _mm_mul_ps(_mm_load_ps(soa._extentZ), fp._absZ[plane]));
+    }
+    static inline __m128 projectedExtent(const BoundingVolumesSoA& soa, const FrustumPlanesSIMD& fp, unsigned plane, Sphere const *)
+    {
+      return _mm_load_ps(soa._extentX);
+    }
+    /**
+    * Classifies up to four bounding volumes against the frustum at once. Computes the same results as 
+    * frustumIntersectsBoundingVolume() for each of the bounding volumes. count must be between 1 and 4, 
+    * unused lanes are filled with the last bounding volume.
+    */
+    template<typename BV>
+    static inline void frustumIntersectsBoundingVolumes(BV const * const * bvs, unsigned count, const FrustumPlanesSIMD& fp, IntersectionResult* results)
+    {
+      BoundingVolumesSoA soa;
+      for (unsigned i = 0; i < 4; i++) {
+        loadSoA(*bvs[std::min(i, count - 1u)], i, soa);
+      }
+      auto cx = _mm_load_ps(soa._centerX);
+      auto cy = _mm_load_ps(soa._centerY);
+      auto cz = _mm_load_ps(soa._centerZ);
+      auto outside = _mm_setzero_ps();
+      auto intersecting = _mm_setzero_ps();
+      for (unsigned i = 0; i < 6; i++) {
+        auto s = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, fp._x[i]), _mm_mul_ps(cy, fp._y[i])), _mm_add_ps(_mm_mul_ps(cz, fp._z[i]), fp._w[i]));
+        auto e = projectedExtent(soa, fp, i, static_cast<BV const *>(nullptr));
+        outside = _mm_or_ps(outside, _mm_cmpgt_ps(_mm_sub_ps(s, e), _mm_setzero_ps()));
+        intersecting = _mm_or_ps(intersecting, _mm_cmpge_ps(_mm_add_ps(s, e), _mm_setzero_ps()));
+      }
+      int outside_mask = _mm_movemask_ps(outside);
+      int intersecting_mask = _mm_movemask_ps(intersecting);
+      for (unsigned i = 0; i < count; i++) {
+        if (outside_mask & (1 << i)) {
+          results[i] = IntersectionResult::OUTSIDE;
+        }
+        else {
+          results[i] = intersecting_mask & (1 << i) ? IntersectionResult::INTERSECTING : IntersectionResult::INSIDE;
+        }
+      }
+    }
+    static inline __m128 projectedExtent(const Vec3f& extent, const MultiFrustumPlanesSIMD& fp, unsigned group, unsigned plane, AABB const *)
+    {
+      return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(extent[0]), fp._absX[group][plane]),
+        _mm_mul_ps(_mm_set1_ps(extent[1]), fp._absY[group][plane])), _mm_mul_ps(_mm_set1_ps(extent[2]), fp._absZ[group][plane]));
+    }
+    static inline __m128 projectedExtent(const Vec3f& extent, const MultiFrustumPlanesSIMD& fp, unsigned group, unsigned plane, Sphere const *)
+    {
+      return _mm_set1_ps(extent[0]);
+    }
+    /**
+    * Classifies a bounding volume against all views of fp at once. Bit i of outside_mask is set if the bounding volume is outside of view i,
+    * bit i of intersecting_mask if it intersects the frustum of view i. The bounding volume is fully inside all remaining views.
+    * Computes the same results as frustumIntersectsBoundingVolume() for each view.
+    */
+    template<typename BV>
+    static inline void frustumsIntersectBoundingVolume(const BV& bv, const MultiFrustumPlanesSIMD& fp, unsigned& outside_mask, unsigned& intersecting_mask)
+    {
+      BoundingVolumesSoA soa;
+      loadSoA(bv, 0, soa);
+      auto cx = _mm_set1_ps(soa._centerX[0]);
+      auto cy = _mm_set1_ps(soa._centerY[0]);
+      auto cz = _mm_set1_ps(soa._centerZ[0]);
+      Vec3f extent(soa._extentX[0], soa._extentY[0], soa._extentZ[0]);
+      outside_mask = 0;
+      intersecting_mask = 0;
+      for (unsigned g = 0; g < fp._numGroups; g++) {
+        auto outside = _mm_setzero_ps();
+        auto intersecting = _mm_setzero_ps();
+        for (unsigned i = 0; i < 6; i++) {
+          auto s = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, fp._x[g][i]), _mm_mul_ps(cy, fp._y[g][i])), _mm_add_ps(_mm_mul_ps(cz, fp._z[g][i]), fp._w[g][i]));
+          auto e = projectedExtent(extent, fp, g, i, static_cast<BV const *>(nullptr));
+          outside = _mm_or_ps(outside, _mm_cmpgt_ps(_mm_sub_ps(s, e), _mm_setzero_ps()));
+          intersecting = _mm_or_ps(intersecting, _mm_cmpge_ps(_mm_add_ps(s, e), _mm_setzero_ps()));
+        }
+        outside_mask |= _mm_movemask_ps(outside) << (g * 4u);
+        intersecting_mask |= _mm_movemask_ps(intersecting) << (g * 4u);
+      }
+      unsigned views_mask = (1u << fp._numViews) - 1u;
+      outside_mask &= views_mask;
+      intersecting_mask &= views_mask & ~outside_mask;
+    }
   }
 }
 
@@ -0,0 +1,157 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fly
+{
+  /**
+  * Engine wide job system with persistent worker threads, so no threads are created in the frame loop.
+  * Every worker owns a deque, it pushes and pops its own jobs at the back and steals from the front of the other deques
+  * once its own deque is empty. Jobs that are scheduled from threads outside of the pool go into a shared deque.
+  * A job may depend on other jobs, it is queued once all of its dependencies finished. Threads that wait for a job
+  * execute other jobs in the meantime, so jobs can schedule and wait for jobs themselves without starving the pool.
+  * Jobs must not throw, use async() for work that may throw.
+  */
+  class JobSystem
+  {
+    struct Job;
+  public:
+    /**
+    * Handle to a scheduled job, it can be copied and waited for from any thread. A default constructed handle counts as finished.
+    */
+    class JobHandle
+    {
+    public:
+      JobHandle() = default;
+      bool isDone() const;
+    private:
+      friend class JobSystem;
+      JobHandle(const std::shared_ptr<Job>& job);
+      std::shared_ptr<Job> _job;
+    };
+    /**
+    * If num_workers is zero, one worker per hardware thread is created, minus one for the thread that waits for the jobs.
+    */
+    JobSystem(unsigned num_workers = 0);
+    ~JobSystem();
+    JobSystem(const JobSystem& other) = delete;
+    JobSystem& operator=(const JobSystem& other) = delete;
+    static JobSystem& getInstance();
+    /**
+    * Number of threads that execute jobs, the workers plus the waiting thread.
+    */
+    unsigned getNumThreads() const;
+    /**
+    * Index of the calling thread in [0, getNumThreads()), all threads outside of the pool share the last index.
+    */
+    unsigned getThreadIndex() const;
+    JobHandle schedule(std::function<void()> func);
+    JobHandle schedule(std::function<void()> func, std::initializer_list<JobHandle> dependencies);
+    JobHandle schedule(std::function<void()> func, const JobHandle* dependencies, unsigned num_dependencies);
+    /**
+    * Like schedule(), but the job is never executed by a worker, only by the main thread in waitOnMainThread().
+    * Used for work that has to stay on the main thread, e.g. because it makes graphics API calls.
+    */
+    JobHandle scheduleOnMainThread(std::function<void()> func, const JobHandle* dependencies, unsigned num_dependencies);
+    /**
+    * Executes other jobs until handle is done, but never the ones that were scheduled with scheduleOnMainThread().
+    */
+    void wait(const JobHandle& handle);
+    /**
+    * Like wait(), but also executes the jobs that were scheduled with scheduleOnMainThread(). Must only be called by the main thread
+    * outside of any job, so a main thread job never runs in the middle of other work that waits, e.g. a parallelFor().
+    */
+    void waitOnMainThread(const JobHandle& handle);
+    /**
+    * Drop-in replacement for std::async(std::launch::async, func) that runs func on the pool.
+    */
+    template<typename Func>
+    auto async(Func func) -> std::future<decltype(func())>
+    {
+      auto task = std::make_shared<std::packaged_task<decltype(func())()>>(std::move(func));
+      auto future = task->get_future();
+      schedule([task]() {
+        (*task)();
+      });
+      return future;
+    }
+    /**
+    * Calls func(range_begin, range_end) for consecutive ranges of at least min_range_size elements, at most one range per thread.
+    * The calling thread processes the first range itself, the call returns after all ranges are processed.
+    */
+    template<typename Func>
+    void parallelFor(unsigned begin, unsigned end, unsigned min_range_size, const Func& func)
+    {
+      if (begin >= end) {
+        return;
+      }
+      unsigned num_elements = end - begin;
+      unsigned num_ranges = std::max(std::min(getNumThreads(), num_elements / std::max(min_range_size, 1u)), 1u);
+      unsigned range_size = (num_elements + num_ranges - 1u) / num_ranges;
+      std::vector<JobHandle> jobs;
+      jobs.reserve(num_ranges - 1u);
+      for (unsigned range_begin = begin + range_size; range_begin < end; range_begin += range_size) {
+        unsigned range_end = std::min(range_begin + range_size, end);
+        jobs.push_back(schedule([&func, range_begin, range_end]() {
+          func(range_begin, range_end);
+        }));
+      }
+      func(begin, std::min(begin + range_size, end));
+      for (const auto& j : jobs) {
+        wait(j);
+      }
+    }
+  private:
+    struct Job
+    {
+      std::function<void()> _func;
+      /**
+      * Unfinished dependencies plus one that is held while the job is scheduled.
+      */
+      std::atomic<unsigned> _numDependencies{ 1u };
+      std::atomic<bool> _done{ false };
+      bool _mainThread = false;
+      std::mutex _mutex;
+      std::vector<std::shared_ptr<Job>> _dependents;
+    };
+    struct Queue
+    {
+      std::mutex _mutex;
+      std::deque<std::shared_ptr<Job>> _jobs;
+    };
+    /**
+    * One queue per worker, the last queue is shared by all threads outside of the pool.
+    */
+    std::vector<std::unique_ptr<Queue>> _queues;
+    /**
+    * Same as _workers.size(), but constant, so workers can read it while the pool is still being constructed.
+    */
+    unsigned const _numWorkers;
+    Queue _mainThreadQueue;
+    std::vector<std::thread> _workers;
+    std::atomic<unsigned> _numQueuedJobs{ 0u };
+    std::mutex _sleepMutex;
+    std::condition_variable _wakeUp;
+    bool _stop = false;
+    void workerLoop(unsigned index);
+    unsigned queueIndex() const;
+    JobHandle schedule(const std::shared_ptr<Job>& job, const JobHandle* dependencies, unsigned num_dependencies);
+    void push(const std::shared_ptr<Job>& job);
+    std::shared_ptr<Job> pop(unsigned index);
+    std::shared_ptr<Job> popMainThread();
+    void execute(const std::shared_ptr<Job>& job);
+  };
+}
+
+#endif
@@ -3,9 +3,17 @@
 
 #include <Camera.h>
 #include <vector>
+#include <algorithm>
 #include <StackPOD.h>
 #include <IntersectionTests.h>
 #include <CullResult.h>
+#include <BVHSplit.h>
+#include <SoftwareOcclusionCuller.h>
+#include <JobSystem.h>
+#include <Profiler.h>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
 
 /** 
 * Using boost object pools should be used in general. It ensures that
@@ -15,10 +23,9 @@
 */
 #define KD_TREE_USE_BOOST 1
 
+#include <memory>
 #if KD_TREE_USE_BOOST
 #include <boost/pool/object_pool.hpp>
-#else
-#include <memory>
 #endif
 
 namespace fly
@@ -47,41 +54,105 @@ namespace fly
   * always parallel to one of main coordinate axes. It is used for Hierarchical View Frustum Culling and Detail Culling
   * (see cullVisibleObjects()) and for coarse collision detection algorithms (see intersectObjects()). The
   * tree is built once in the constructor by passing a number of objects of type T (pointer type), associated with a bounding
-  * volume of type BV. Dynamic node insertion/removal is currently not supported, because this type of tree can easily become
-  * unbalanced.
+  * volume of type BV. The objects of each internal node are distributed among its children by SplitPolicy, see BVHSplit.h.
+  * An empty tree has no root, all queries on it return nothing.
+  * The upper levels of the tree are built in parallel, each of the resulting subtrees is allocated from its own node pool.
+  * Objects that moved can be refitted (see refit()), and objects can be inserted and removed (see insert() and remove()). These updates
+  * only touch the path from the affected leaf to the root, but the tree can become unbalanced over time, which is detected by needsRebuild().
   * TODO: Support for asynchronous streaming of nodes and individual objects from disk / database.
   */
-  template<typename T, typename BV, typename GetBoundingVolume = DefaultGetBoundingVolume<T, BV>, typename GetLargestBVSize = DefaultGetLargestBVSize<T>>
+  template<typename T, typename BV, typename GetBoundingVolume = DefaultGetBoundingVolume<T, BV>, typename GetLargestBVSize = DefaultGetLargestBVSize<T>,
+    typename SplitPolicy = MedianSplit<T, GetBoundingVolume>>
   class KdTree
   {
+    class NodePool;
   public:
+    class InternalNode;
     class Node
     {
     public:
-      Node(unsigned begin, unsigned end, std::vector<T>& objects)
+      Node(unsigned begin, unsigned end, std::vector<T>& objects) :
+        _subtreeSize(end - begin)
       {
         for (unsigned i = begin; i < end; i++) {
-          _bv = _bv.getUnion(GetBoundingVolume()(objects[i]));
-          _largestBVSize = std::max(_largestBVSize, GetLargestBVSize()(objects[i]));
+          addToBV(objects[i]);
         }
-        auto axis = _bv.getLongestAxis();
-        std::sort(&objects.front() + begin, &objects.front() + end, [&axis](const T& o1, const T& o2) {
-          return GetBoundingVolume()(o1).center(axis) > GetBoundingVolume()(o2).center(axis);
-        });
       }
       virtual ~Node() = default;
       const BV& getBV() const { return _bv; }
-      virtual void cullVisibleObjects(const Camera::CullingParams& cp, CullResult<T>& cull_result) const = 0;
+      /**
+      * plane_mask contains the frustum planes that intersect all ancestors of this node, the other planes don't need to be tested.
+      * rejecting_planes is indexed by the node index, see CullResult::_rejectingPlanes.
+      */
+      virtual void cullVisibleObjects(const Camera::CullingParams& cp, unsigned char plane_mask, std::vector<unsigned char>& rejecting_planes, CullResult<T>& cull_result) const = 0;
       virtual void cullAllObjects(const Camera::CullingParams& cp, StackPOD<T>& objects) const = 0;
+      /**
+      * Multi-view culling. intersecting_views are the views whose frustum intersects all ancestors of this node, inside_views
+      * are the views whose frustum fully contains one of the ancestors. Detail culling is the same for all views.
+      */
+      virtual void cullVisibleObjects(const Camera::MultiViewCullingParams& cp, const MultiFrustumPlanesSIMD& fp, unsigned char intersecting_views,
+        unsigned char inside_views, MultiViewCullResult<T>& cull_result) const = 0;
+      virtual void cullAllObjects(const Camera::MultiViewCullingParams& cp, unsigned char views, MultiViewCullResult<T>& cull_result) const = 0;
+      /**
+      * Temporal culling, see TemporalCullCache. Objects that stay visible within the tolerance are appended to stable_objects,
+      * objects close to the frustum boundary are appended to boundary_objects.
+      */
+      virtual void cullVisibleObjects(const Camera::TemporalCullingParams& cp, StackPOD<T>& stable_objects, StackPOD<T>& boundary_objects) const = 0;
+      virtual void cullAllObjects(const Camera::TemporalCullingParams& cp, StackPOD<T>& objects) const = 0;
       virtual void getSizeInBytes(size_t& bytes) const = 0;
       virtual void intersectObjects(const BV& bv, StackPOD<T>& intersected_objects) const = 0;
       virtual void cullVisibleNodes(const Camera::CullingParams& cp, StackPOD<Node const *>& nodes) const = 0;
       virtual void cullAllNodes(const Camera::CullingParams& cp, StackPOD<Node const *>& nodes) const = 0;
       virtual void countNodes(unsigned& internal_nodes, unsigned& leaf_nodes) const = 0;
+      /**
+      * Accumulates the unnormalized SAH cost and overlap of this subtree.
+      */
+      virtual void computeQuality(BVHQuality& quality) const = 0;
+      /**
+      * Number of objects stored in this node, zero for internal nodes.
+      */
+      virtual unsigned numObjects() const = 0;
+      inline bool isLeaf() const { return numObjects() != 0; }
+      /**
+      * Appends the objects of a leaf node, internal nodes don't append anything.
+      */
+      virtual void getObjects(std::vector<T>& objects) const = 0;
+      /**
+      * Recomputes the bounding volume from the objects for leaf nodes and from the children for internal nodes.
+      */
+      virtual void recomputeBV() = 0;
+      virtual void registerLeaves(std::unordered_map<T, Node*>& leaves) = 0;
     protected:
+      friend class KdTree;
       BV _bv;
       float _largestBVSize = 0.f;
-      inline bool isLargeEnough(const Camera::CullingParams& cp) const
+      InternalNode* _parent = nullptr;
+      /**
+      * Unique index of this node, used to look up per node data that is stored outside of the tree.
+      */
+      unsigned _index = 0;
+      /**
+      * Number of objects in this subtree, bounds the number of objects a parallel culling task appends for this node.
+      */
+      unsigned _subtreeSize;
+#if KD_TREE_USE_BOOST
+      /**
+      * Pool this node was allocated from, so releasing it doesn't have to search the pools.
+      */
+      NodePool* _pool = nullptr;
+#endif
+      inline void resetBV()
+      {
+        _bv = BV();
+        _largestBVSize = 0.f;
+      }
+      inline void addToBV(const T& object)
+      {
+        _bv = _bv.getUnion(GetBoundingVolume()(object));
+        _largestBVSize = std::max(_largestBVSize, GetLargestBVSize()(object));
+      }
+      template<typename CullingParams>
+      inline bool isLargeEnough(const CullingParams& cp) const
       {
         return _bv.isLargeEnough(cp._camPos, cp._thresh, _largestBVSize);
       }
@@ -89,6 +160,42 @@ namespace fly
       {
         return IntersectionTests::frustumIntersectsBoundingVolume(_bv, cp._frustumPlanes);
       }
+      /**
+      * Only tests the planes in plane_mask, starting with the plane that rejected this node during the last culling pass.
+      */
+      inline IntersectionResult intersectFrustum(const Camera::CullingParams& cp, unsigned char& plane_mask, std::vector<unsigned char>& rejecting_planes) const
+      {
+        return IntersectionTests::frustumIntersectsBoundingVolume(_bv, cp._frustumPlanes, plane_mask, rejecting_planes[_index]);
+      }
+      inline bool isLargeEnough(const Camera::TemporalCullingParams& cp) const
+      {
+        return _bv.isLargeEnough(cp._camPos, cp._thresh, _largestBVSize, cp._tolerance);
+      }
+      /**
+      * OUTSIDE if the node is outside of the outer frustum, INSIDE if it is inside the inner frustum, INTERSECTING otherwise.
+      */
+      inline IntersectionResult intersectFrustum(const Camera::TemporalCullingParams& cp) const
+      {
+        if (IntersectionTests::frustumIntersectsBoundingVolume(_bv, cp._outerFrustumPlanes) == IntersectionResult::OUTSIDE) {
+          return IntersectionResult::OUTSIDE;
+        }
+        return IntersectionTests::frustumIntersectsBoundingVolume(_bv, cp._innerFrustumPlanes) == IntersectionResult::INSIDE ?
+          IntersectionResult::INSIDE : IntersectionResult::INTERSECTING;
+      }
+      inline bool isOccluded(const Camera::CullingParams& cp) const
+      {
+        return cp._occlusionCuller && cp._occlusionCuller->isOccluded(_bv);
+      }
+      /**
+      * Removes the views from intersecting_views whose frustum doesn't intersect this node, the views that fully contain the node are moved to inside_views.
+      */
+      inline void intersectFrustums(const MultiFrustumPlanesSIMD& fp, unsigned char& intersecting_views, unsigned char& inside_views) const
+      {
+        unsigned outside_mask, intersecting_mask;
+        IntersectionTests::frustumsIntersectBoundingVolume(_bv, fp, outside_mask, intersecting_mask);
+        inside_views |= intersecting_views & ~(outside_mask | intersecting_mask);
+        intersecting_views &= intersecting_mask;
+      }
     };
     class LeafNodeSingle : public Node
     {
@@ -99,7 +206,7 @@ namespace fly
         _left = objects[begin];
       }
       virtual ~LeafNodeSingle() = default;
-      virtual void cullVisibleObjects(const Camera::CullingParams& cp, CullResult<T>& cull_result) const override
+      virtual void cullVisibleObjects(const Camera::CullingParams& cp, unsigned char plane_mask, std::vector<unsigned char>& rejecting_planes, CullResult<T>& cull_result) const override
       {
         cull_result._probablyVisibleObjects.push_back(_left);
       }
@@ -107,6 +214,23 @@ namespace fly
       {
         objects.push_back(_left);
       }
+      virtual void cullVisibleObjects(const Camera::MultiViewCullingParams& cp, const MultiFrustumPlanesSIMD& fp, unsigned char intersecting_views,
+        unsigned char inside_views, MultiViewCullResult<T>& cull_result) const override
+      {
+        cull_result.add(_left, inside_views, intersecting_views);
+      }
+      virtual void cullAllObjects(const Camera::MultiViewCullingParams& cp, unsigned char views, MultiViewCullResult<T>& cull_result) const override
+      {
+        cull_result.add(_left, views, 0);
+      }
+      virtual void cullVisibleObjects(const Camera::TemporalCullingParams& cp, StackPOD<T>& stable_objects, StackPOD<T>& boundary_objects) const override
+      {
+        boundary_objects.push_back(_left);
+      }
+      virtual void cullAllObjects(const Camera::TemporalCullingParams& cp, StackPOD<T>& objects) const override
+      {
+        objects.push_back(_left);
+      }
       virtual void getSizeInBytes(size_t& bytes) const override
       {
         bytes += sizeof(*this);
@@ -133,6 +257,27 @@ namespace fly
       {
         leaf_nodes += 1;
       }
+      virtual void computeQuality(BVHQuality& quality) const override
+      {
+        quality._sahCost += BVHMetrics::surfaceArea(_bv);
+      }
+      virtual unsigned numObjects() const override
+      {
+        return 1;
+      }
+      virtual void getObjects(std::vector<T>& objects) const override
+      {
+        objects.push_back(_left);
+      }
+      virtual void recomputeBV() override
+      {
+        resetBV();
+        addToBV(_left);
+      }
+      virtual void registerLeaves(std::unordered_map<T, Node*>& leaves) override
+      {
+        leaves[_left] = this;
+      }
     protected:
       T _left;
     };
@@ -148,10 +293,13 @@ namespace fly
       {
         bytes += sizeof(*this);
       }
-      virtual void cullVisibleObjects(const Camera::CullingParams& cp, CullResult<T>& cull_result) const override
+      virtual void cullVisibleObjects(const Camera::CullingParams& cp, unsigned char plane_mask, std::vector<unsigned char>& rejecting_planes, CullResult<T>& cull_result) const override
       {
         if (isLargeEnough(cp)) {
-          auto result = intersectFrustum(cp);
+          auto result = intersectFrustum(cp, plane_mask, rejecting_planes);
+          if (result != IntersectionResult::OUTSIDE && isOccluded(cp)) {
+            return;
+          }
           if (result == IntersectionResult::INSIDE) {
             add(cull_result._fullyVisibleObjects);
           }
@@ -161,11 +309,71 @@ namespace fly
         }
       }
       virtual void cullAllObjects(const Camera::CullingParams& cp, StackPOD<T>& objects) const override
+      {
+        if (isLargeEnough(cp) && !isOccluded(cp)) {
+          add(objects);
+        }
+      }
+      virtual void cullVisibleObjects(const Camera::MultiViewCullingParams& cp, const MultiFrustumPlanesSIMD& fp, unsigned char intersecting_views,
+        unsigned char inside_views, MultiViewCullResult<T>& cull_result) const override
+      {
+        if (isLargeEnough(cp)) {
+          intersectFrustums(fp, intersecting_views, inside_views);
+          if (intersecting_views | inside_views) {
+            cull_result.add(_left, inside_views, intersecting_views);
+            cull_result.add(_right, inside_views, intersecting_views);
+          }
+        }
+      }
+      virtual void cullAllObjects(const Camera::MultiViewCullingParams& cp, unsigned char views, MultiViewCullResult<T>& cull_result) const override
+      {
+        if (isLargeEnough(cp)) {
+          cull_result.add(_left, views, 0);
+          cull_result.add(_right, views, 0);
+        }
+      }
+      virtual void cullVisibleObjects(const Camera::TemporalCullingParams& cp, StackPOD<T>& stable_objects, StackPOD<T>& boundary_objects) const override
+      {
+        if (isLargeEnough(cp)) {
+          auto result = intersectFrustum(cp);
+          if (result == IntersectionResult::INSIDE) {
+            add(stable_objects);
+          }
+          else if (result == IntersectionResult::INTERSECTING) {
+            add(boundary_objects);
+          }
+        }
+      }
+      virtual void cullAllObjects(const Camera::TemporalCullingParams& cp, StackPOD<T>& objects) const override
       {
         if (isLargeEnough(cp)) {
           add(objects);
         }
       }
+      virtual void computeQuality(BVHQuality& quality) const override
+      {
+        quality._sahCost += BVHMetrics::surfaceArea(_bv) * 2.f;
+      }
+      virtual unsigned numObjects() const override
+      {
+        return 2;
+      }
+      virtual void getObjects(std::vector<T>& objects) const override
+      {
+        objects.push_back(_left);
+        objects.push_back(_right);
+      }
+      virtual void recomputeBV() override
+      {
+        resetBV();
+        addToBV(_left);
+        addToBV(_right);
+      }
+      virtual void registerLeaves(std::unordered_map<T, Node*>& leaves) override
+      {
+        leaves[_left] = this;
+        leaves[_right] = this;
+      }
       virtual void intersectObjects(const BV& bv, StackPOD<T>& intersected_objects) const override
       {
         if (bv.intersects(_bv)) {
@@ -193,30 +401,89 @@ namespace fly
     class InternalNode : public Node
     {
     public:
-      InternalNode(unsigned begin, unsigned end, std::vector<T>& objects, KdTree& kd_tree)
+      InternalNode(unsigned begin, unsigned end, std::vector<T>& objects, KdTree& kd_tree, NodePool& node_pool, unsigned depth)
         : Node(begin, end, objects)
       {
-        unsigned num_objects = end - begin;
-        unsigned num_objects_left = num_objects / 2u;
-        _left = kd_tree.createNode(begin, begin + num_objects_left, objects);
-        _right = kd_tree.createNode(begin + num_objects_left, end, objects);
+        unsigned num_objects_left = SplitPolicy()(&objects.front() + begin, &objects.front() + end, _bv, depth);
+        unsigned mid = begin + num_objects_left;
+        if (buildInParallel(end - begin, depth)) {
+          auto& job_system = JobSystem::getInstance();
+          auto left_job = job_system.schedule([this, &kd_tree, &objects, begin, mid, depth]() {
+            PROFILE_ZONE("KdTree build subtree");
+            _left = kd_tree.createSubtree(begin, mid, objects, depth + 1u);
+          });
+          _right = kd_tree.createSubtree(mid, end, objects, depth + 1u);
+          job_system.wait(left_job);
+        }
+        else {
+          _left = node_pool.createNode(begin, mid, objects, kd_tree, depth + 1u);
+          _right = node_pool.createNode(mid, end, objects, kd_tree, depth + 1u);
+        }
+        _left->_parent = this;
+        _right->_parent = this;
       }
       virtual ~InternalNode() = default;
-      virtual void cullVisibleObjects(const Camera::CullingParams& cp, CullResult<T>& cull_result) const override
+      virtual void cullVisibleObjects(const Camera::CullingParams& cp, unsigned char plane_mask, std::vector<unsigned char>& rejecting_planes, CullResult<T>& cull_result) const override
       {
         if (isLargeEnough(cp)) {
-          auto result = intersectFrustum(cp);
+          auto result = intersectFrustum(cp, plane_mask, rejecting_planes);
+          if (result != IntersectionResult::OUTSIDE && isOccluded(cp)) {
+            return;
+          }
           if (result == IntersectionResult::INSIDE) {
             _left->cullAllObjects(cp, cull_result._fullyVisibleObjects);
             _right->cullAllObjects(cp, cull_result._fullyVisibleObjects);
           }
           else if (result == IntersectionResult::INTERSECTING) {
-            _left->cullVisibleObjects(cp, cull_result);
-            _right->cullVisibleObjects(cp, cull_result);
+            _left->cullVisibleObjects(cp, plane_mask, rejecting_planes, cull_result);
+            _right->cullVisibleObjects(cp, plane_mask, rejecting_planes, cull_result);
           }
         }
       }
       virtual void cullAllObjects(const Camera::CullingParams& cp, StackPOD<T>& objects) const override
+      {
+        if (isLargeEnough(cp) && !isOccluded(cp)) {
+          _left->cullAllObjects(cp, objects);
+          _right->cullAllObjects(cp, objects);
+        }
+      }
+      virtual void cullVisibleObjects(const Camera::MultiViewCullingParams& cp, const MultiFrustumPlanesSIMD& fp, unsigned char intersecting_views,
+        unsigned char inside_views, MultiViewCullResult<T>& cull_result) const override
+      {
+        if (isLargeEnough(cp)) {
+          intersectFrustums(fp, intersecting_views, inside_views);
+          if (intersecting_views) {
+            _left->cullVisibleObjects(cp, fp, intersecting_views, inside_views, cull_result);
+            _right->cullVisibleObjects(cp, fp, intersecting_views, inside_views, cull_result);
+          }
+          else if (inside_views) {
+            _left->cullAllObjects(cp, inside_views, cull_result);
+            _right->cullAllObjects(cp, inside_views, cull_result);
+          }
+        }
+      }
+      virtual void cullAllObjects(const Camera::MultiViewCullingParams& cp, unsigned char views, MultiViewCullResult<T>& cull_result) const override
+      {
+        if (isLargeEnough(cp)) {
+          _left->cullAllObjects(cp, views, cull_result);
+          _right->cullAllObjects(cp, views, cull_result);
+        }
+      }
+      virtual void cullVisibleObjects(const Camera::TemporalCullingParams& cp, StackPOD<T>& stable_objects, StackPOD<T>& boundary_objects) const override
+      {
+        if (isLargeEnough(cp)) {
+          auto result = intersectFrustum(cp);
+          if (result == IntersectionResult::INSIDE) {
+            _left->cullAllObjects(cp, stable_objects);
+            _right->cullAllObjects(cp, stable_objects);
+          }
+          else if (result == IntersectionResult::INTERSECTING) {
+            _left->cullVisibleObjects(cp, stable_objects, boundary_objects);
+            _right->cullVisibleObjects(cp, stable_objects, boundary_objects);
+          }
+        }
+      }
+      virtual void cullAllObjects(const Camera::TemporalCullingParams& cp, StackPOD<T>& objects) const override
       {
         if (isLargeEnough(cp)) {
           _left->cullAllObjects(cp, objects);
@@ -266,43 +533,302 @@ namespace fly
         _left->countNodes(internal_nodes, leaf_nodes);
         _right->countNodes(internal_nodes, leaf_nodes);
       }
+      virtual void computeQuality(BVHQuality& quality) const override
+      {
+        quality._sahCost += BVHMetrics::surfaceArea(_bv);
+        quality._overlap += BVHMetrics::overlap(_left->getBV(), _right->getBV());
+        _left->computeQuality(quality);
+        _right->computeQuality(quality);
+      }
+      virtual unsigned numObjects() const override
+      {
+        return 0;
+      }
+      virtual void getObjects(std::vector<T>& objects) const override
+      {
+      }
+      virtual void recomputeBV() override
+      {
+        resetBV();
+        _bv = _bv.getUnion(_left->getBV());
+        _bv = _bv.getUnion(_right->getBV());
+        _largestBVSize = std::max(_left->_largestBVSize, _right->_largestBVSize);
+      }
+      virtual void registerLeaves(std::unordered_map<T, Node*>& leaves) override
+      {
+        _left->registerLeaves(leaves);
+        _right->registerLeaves(leaves);
+      }
+      inline NodePtr& getChild(Node const * child)
+      {
+        return &*_left == child ? _left : _right;
+      }
+      inline NodePtr& getSibling(Node const * child)
+      {
+        return &*_left == child ? _right : _left;
+      }
     private:
+      friend class KdTree;
       NodePtr _left, _right;
     };
-    KdTree(std::vector<T>& objects) :
-#if KD_TREE_USE_BOOST
-      _nodePool(static_cast<unsigned>(objects.size())),
-#endif
-       _root(createNode(0, static_cast<unsigned>(objects.size()), objects))
+    KdTree(std::vector<T>& objects)
+    {
+      PROFILE_ZONE("KdTree build");
+      if (objects.size()) {
+        _root = createSubtree(0, static_cast<unsigned>(objects.size()), objects, 1);
+      }
+    }
+    /**
+    * Parallel construction is enabled by default. Disabling it is meant for comparisons, e.g. in benchmarks.
+    */
+    static void setParallelBuild(bool enabled)
     {
+      parallelBuild() = enabled;
     }
+    /**
+    * Hierarchical view frustum culling and detail culling. Children skip the frustum planes that fully contain their parent, and each node
+    * first tests the plane that rejected it during the last call with the same cull_result. Hence each view should have its own CullResult.
+    */
     void cullVisibleObjects(const Camera::CullingParams& cp, CullResult<T>& cull_result) const
     {
-      _root->cullVisibleObjects(cp, cull_result);
+      if (cull_result._rejectingPlanes.size() < _numNodeIndices) {
+        cull_result._rejectingPlanes.resize(_numNodeIndices, 0);
+      }
+      if (_root) {
+        _root->cullVisibleObjects(cp, 0x3f, cull_result._rejectingPlanes, cull_result);
+      }
+    }
+    /**
+    * Parallel variant of the above. The top levels are traversed breadth first until there are enough subtrees to keep all threads of
+    * the job system busy, each large subtree is then traversed by its own job and appends to its own chunk of cull_result.
+    * Small subtrees are traversed by the calling thread into the first chunk.
+    */
+    void cullVisibleObjects(const Camera::CullingParams& cp, ParallelCullResult<T>& cull_result) const
+    {
+      if (cull_result._rejectingPlanes.size() < _numNodeIndices) {
+        cull_result._rejectingPlanes.resize(_numNodeIndices, 0);
+      }
+      if (!_root) {
+        cull_result.setNumChunks(1);
+        return;
+      }
+      if (_root->_subtreeSize < _minObjectsPerCullTask) {
+        cull_result.setNumChunks(1);
+        cull_result.getChunk(0).reserve(_root->_subtreeSize);
+        _root->cullVisibleObjects(cp, 0x3f, cull_result._rejectingPlanes, cull_result.getChunk(0));
+        return;
+      }
+      auto& job_system = JobSystem::getInstance();
+      std::vector<CullTask> tasks;
+      std::vector<CullTask> open = { { &*_root, 0x3f, false } };
+      size_t max_tasks = job_system.getNumThreads() * _cullTasksPerThread;
+      size_t next = 0;
+      for (; next < open.size() && open.size() - next + tasks.size() < max_tasks; next++) {
+        auto task = open[next];
+        auto node = static_cast<InternalNode const *>(task._node);
+        if (!node->isLargeEnough(cp)) {
+          continue;
+        }
+        if (!task._inside) {
+          auto result = node->intersectFrustum(cp, task._planeMask, cull_result._rejectingPlanes);
+          if (result == IntersectionResult::OUTSIDE) {
+            continue;
+          }
+          task._inside = result == IntersectionResult::INSIDE;
+        }
+        if (!node->isOccluded(cp)) {
+          for (Node const * child : { &*node->_left, &*node->_right }) {
+            (child->isLeaf() ? tasks : open).push_back({ child, task._planeMask, task._inside });
+          }
+        }
+      }
+      tasks.insert(tasks.end(), open.begin() + next, open.end());
+      unsigned num_chunks = 1;
+      size_t small_tasks_size = 0;
+      for (const auto& task : tasks) {
+        if (task._node->_subtreeSize >= _minObjectsPerCullTask) {
+          num_chunks++;
+        }
+        else {
+          small_tasks_size += task._node->_subtreeSize;
+        }
+      }
+      cull_result.setNumChunks(num_chunks);
+      cull_result.getChunk(0).reserve(small_tasks_size);
+      std::vector<JobSystem::JobHandle> jobs;
+      jobs.reserve(num_chunks - 1u);
+      unsigned chunk = 1;
+      for (const auto& task : tasks) {
+        if (task._node->_subtreeSize >= _minObjectsPerCullTask) {
+          auto& chunk_result = cull_result.getChunk(chunk++);
+          chunk_result.reserve(task._node->_subtreeSize);
+          jobs.push_back(job_system.schedule([&cp, &cull_result, &chunk_result, task]() {
+            cullTask(cp, task, cull_result._rejectingPlanes, chunk_result);
+          }));
+        }
+      }
+      for (const auto& task : tasks) {
+        if (task._node->_subtreeSize < _minObjectsPerCullTask) {
+          cullTask(cp, task, cull_result._rejectingPlanes, cull_result.getChunk(0));
+        }
+      }
+      for (const auto& j : jobs) {
+        job_system.wait(j);
+      }
+    }
+    /**
+    * Culls up to Camera::MultiViewCullingParams::maxViews views in a single traversal, e.g. the camera view and all shadow cascades.
+    * Each node is classified against all views at once, subtrees are only skipped if they are outside of all views.
+    */
+    void cullVisibleObjects(const Camera::MultiViewCullingParams& cp, MultiViewCullResult<T>& cull_result) const
+    {
+      if (!_root) {
+        return;
+      }
+      MultiFrustumPlanesSIMD fp(cp._frustumPlanes.data(), cp._numViews);
+      _root->cullVisibleObjects(cp, fp, static_cast<unsigned char>((1u << cp._numViews) - 1u), 0, cull_result);
+    }
+    /**
+    * Conservative culling for TemporalCullCache, the results stay valid as long as the camera moves less than cp._tolerance.
+    */
+    void cullVisibleObjects(const Camera::TemporalCullingParams& cp, StackPOD<T>& stable_objects, StackPOD<T>& boundary_objects) const
+    {
+      if (_root) {
+        _root->cullVisibleObjects(cp, stable_objects, boundary_objects);
+      }
     }
     void intersectObjects(const BV& bv, StackPOD<T>& intersected_objects) const
     {
-      _root->intersectObjects(bv, intersected_objects);
+      if (_root) {
+        _root->intersectObjects(bv, intersected_objects);
+      }
     }
     void cullVisibleNodes(const Camera::CullingParams& cp, StackPOD<Node const *>& nodes) const
     {
-      _root->cullVisibleNodes(cp, nodes);
+      if (_root) {
+        _root->cullVisibleNodes(cp, nodes);
+      }
     }
     size_t getSizeInBytes() const
     {
       size_t bytes = 0;
-      _root->getSizeInBytes(bytes);
+      if (_root) {
+        _root->getSizeInBytes(bytes);
+      }
       return bytes;
     }
+    /**
+    * The bounding volume of an empty tree is the default constructed one.
+    */
     const BV& getBV() const
     {
-      return _root->getBV();
+      static const BV empty_bv;
+      return _root ? _root->getBV() : empty_bv;
     }
     void countNodes(unsigned& internal_nodes, unsigned& leaf_nodes) const
     {
       internal_nodes = 0;
       leaf_nodes = 0;
-      _root->countNodes(internal_nodes, leaf_nodes);
+      if (_root) {
+        _root->countNodes(internal_nodes, leaf_nodes);
+      }
+    }
+    BVHQuality getQuality() const
+    {
+      BVHQuality quality;
+      if (!_root) {
+        return quality;
+      }
+      _root->computeQuality(quality);
+      float root_area = BVHMetrics::surfaceArea(_root->getBV());
+      if (root_area > 0.f) {
+        quality._sahCost /= root_area;
+        quality._overlap /= root_area;
+      }
+      return quality;
+    }
+    /**
+    * Updates the bounding volumes on the path from the leaf of object to the root after the bounding volume of object has changed,
+    * e.g. because it was moved. The update stops at the first node whose bounding volume doesn't change.
+    * The tree structure is kept, so the quality of the tree degrades if objects move far from their original position.
+    */
+    void refit(const T& object)
+    {
+      initDynamicUpdates();
+      refitPath(_leaves.at(object));
+    }
+    /**
+    * Descends to the leaf whose bounding volume grows the least in surface area when adding object,
+    * and replaces that leaf by a subtree built from its objects and object.
+    */
+    void insert(const T& object)
+    {
+      initDynamicUpdates();
+      if (_leaves.count(object)) {
+        throw std::exception("The object is already part of the KdTree.");
+      }
+      std::vector<T> objects = { object };
+      if (!_root) {
+        _root = _dynamicNodePool->createNode(0, 1, objects, *this, 1);
+        _root->registerLeaves(_leaves);
+        _sahCost = cost(&*_root);
+        _buildSahCost = _sahCost / BVHMetrics::surfaceArea(_root->_bv);
+        return;
+      }
+      const auto& bv = GetBoundingVolume()(object);
+      Node* node = &*_root;
+      while (!node->isLeaf()) {
+        auto internal_node = static_cast<InternalNode*>(node);
+        Node* left = &*internal_node->_left;
+        Node* right = &*internal_node->_right;
+        node = growth(left->_bv, bv) <= growth(right->_bv, bv) ? left : right;
+      }
+      node->getObjects(objects);
+      replace(node, objects);
+    }
+    /**
+    * Removes object from its leaf. If the leaf becomes empty, its parent is replaced by the sibling of the leaf.
+    * Removing the last object leaves an empty tree, which objects can be inserted into again.
+    */
+    void remove(const T& object)
+    {
+      initDynamicUpdates();
+      Node* leaf = _leaves.at(object);
+      std::vector<T> objects;
+      leaf->getObjects(objects);
+      objects.erase(std::remove(objects.begin(), objects.end(), object), objects.end());
+      _leaves.erase(object);
+      if (objects.size()) {
+        replace(leaf, objects);
+        return;
+      }
+      auto parent = leaf->_parent;
+      if (!parent) {
+        releaseNode(leaf);
+        _root = nullptr;
+        _sahCost = 0.f;
+        return;
+      }
+      _sahCost -= cost(leaf) + cost(parent);
+      NodePtr sibling = std::move(parent->getSibling(leaf));
+      auto grand_parent = parent->_parent;
+      sibling->_parent = grand_parent;
+      auto& slot = grand_parent ? grand_parent->getChild(parent) : _root;
+      releaseNode(leaf);
+      releaseNode(parent);
+      slot = std::move(sibling);
+      for (Node* n = grand_parent; n; n = n->_parent) {
+        n->_subtreeSize--;
+      }
+      refitPath(grand_parent);
+    }
+    /**
+    * Returns true if refits, insertions and removals increased the SAH cost (see getQuality()) by more than
+    * the factor max_cost_increase compared to the freshly built tree, in this case the tree should be rebuilt.
+    */
+    bool needsRebuild(float max_cost_increase = 1.5f) const
+    {
+      return _dynamicNodePool && _root && _sahCost / BVHMetrics::surfaceArea(_root->_bv) > _buildSahCost * max_cost_increase;
     }
   private:
 #if KD_TREE_USE_BOOST
@@ -323,16 +849,40 @@ namespace fly
       NodePool& operator=(const NodePool& other) = delete;
       NodePool(NodePool&& other) = delete;
       NodePool& operator=(NodePool&& other) = delete;
-      NodePtr createNode(unsigned begin, unsigned end, std::vector<T>& objects, KdTree& kd_tree)
+      NodePtr createNode(unsigned begin, unsigned end, std::vector<T>& objects, KdTree& kd_tree, unsigned depth)
       {
+        NodePtr node;
         auto num_objects = end - begin;
         switch (num_objects) {
         case 2:
-          return new(_leafNodePool.malloc()) LeafNode(begin, end, objects);
+          node = new(allocate(_leafNodePool, _releasedLeafNodes)) LeafNode(begin, end, objects);
+          break;
         case 1:
-          return new(_leafNodeSinglePool.malloc()) LeafNodeSingle(begin, end, objects);
+          node = new(allocate(_leafNodeSinglePool, _releasedLeafNodesSingle)) LeafNodeSingle(begin, end, objects);
+          break;
         default:
-          return new(_internalNodePool.malloc()) InternalNode(begin, end, objects, kd_tree);
+          node = new(allocate(_internalNodePool, _releasedInternalNodes)) InternalNode(begin, end, objects, kd_tree, *this, depth);
+          break;
+        }
+        node->_index = kd_tree.createNodeIndex();
+        node->_pool = this;
+        return node;
+      }
+      /**
+      * Hands node, which must have been allocated from this pool, back for reuse by createNode().
+      */
+      void releaseNode(Node* node)
+      {
+        switch (node->numObjects()) {
+        case 2:
+          _releasedLeafNodes.push_back(static_cast<LeafNode*>(node));
+          break;
+        case 1:
+          _releasedLeafNodesSingle.push_back(static_cast<LeafNodeSingle*>(node));
+          break;
+        default:
+          _releasedInternalNodes.push_back(static_cast<InternalNode*>(node));
+          break;
         }
       }
     private:
@@ -343,27 +893,211 @@ namespace fly
       boost::object_pool<InternalNode> _internalNodePool;
       boost::object_pool<LeafNode> _leafNodePool;
       boost::object_pool<LeafNodeSingle> _leafNodeSinglePool;
+      /**
+      * Released nodes are kept constructed and only destroyed when their memory is reused, so the object pools still destroy every
+      * object exactly once. This avoids boost::object_pool::destroy(), which is an ordered free that walks the free list.
+      */
+      std::vector<InternalNode*> _releasedInternalNodes;
+      std::vector<LeafNode*> _releasedLeafNodes;
+      std::vector<LeafNodeSingle*> _releasedLeafNodesSingle;
+      template<typename NodeType>
+      static inline void* allocate(boost::object_pool<NodeType>& pool, std::vector<NodeType*>& released)
+      {
+        if (released.empty()) {
+          return pool.malloc();
+        }
+        auto node = released.back();
+        released.pop_back();
+        node->~NodeType();
+        return node;
+      }
     };
-    NodePool _nodePool;
-    inline NodePtr createNode(unsigned begin, unsigned end, std::vector<T>& objects)
+#else
+    class NodePool
     {
-      return _nodePool.createNode(begin, end, objects, *this);
+    public:
+      NodePool(unsigned num_objects)
+      {
+      }
+      NodePtr createNode(unsigned begin, unsigned end, std::vector<T>& objects, KdTree& kd_tree, unsigned depth)
+      {
+        NodePtr node;
+        auto num_objects = end - begin;
+        switch (num_objects) {
+        case 2:
+          node = std::make_unique<LeafNode>(begin, end, objects);
+          break;
+        case 1:
+          node = std::make_unique<LeafNodeSingle>(begin, end, objects);
+          break;
+        default:
+          node = std::make_unique<InternalNode>(begin, end, objects, kd_tree, *this, depth);
+          break;
+        }
+        node->_index = kd_tree.createNodeIndex();
+        return node;
+      }
+    };
+#endif
+    /**
+    * Subtrees with fewer objects are built sequentially, because the task overhead outweighs the gain.
+    */
+    static const unsigned _minObjectsParallel = 4096;
+    /**
+    * The parallel traversal creates about this many subtree tasks per thread, so the job system can balance frusta that cover the tree unevenly.
+    */
+    static const unsigned _cullTasksPerThread = 4;
+    static const unsigned _minObjectsPerCullTask = 1024;
+    /**
+    * Subtree of the parallel traversal, inside is true if the frustum fully contains the subtree.
+    */
+    struct CullTask
+    {
+      Node const * _node;
+      unsigned char _planeMask;
+      bool _inside;
+    };
+    static inline void cullTask(const Camera::CullingParams& cp, const CullTask& task, std::vector<unsigned char>& rejecting_planes, CullResult<T>& cull_result)
+    {
+      if (task._inside) {
+        task._node->cullAllObjects(cp, cull_result._fullyVisibleObjects);
+      }
+      else {
+        task._node->cullVisibleObjects(cp, task._planeMask, rejecting_planes, cull_result);
+      }
     }
-#else
-    inline NodePtr createNode(unsigned begin, unsigned end, std::vector<T>& objects)
+    std::mutex _nodePoolsMutex;
+    std::vector<std::unique_ptr<NodePool>> _nodePools;
+    /**
+    * Upper bound of the node indices handed out so far, see Node::_index.
+    */
+    std::atomic<unsigned> _numNodeIndices{ 0 };
+    /**
+    * Indices of nodes that were released by insertions and removals, reused for the nodes they create.
+    * Only touched by dynamic updates, which are not concurrent with building, so the parallel build always finds it empty.
+    */
+    std::vector<unsigned> _freeNodeIndices;
+    inline unsigned createNodeIndex()
     {
-      auto num_objects = end - begin;
-      switch (num_objects) {
-      case 2:
-        return std::make_unique<LeafNode>(begin, end, objects);
-      case 1:
-        return std::make_unique<LeafNodeSingle>(begin, end, objects);
-      default:
-        return std::make_unique<InternalNode>(begin, end, objects, *this);
+      if (_freeNodeIndices.size()) {
+        auto index = _freeNodeIndices.back();
+        _freeNodeIndices.pop_back();
+        return index;
       }
+      return _numNodeIndices++;
     }
+    /**
+    * Called for a node that is unlinked from the tree, before the last reference to it is dropped. Its index is recycled
+    * and, with pooled nodes, it is handed back to the pool it was allocated from. Children are not released.
+    */
+    void releaseNode(Node* node)
+    {
+      _freeNodeIndices.push_back(node->_index);
+#if KD_TREE_USE_BOOST
+      node->_pool->releaseNode(node);
 #endif
+    }
+    /**
+    * Creates a new node pool for the subtree that spans the objects in [begin, end) and builds the subtree.
+    * Pools are never shared between threads: a node that builds its children in parallel is the only node allocated from its pool,
+    * hence the minimal pool size.
+    */
+    NodePtr createSubtree(unsigned begin, unsigned end, std::vector<T>& objects, unsigned depth)
+    {
+      NodePool* node_pool;
+      {
+        std::lock_guard<std::mutex> lock(_nodePoolsMutex);
+        _nodePools.push_back(std::make_unique<NodePool>(buildInParallel(end - begin, depth) ? 2u : end - begin));
+        node_pool = _nodePools.back().get();
+      }
+      return node_pool->createNode(begin, end, objects, *this, depth);
+    }
+    /**
+    * Splits are parallelized until there are at least as many subtrees as job system threads.
+    */
+    static inline bool buildInParallel(unsigned num_objects, unsigned depth)
+    {
+      static const unsigned num_threads = JobSystem::getInstance().getNumThreads();
+      return parallelBuild() && num_objects >= _minObjectsParallel && depth < 32u && (1u << (depth - 1u)) < num_threads;
+    }
+    static inline bool& parallelBuild()
+    {
+      static bool parallel_build = true;
+      return parallel_build;
+    }
     NodePtr _root;
+    /**
+    * State for dynamic updates, which is only set up once the first update happens. Nodes that are created by insertions and removals
+    * are allocated from a separate pool, replaced nodes are released immediately, see releaseNode().
+    */
+    std::unique_ptr<NodePool> _dynamicNodePool;
+    std::unordered_map<T, Node*> _leaves;
+    float _sahCost = 0.f;
+    float _buildSahCost = 0.f;
+    void initDynamicUpdates()
+    {
+      if (!_dynamicNodePool) {
+        _dynamicNodePool = std::make_unique<NodePool>(64u);
+        if (!_root) {
+          return;
+        }
+        _root->registerLeaves(_leaves);
+        BVHQuality quality;
+        _root->computeQuality(quality);
+        _sahCost = quality._sahCost;
+        _buildSahCost = _sahCost / BVHMetrics::surfaceArea(_root->_bv);
+      }
+    }
+    static inline float cost(Node const * node)
+    {
+      return BVHMetrics::surfaceArea(node->_bv) * std::max(node->numObjects(), 1u);
+    }
+    static inline float growth(const BV& node_bv, const BV& bv)
+    {
+      BV bv_union = node_bv;
+      bv_union = bv_union.getUnion(bv);
+      return BVHMetrics::surfaceArea(bv_union) - BVHMetrics::surfaceArea(node_bv);
+    }
+    static inline unsigned depth(Node const * node)
+    {
+      unsigned depth = 1;
+      for (; node->_parent; node = node->_parent, depth++);
+      return depth;
+    }
+    void refitPath(Node* node)
+    {
+      for (; node; node = node->_parent) {
+        BV bv_old = node->_bv;
+        float largest_bv_size_old = node->_largestBVSize;
+        float cost_old = cost(node);
+        node->recomputeBV();
+        _sahCost += cost(node) - cost_old;
+        if (bv_old.getMin() == node->_bv.getMin() && bv_old.getMax() == node->_bv.getMax() && largest_bv_size_old == node->_largestBVSize) {
+          break;
+        }
+      }
+    }
+    /**
+    * Replaces node, which must be a leaf, by a new subtree that contains objects.
+    */
+    void replace(Node* node, std::vector<T>& objects)
+    {
+      auto parent = node->_parent;
+      _sahCost -= cost(node);
+      NodePtr subtree = _dynamicNodePool->createNode(0, static_cast<unsigned>(objects.size()), objects, *this, depth(node));
+      subtree->_parent = parent;
+      for (Node* n = parent; n; n = n->_parent) {
+        n->_subtreeSize = n->_subtreeSize - node->_subtreeSize + subtree->_subtreeSize;
+      }
+      subtree->registerLeaves(_leaves);
+      BVHQuality quality;
+      subtree->computeQuality(quality);
+      _sahCost += quality._sahCost;
+      auto& slot = parent ? parent->getChild(node) : _root;
+      releaseNode(node);
+      slot = std::move(subtree);
+      refitPath(parent);
+    }
   };
 }
 
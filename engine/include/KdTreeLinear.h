@@ -0,0 +1,757 @@
+#ifndef KDTREELINEAR_H
+#define KDTREELINEAR_H
+
+#include <Camera.h>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <StackPOD.h>
+#include <IntersectionTests.h>
+#include <CullResult.h>
+#include <KdTree.h>
+#include <xmmintrin.h>
+#include <JobSystem.h>
+#include <Profiler.h>
+#include <memory>
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <typeinfo>
+#include <type_traits>
+#include <unordered_map>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace fly
+{
+  /**
+  * Pointer-free, flattened variant of KdTree. It is built with the same split policy and therefore has exactly the same structure,
+  * but all nodes are stored in a single contiguous array in depth-first order. The left child of an internal node directly follows
+  * its parent in memory, the right child is referenced by its index. Leaf nodes reference one or two objects in a separate object array.
+  * Nodes have a fixed size and no vtable, the traversal is iterative and uses an explicit stack instead of recursion.
+  * The public interface matches KdTree, so it can be used as the BVH type of the Renderer. Dynamic updates (refit, insert, remove)
+  * are not supported, since they would break the depth-first layout.
+  * As nodes are plain data, a tree can be written to a file with save() and memory-mapped with load(), which avoids rebuilding it at startup.
+  */
+  template<typename T, typename BV, typename GetBoundingVolume = DefaultGetBoundingVolume<T, BV>, typename GetLargestBVSize = DefaultGetLargestBVSize<T>,
+    typename SplitPolicy = MedianSplit<T, GetBoundingVolume>>
+  class KdTreeLinear
+  {
+  public:
+    class Node
+    {
+    public:
+      inline const BV& getBV() const { return _bv; }
+      inline bool isLeaf() const { return _numObjects != 0; }
+    private:
+      friend class KdTreeLinear;
+      BV _bv;
+      float _largestBVSize;
+      unsigned _offset; // Index of the right child for internal nodes, index of the first object for leaf nodes.
+      unsigned _numObjects; // Zero for internal nodes, one or two for leaf nodes.
+    };
+    KdTreeLinear(std::vector<T>& objects)
+    {
+      PROFILE_ZONE("KdTreeLinear build");
+      // An empty tree has no nodes at all, as a node without objects would be taken for an internal node.
+      if (objects.size()) {
+        _nodeStorage.reserve(objects.size() * 2u - 1u);
+        build(0, static_cast<unsigned>(objects.size()), objects, 1, _nodeStorage);
+      }
+      _nodes = _nodeStorage.data();
+      _numNodes = static_cast<unsigned>(_nodeStorage.size());
+      _objects = objects;
+    }
+    KdTreeLinear(const KdTreeLinear& other) = delete;
+    KdTreeLinear& operator=(const KdTreeLinear& other) = delete;
+    /**
+    * Parallel construction is enabled by default. Disabling it is meant for comparisons, e.g. in benchmarks.
+    */
+    static void setParallelBuild(bool enabled)
+    {
+      parallelBuild() = enabled;
+    }
+    /**
+    * Writes the tree to file. Objects are stored as indices into objects, which has to contain the same objects
+    * as the vector the tree was built from, in the order before the construction reordered them.
+    */
+    void save(const std::string& file, const std::vector<T>& objects) const
+    {
+      std::unordered_map<T, uint32_t> indices;
+      for (uint32_t i = 0; i < objects.size(); i++) {
+        indices[objects[i]] = i;
+      }
+      FileHeader header = {};
+      header._magic = _fileMagic;
+      header._version = _fileVersion;
+      header._nodeSize = sizeof(Node);
+      header._numNodes = _numNodes;
+      header._numObjects = static_cast<uint32_t>(_objects.size());
+      header._key = computeKey(objects);
+      std::ofstream os(file, std::ios::binary);
+      os.write(reinterpret_cast<const char*>(&header), sizeof header);
+      os.write(reinterpret_cast<const char*>(_nodes), _numNodes * sizeof(Node));
+      for (const auto& o : _objects) {
+        auto index = indices.at(o);
+        os.write(reinterpret_cast<const char*>(&index), sizeof index);
+      }
+      if (!os) {
+        throw std::exception(("Failed to write BVH to " + file).c_str());
+      }
+    }
+    /**
+    * Memory-maps a tree written by save(). The nodes are used directly from the mapped file, only the object array is allocated.
+    * Returns nullptr if the file doesn't exist, was written by a different version, if the bounding volumes
+    * of objects don't match the ones the tree was built from, or if the nodes don't form a valid tree.
+    */
+    static std::unique_ptr<KdTreeLinear> load(const std::string& file, const std::vector<T>& objects)
+    {
+      std::unique_ptr<KdTreeLinear> tree(new KdTreeLinear());
+      try {
+        boost::interprocess::file_mapping mapping(file.c_str(), boost::interprocess::read_only);
+        tree->_mappedRegion = std::make_unique<boost::interprocess::mapped_region>(mapping, boost::interprocess::read_only);
+      }
+      catch (const boost::interprocess::interprocess_exception&) {
+        return nullptr;
+      }
+      auto data = static_cast<const char*>(tree->_mappedRegion->get_address());
+      auto size = tree->_mappedRegion->get_size();
+      if (size < sizeof(FileHeader)) {
+        return nullptr;
+      }
+      FileHeader header;
+      std::memcpy(&header, data, sizeof header);
+      if (header._magic != _fileMagic || header._version != _fileVersion || header._nodeSize != sizeof(Node)
+        || header._numObjects != objects.size() || header._numNodes == 0 || header._key != computeKey(objects)
+        || size != sizeof header + header._numNodes * sizeof(Node) + header._numObjects * sizeof(uint32_t)) {
+        return nullptr;
+      }
+      tree->_nodes = reinterpret_cast<const Node*>(data + sizeof header);
+      tree->_numNodes = header._numNodes;
+      tree->_objects.resize(header._numObjects);
+      if (!tree->validNodes()) {
+        return nullptr;
+      }
+      auto indices = reinterpret_cast<const uint32_t*>(data + sizeof header + header._numNodes * sizeof(Node));
+      for (uint32_t i = 0; i < header._numObjects; i++) {
+        if (indices[i] >= objects.size()) {
+          return nullptr;
+        }
+        tree->_objects[i] = objects[indices[i]];
+      }
+      return tree;
+    }
+    /**
+    * See KdTree::cullVisibleObjects(). The stack stores the mask of the frustum planes that still need to be tested along with the node indices,
+    * the node indices are also used to look up the plane that rejected a node during the last call with the same cull_result.
+    */
+    void cullVisibleObjects(const Camera::CullingParams& cp, CullResult<T>& cull_result) const
+    {
+      if (cull_result._rejectingPlanes.size() < _numNodes) {
+        cull_result._rejectingPlanes.resize(_numNodes, 0);
+      }
+      if (_numNodes) {
+        cullVisibleObjects(0, 0x3f, cp, cull_result._rejectingPlanes, cull_result);
+      }
+    }
+    /**
+    * Parallel variant, see KdTree::cullVisibleObjects().
+    */
+    void cullVisibleObjects(const Camera::CullingParams& cp, ParallelCullResult<T>& cull_result) const
+    {
+      if (cull_result._rejectingPlanes.size() < _numNodes) {
+        cull_result._rejectingPlanes.resize(_numNodes, 0);
+      }
+      if (_objects.size() < _minObjectsPerCullTask) {
+        cull_result.setNumChunks(1);
+        cull_result.getChunk(0).reserve(_objects.size());
+        if (_numNodes) {
+          cullVisibleObjects(0, 0x3f, cp, cull_result._rejectingPlanes, cull_result.getChunk(0));
+        }
+        return;
+      }
+      auto& job_system = JobSystem::getInstance();
+      std::vector<CullTask> tasks;
+      std::vector<CullTask> open = { { 0, 0x3f, false, 0 } };
+      size_t max_tasks = job_system.getNumThreads() * _cullTasksPerThread;
+      size_t next = 0;
+      for (; next < open.size() && open.size() - next + tasks.size() < max_tasks; next++) {
+        auto task = open[next];
+        const auto& node = _nodes[task._index];
+        if (!isLargeEnough(node, cp)) {
+          continue;
+        }
+        if (!task._inside) {
+          auto result = IntersectionTests::frustumIntersectsBoundingVolume(node._bv, cp._frustumPlanes, task._planeMask,
+            cull_result._rejectingPlanes[task._index]);
+          if (result == IntersectionResult::OUTSIDE) {
+            continue;
+          }
+          task._inside = result == IntersectionResult::INSIDE;
+        }
+        if (!isOccluded(node, cp)) {
+          for (unsigned child : { task._index + 1u, node._offset }) {
+            (_nodes[child].isLeaf() ? tasks : open).push_back({ child, task._planeMask, task._inside, 0 });
+          }
+        }
+      }
+      tasks.insert(tasks.end(), open.begin() + next, open.end());
+      unsigned num_chunks = 1;
+      size_t small_tasks_size = 0;
+      for (auto& task : tasks) {
+        task._subtreeSize = subtreeSize(task._index);
+        if (task._subtreeSize >= _minObjectsPerCullTask) {
+          num_chunks++;
+        }
+        else {
+          small_tasks_size += task._subtreeSize;
+        }
+      }
+      cull_result.setNumChunks(num_chunks);
+      cull_result.getChunk(0).reserve(small_tasks_size);
+      std::vector<JobSystem::JobHandle> jobs;
+      jobs.reserve(num_chunks - 1u);
+      unsigned chunk = 1;
+      for (const auto& task : tasks) {
+        if (task._subtreeSize >= _minObjectsPerCullTask) {
+          auto& chunk_result = cull_result.getChunk(chunk++);
+          chunk_result.reserve(task._subtreeSize);
+          jobs.push_back(job_system.schedule([this, &cp, &cull_result, &chunk_result, task]() {
+            cullTask(cp, task, cull_result._rejectingPlanes, chunk_result);
+          }));
+        }
+      }
+      for (const auto& task : tasks) {
+        if (task._subtreeSize < _minObjectsPerCullTask) {
+          cullTask(cp, task, cull_result._rejectingPlanes, cull_result.getChunk(0));
+        }
+      }
+      for (const auto& j : jobs) {
+        job_system.wait(j);
+      }
+    }
+    /**
+    * Multi-view variant, see KdTree::cullVisibleObjects(). The stack stores the view masks along with the node indices.
+    */
+    void cullVisibleObjects(const Camera::MultiViewCullingParams& cp, MultiViewCullResult<T>& cull_result) const
+    {
+      if (!_numNodes) {
+        return;
+      }
+      MultiFrustumPlanesSIMD fp(cp._frustumPlanes.data(), cp._numViews);
+      struct StackEntry
+      {
+        unsigned _index;
+        unsigned char _intersectingViews;
+        unsigned char _insideViews;
+      };
+      StackEntry stack[_maxDepth + 1u];
+      unsigned stack_size = 0;
+      stack[stack_size++] = { 0, static_cast<unsigned char>((1u << cp._numViews) - 1u), 0 };
+      while (stack_size) {
+        auto entry = stack[--stack_size];
+        const auto& node = _nodes[entry._index];
+        if (node._numObjects == 1) {
+          cull_result.add(_objects[node._offset], entry._insideViews, entry._intersectingViews);
+        }
+        else if (node._bv.isLargeEnough(cp._camPos, cp._thresh, node._largestBVSize)) {
+          unsigned outside_mask, intersecting_mask;
+          IntersectionTests::frustumsIntersectBoundingVolume(node._bv, fp, outside_mask, intersecting_mask);
+          unsigned char inside_views = entry._insideViews | (entry._intersectingViews & ~(outside_mask | intersecting_mask));
+          unsigned char intersecting_views = entry._intersectingViews & intersecting_mask;
+          if (node.isLeaf()) {
+            if (intersecting_views | inside_views) {
+              for (unsigned i = node._offset; i < node._offset + node._numObjects; i++) {
+                cull_result.add(_objects[i], inside_views, intersecting_views);
+              }
+            }
+          }
+          else if (intersecting_views) {
+            _mm_prefetch(reinterpret_cast<const char*>(&_nodes[node._offset]), _MM_HINT_T0);
+            stack[stack_size++] = { node._offset, intersecting_views, inside_views };
+            stack[stack_size++] = { entry._index + 1u, intersecting_views, inside_views };
+          }
+          else if (inside_views) {
+            cullAllObjects(entry._index, cp, inside_views, cull_result);
+          }
+        }
+      }
+    }
+    /**
+    * Conservative culling for TemporalCullCache, see KdTree::cullVisibleObjects().
+    */
+    void cullVisibleObjects(const Camera::TemporalCullingParams& cp, StackPOD<T>& stable_objects, StackPOD<T>& boundary_objects) const
+    {
+      if (!_numNodes) {
+        return;
+      }
+      unsigned stack[_maxDepth + 1u];
+      unsigned stack_size = 0;
+      stack[stack_size++] = 0;
+      while (stack_size) {
+        auto index = stack[--stack_size];
+        const auto& node = _nodes[index];
+        if (node._numObjects == 1) {
+          boundary_objects.push_back(_objects[node._offset]);
+        }
+        else if (isLargeEnough(node, cp)) {
+          auto result = intersectFrustum(node, cp);
+          if (result == IntersectionResult::INSIDE) {
+            node.isLeaf() ? addObjects(node, stable_objects) : cullAllObjects(index, cp, stable_objects);
+          }
+          else if (result == IntersectionResult::INTERSECTING) {
+            if (node.isLeaf()) {
+              addObjects(node, boundary_objects);
+            }
+            else {
+              pushChildren(index, stack, stack_size);
+            }
+          }
+        }
+      }
+    }
+    void intersectObjects(const BV& bv, StackPOD<T>& intersected_objects) const
+    {
+      if (!_numNodes) {
+        return;
+      }
+      unsigned stack[_maxDepth + 1u];
+      unsigned stack_size = 0;
+      stack[stack_size++] = 0;
+      while (stack_size) {
+        auto index = stack[--stack_size];
+        const auto& node = _nodes[index];
+        if (node._numObjects == 1 || bv.intersects(node._bv)) {
+          if (node.isLeaf()) {
+            for (unsigned i = node._offset; i < node._offset + node._numObjects; i++) {
+              if (bv.intersects(GetBoundingVolume()(_objects[i]))) {
+                intersected_objects.push_back_secure(_objects[i]);
+              }
+            }
+          }
+          else {
+            pushChildren(index, stack, stack_size);
+          }
+        }
+      }
+    }
+    void cullVisibleNodes(const Camera::CullingParams& cp, StackPOD<Node const *>& nodes) const
+    {
+      if (!_numNodes) {
+        return;
+      }
+      unsigned stack[_maxDepth + 1u];
+      unsigned stack_size = 0;
+      stack[stack_size++] = 0;
+      while (stack_size) {
+        auto index = stack[--stack_size];
+        const auto& node = _nodes[index];
+        if (isLargeEnough(node, cp)) {
+          auto result = intersectFrustum(node, cp);
+          if (result != IntersectionResult::OUTSIDE) {
+            nodes.push_back_secure(&node);
+            if (!node.isLeaf()) {
+              if (result == IntersectionResult::INSIDE) {
+                cullAllNodes(index + 1u, cp, nodes);
+                cullAllNodes(node._offset, cp, nodes);
+              }
+              else {
+                pushChildren(index, stack, stack_size);
+              }
+            }
+          }
+        }
+      }
+    }
+    size_t getSizeInBytes() const
+    {
+      return sizeof(*this) + _numNodes * sizeof(Node) + _objects.size() * sizeof(T);
+    }
+    const BV& getBV() const
+    {
+      static const BV empty_bv;
+      return _numNodes ? _nodes[0]._bv : empty_bv;
+    }
+    void countNodes(unsigned& internal_nodes, unsigned& leaf_nodes) const
+    {
+      internal_nodes = 0;
+      leaf_nodes = 0;
+      for (unsigned i = 0; i < _numNodes; i++) {
+        _nodes[i].isLeaf() ? leaf_nodes++ : internal_nodes++;
+      }
+    }
+    BVHQuality getQuality() const
+    {
+      BVHQuality quality;
+      for (unsigned i = 0; i < _numNodes; i++) {
+        const auto& n = _nodes[i];
+        quality._sahCost += BVHMetrics::surfaceArea(n._bv) * std::max(n._numObjects, 1u);
+        if (!n.isLeaf()) {
+          quality._overlap += BVHMetrics::overlap(_nodes[i + 1u]._bv, _nodes[n._offset]._bv);
+        }
+      }
+      float root_area = BVHMetrics::surfaceArea(getBV());
+      if (root_area > 0.f) {
+        quality._sahCost /= root_area;
+        quality._overlap /= root_area;
+      }
+      return quality;
+    }
+  private:
+    /**
+    * Upper bound for the depth of the tree, which determines the size of the traversal stack.
+    * Median splits result in a depth of at most log2(num_objects) + 1, BinnedSAHSplit falls back to median splits below depth 32.
+    */
+    static const unsigned _maxDepth = 64;
+    /**
+    * Nodes point either into _nodeStorage for trees that were built, or into _mappedRegion for trees that were loaded.
+    */
+    Node const * _nodes = nullptr;
+    unsigned _numNodes = 0;
+    std::vector<Node> _nodeStorage;
+    std::unique_ptr<boost::interprocess::mapped_region> _mappedRegion;
+    std::vector<T> _objects;
+    KdTreeLinear() = default;
+    /**
+    * Files are only valid for the same node layout, bump the version if the layout or the build algorithm changes.
+    */
+    static_assert(std::is_trivially_copyable<Node>::value, "Nodes must be trivially copyable");
+    static const uint32_t _fileMagic = 0x48564246; // "FBVH"
+    static const uint32_t _fileVersion = 1;
+    struct FileHeader
+    {
+      uint32_t _magic;
+      uint32_t _version;
+      uint32_t _nodeSize;
+      uint32_t _numNodes;
+      uint32_t _numObjects;
+      uint32_t _padding;
+      uint64_t _key;
+    };
+    /**
+    * Checks that the nodes form a tree in the depth-first layout that build() produces: nodes are visited in index order,
+    * the depth stays within _maxDepth and the leaves reference all objects in order, one or two each. Traversal relies on
+    * all of this without range checks, so a loaded file that passes the header checks but is corrupt must not get through.
+    */
+    bool validNodes() const
+    {
+      unsigned stack[_maxDepth + 1u][2]; // Node index and depth
+      unsigned stack_size = 0;
+      stack[stack_size][0] = 0;
+      stack[stack_size++][1] = 1;
+      unsigned next_node = 0;
+      size_t next_object = 0;
+      while (stack_size) {
+        stack_size--;
+        unsigned index = stack[stack_size][0];
+        unsigned depth = stack[stack_size][1];
+        if (index != next_node++) {
+          return false;
+        }
+        const auto& node = _nodes[index];
+        if (node.isLeaf()) {
+          if (node._numObjects > 2u || node._offset != next_object) {
+            return false;
+          }
+          next_object += node._numObjects;
+        }
+        else {
+          if (depth >= _maxDepth || index + 1u >= _numNodes || node._offset <= index + 1u || node._offset >= _numNodes) {
+            return false;
+          }
+          stack[stack_size][0] = node._offset;
+          stack[stack_size++][1] = depth + 1u;
+          stack[stack_size][0] = index + 1u;
+          stack[stack_size++][1] = depth + 1u;
+        }
+      }
+      return next_node == _numNodes && next_object == _objects.size();
+    }
+    /**
+    * FNV-1a hash of the bounding volumes of objects and the split policy, which identifies the input of the build.
+    */
+    static uint64_t computeKey(const std::vector<T>& objects)
+    {
+      uint64_t hash = 14695981039346656037ull;
+      auto add = [&hash](const void* data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+          hash = (hash ^ static_cast<const unsigned char*>(data)[i]) * 1099511628211ull;
+        }
+      };
+      std::string policy = typeid(SplitPolicy).name();
+      add(policy.data(), policy.size());
+      for (const auto& o : objects) {
+        const auto& bv = GetBoundingVolume()(o);
+        Vec3f bv_min = bv.getMin();
+        Vec3f bv_max = bv.getMax();
+        float largest_bv_size = GetLargestBVSize()(o);
+        add(&bv_min, sizeof bv_min);
+        add(&bv_max, sizeof bv_max);
+        add(&largest_bv_size, sizeof largest_bv_size);
+      }
+      return hash;
+    }
+    /**
+    * Builds the subtree for the objects in [begin, end) and appends its nodes to the array nodes. Returns the index of the subtree root.
+    * In the upper levels, the right subtree is built concurrently into a separate array, which is appended afterwards.
+    */
+    unsigned build(unsigned begin, unsigned end, std::vector<T>& objects, unsigned depth, std::vector<Node>& nodes)
+    {
+      assert(depth <= _maxDepth);
+      unsigned index = static_cast<unsigned>(nodes.size());
+      nodes.push_back(Node());
+      Node node;
+      node._largestBVSize = 0.f;
+      for (unsigned i = begin; i < end; i++) {
+        node._bv = node._bv.getUnion(GetBoundingVolume()(objects[i]));
+        node._largestBVSize = std::max(node._largestBVSize, GetLargestBVSize()(objects[i]));
+      }
+      unsigned num_objects = end - begin;
+      if (num_objects <= 2u) {
+        node._offset = begin;
+        node._numObjects = num_objects;
+      }
+      else {
+        unsigned num_objects_left = SplitPolicy()(&objects.front() + begin, &objects.front() + end, node._bv, depth);
+        unsigned mid = begin + num_objects_left;
+        if (buildInParallel(num_objects, depth)) {
+          std::vector<Node> right_nodes;
+          right_nodes.reserve((end - mid) * 2u - 1u);
+          auto& job_system = JobSystem::getInstance();
+          auto right = job_system.schedule([this, mid, end, &objects, depth, &right_nodes]() {
+            PROFILE_ZONE("KdTreeLinear build subtree");
+            build(mid, end, objects, depth + 1u, right_nodes);
+          });
+          build(begin, mid, objects, depth + 1u, nodes);
+          job_system.wait(right);
+          node._offset = append(right_nodes, nodes);
+        }
+        else {
+          build(begin, mid, objects, depth + 1u, nodes);
+          node._offset = build(mid, end, objects, depth + 1u, nodes);
+        }
+        node._numObjects = 0;
+      }
+      nodes[index] = node;
+      return index;
+    }
+    /**
+    * Appends a subtree that was built into a separate array, child indices are relative to that array and have to be rebased.
+    */
+    unsigned append(const std::vector<Node>& subtree, std::vector<Node>& nodes) const
+    {
+      unsigned base = static_cast<unsigned>(nodes.size());
+      for (auto n : subtree) {
+        if (!n.isLeaf()) {
+          n._offset += base;
+        }
+        nodes.push_back(n);
+      }
+      return base;
+    }
+    static const unsigned _minObjectsParallel = 4096;
+    static inline bool buildInParallel(unsigned num_objects, unsigned depth)
+    {
+      static const unsigned num_threads = JobSystem::getInstance().getNumThreads();
+      return parallelBuild() && num_objects >= _minObjectsParallel && depth < 32u && (1u << (depth - 1u)) < num_threads;
+    }
+    static inline bool& parallelBuild()
+    {
+      static bool parallel_build = true;
+      return parallel_build;
+    }
+    inline bool isLargeEnough(const Node& node, const Camera::CullingParams& cp) const
+    {
+      return node._bv.isLargeEnough(cp._camPos, cp._thresh, node._largestBVSize);
+    }
+    inline bool isLargeEnough(const Node& node, const Camera::TemporalCullingParams& cp) const
+    {
+      return node._bv.isLargeEnough(cp._camPos, cp._thresh, node._largestBVSize, cp._tolerance);
+    }
+    inline IntersectionResult intersectFrustum(const Node& node, const Camera::CullingParams& cp) const
+    {
+      return IntersectionTests::frustumIntersectsBoundingVolume(node._bv, cp._frustumPlanes);
+    }
+    inline IntersectionResult intersectFrustum(const Node& node, const Camera::TemporalCullingParams& cp) const
+    {
+      if (IntersectionTests::frustumIntersectsBoundingVolume(node._bv, cp._outerFrustumPlanes) == IntersectionResult::OUTSIDE) {
+        return IntersectionResult::OUTSIDE;
+      }
+      return IntersectionTests::frustumIntersectsBoundingVolume(node._bv, cp._innerFrustumPlanes) == IntersectionResult::INSIDE ?
+        IntersectionResult::INSIDE : IntersectionResult::INTERSECTING;
+    }
+    inline bool isOccluded(const Node& node, const Camera::CullingParams& cp) const
+    {
+      return cp._occlusionCuller && cp._occlusionCuller->isOccluded(node._bv);
+    }
+    /**
+    * Pushes the right child first, so that the left child, which is adjacent in memory, is processed next.
+    * The right child is prefetched because it is typically located far away from its parent.
+    */
+    inline void pushChildren(unsigned index, unsigned* stack, unsigned& stack_size) const
+    {
+      _mm_prefetch(reinterpret_cast<const char*>(&_nodes[_nodes[index]._offset]), _MM_HINT_T0);
+      stack[stack_size++] = _nodes[index]._offset;
+      stack[stack_size++] = index + 1u;
+    }
+    inline void addObjects(const Node& node, StackPOD<T>& objects) const
+    {
+      for (unsigned i = node._offset; i < node._offset + node._numObjects; i++) {
+        objects.push_back(_objects[i]);
+      }
+    }
+    /**
+    * Culls the subtree at root, plane_mask contains the frustum planes that intersect all ancestors of root.
+    */
+    void cullVisibleObjects(unsigned root, unsigned char plane_mask, const Camera::CullingParams& cp, std::vector<unsigned char>& rejecting_planes,
+      CullResult<T>& cull_result) const
+    {
+      struct StackEntry
+      {
+        unsigned _index;
+        unsigned char _planeMask;
+      };
+      StackEntry stack[_maxDepth + 1u];
+      unsigned stack_size = 0;
+      stack[stack_size++] = { root, plane_mask };
+      while (stack_size) {
+        auto entry = stack[--stack_size];
+        const auto& node = _nodes[entry._index];
+        if (node._numObjects == 1) {
+          cull_result._probablyVisibleObjects.push_back(_objects[node._offset]);
+        }
+        else if (isLargeEnough(node, cp)) {
+          auto result = IntersectionTests::frustumIntersectsBoundingVolume(node._bv, cp._frustumPlanes, entry._planeMask,
+            rejecting_planes[entry._index]);
+          if (result != IntersectionResult::OUTSIDE && isOccluded(node, cp)) {
+            result = IntersectionResult::OUTSIDE;
+          }
+          if (result == IntersectionResult::INSIDE) {
+            node.isLeaf() ? addObjects(node, cull_result._fullyVisibleObjects) : cullAllObjects(entry._index, cp, cull_result._fullyVisibleObjects);
+          }
+          else if (result == IntersectionResult::INTERSECTING) {
+            if (node.isLeaf()) {
+              addObjects(node, cull_result._probablyVisibleObjects);
+            }
+            else {
+              _mm_prefetch(reinterpret_cast<const char*>(&_nodes[node._offset]), _MM_HINT_T0);
+              stack[stack_size++] = { node._offset, entry._planeMask };
+              stack[stack_size++] = { entry._index + 1u, entry._planeMask };
+            }
+          }
+        }
+      }
+    }
+    /**
+    * Subtree of the parallel traversal, see KdTree::CullTask.
+    */
+    struct CullTask
+    {
+      unsigned _index;
+      unsigned char _planeMask;
+      bool _inside;
+      unsigned _subtreeSize;
+    };
+    static const unsigned _cullTasksPerThread = 4;
+    static const unsigned _minObjectsPerCullTask = 1024;
+    inline void cullTask(const Camera::CullingParams& cp, const CullTask& task, std::vector<unsigned char>& rejecting_planes, CullResult<T>& cull_result) const
+    {
+      if (task._inside) {
+        cullAllObjects(task._index, cp, cull_result._fullyVisibleObjects);
+      }
+      else {
+        cullVisibleObjects(task._index, task._planeMask, cp, rejecting_planes, cull_result);
+      }
+    }
+    /**
+    * Number of objects in the subtree at index. The objects of a subtree are contiguous, from the first object of its leftmost leaf
+    * to the last object of its rightmost leaf.
+    */
+    inline unsigned subtreeSize(unsigned index) const
+    {
+      unsigned first = index;
+      while (!_nodes[first].isLeaf()) {
+        first++;
+      }
+      unsigned last = index;
+      while (!_nodes[last].isLeaf()) {
+        last = _nodes[last]._offset;
+      }
+      return _nodes[last]._offset + _nodes[last]._numObjects - _nodes[first]._offset;
+    }
+    void cullAllObjects(unsigned root, const Camera::CullingParams& cp, StackPOD<T>& objects) const
+    {
+      unsigned stack[_maxDepth + 1u];
+      unsigned stack_size = 0;
+      stack[stack_size++] = root;
+      while (stack_size) {
+        auto index = stack[--stack_size];
+        const auto& node = _nodes[index];
+        if (node._numObjects == 1) {
+          objects.push_back(_objects[node._offset]);
+        }
+        else if (isLargeEnough(node, cp) && !isOccluded(node, cp)) {
+          node.isLeaf() ? addObjects(node, objects) : pushChildren(index, stack, stack_size);
+        }
+      }
+    }
+    void cullAllObjects(unsigned root, const Camera::TemporalCullingParams& cp, StackPOD<T>& objects) const
+    {
+      unsigned stack[_maxDepth + 1u];
+      unsigned stack_size = 0;
+      stack[stack_size++] = root;
+      while (stack_size) {
+        auto index = stack[--stack_size];
+        const auto& node = _nodes[index];
+        if (node._numObjects == 1) {
+          objects.push_back(_objects[node._offset]);
+        }
+        else if (isLargeEnough(node, cp)) {
+          node.isLeaf() ? addObjects(node, objects) : pushChildren(index, stack, stack_size);
+        }
+      }
+    }
+    void cullAllObjects(unsigned root, const Camera::MultiViewCullingParams& cp, unsigned char views, MultiViewCullResult<T>& cull_result) const
+    {
+      unsigned stack[_maxDepth + 1u];
+      unsigned stack_size = 0;
+      stack[stack_size++] = root;
+      while (stack_size) {
+        auto index = stack[--stack_size];
+        const auto& node = _nodes[index];
+        if (node._numObjects == 1) {
+          cull_result.add(_objects[node._offset], views, 0);
+        }
+        else if (node._bv.isLargeEnough(cp._camPos, cp._thresh, node._largestBVSize)) {
+          if (node.isLeaf()) {
+            for (unsigned i = node._offset; i < node._offset + node._numObjects; i++) {
+              cull_result.add(_objects[i], views, 0);
+            }
+          }
+          else {
+            pushChildren(index, stack, stack_size);
+          }
+        }
+      }
+    }
+    void cullAllNodes(unsigned root, const Camera::CullingParams& cp, StackPOD<Node const *>& nodes) const
+    {
+      unsigned stack[_maxDepth + 1u];
+      unsigned stack_size = 0;
+      stack[stack_size++] = root;
+      while (stack_size) {
+        auto index = stack[--stack_size];
+        const auto& node = _nodes[index];
+        if (isLargeEnough(node, cp)) {
+          nodes.push_back_secure(&node);
+          if (!node.isLeaf()) {
+            pushChildren(index, stack, stack_size);
+          }
+        }
+      }
+    }
+  };
+}
+
+#endif // !KDTREELINEAR_H
@@ -0,0 +1,169 @@
+#ifndef LRUCACHE_H
+#define LRUCACHE_H
+
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace fly
+{
+  /**
+  * Cache with a budget. Once the summed cost of all elements exceeds the budget, the least recently used elements are evicted.
+  * The cost of an element is returned by a callback, e.g. its size in bytes. By default every element costs 1, so the budget is a number of elements.
+  * Pinned elements are never evicted, they may push the cost above the budget. Not thread safe.
+  */
+  template <typename Key, typename Val, typename... CreateArgs>
+  class LRUCache
+  {
+  public:
+    using CostFunc = std::function<size_t(const Val&)>;
+    using EvictFunc = std::function<void(const Key&, Val&)>;
+    LRUCache(const std::function<Val(CreateArgs...)>& create_func, size_t budget = std::numeric_limits<size_t>::max(),
+      const CostFunc& cost_func = [](const Val&) { return size_t(1); }) :
+      _createFunc(create_func),
+      _costFunc(cost_func),
+      _budget(budget)
+    {}
+    LRUCache(const LRUCache& other) = delete;
+    LRUCache& operator=(const LRUCache& other) = delete;
+    LRUCache(LRUCache&& other) = default;
+    LRUCache& operator=(LRUCache&& other) = default;
+    /**
+    * The returned reference stays valid until the element is evicted or erased. The element that is returned is not evicted by this call.
+    */
+    inline const Val& getOrCreate(const Key& key, CreateArgs... args)
+    {
+      auto it = _elements.find(key);
+      if (it != _elements.end()) {
+        _hits++;
+        _lru.splice(_lru.begin(), _lru, it->second); // Move to the front, iterators stay valid
+        return it->second->_val;
+      }
+      _misses++;
+      _lru.push_front(Entry(key, _createFunc(args...)));
+      auto& entry = _lru.front();
+      entry._cost = _costFunc(entry._val);
+      _cost += entry._cost;
+      _elements[key] = _lru.begin();
+      evict(_lru.begin());
+      return entry._val;
+    }
+    /**
+    * Pinned elements are not evicted until they are unpinned as often as they were pinned. Returns false if key is not in the cache.
+    */
+    bool pin(const Key& key)
+    {
+      auto it = _elements.find(key);
+      if (it == _elements.end()) {
+        return false;
+      }
+      it->second->_pins++;
+      return true;
+    }
+    bool unpin(const Key& key)
+    {
+      auto it = _elements.find(key);
+      if (it == _elements.end() || !it->second->_pins) {
+        return false;
+      }
+      it->second->_pins--;
+      evict(_lru.end());
+      return true;
+    }
+    /**
+    * Removes the element regardless of its pins, without calling the evict callback.
+    */
+    bool erase(const Key& key)
+    {
+      auto it = _elements.find(key);
+      if (it == _elements.end()) {
+        return false;
+      }
+      _cost -= it->second->_cost;
+      _lru.erase(it->second);
+      _elements.erase(it);
+      return true;
+    }
+    void setBudget(size_t budget)
+    {
+      _budget = budget;
+      evict(_lru.end());
+    }
+    size_t getBudget() const { return _budget; }
+    /**
+    * Summed cost of all elements in the cache.
+    */
+    size_t getCost() const { return _cost; }
+    size_t size() const { return _elements.size(); }
+    /**
+    * Called for every element right before it is evicted.
+    */
+    void setEvictFunc(const EvictFunc& evict_func) { _evictFunc = evict_func; }
+    size_t getHits() const { return _hits; }
+    size_t getMisses() const { return _misses; }
+    size_t getEvictions() const { return _evictions; }
+    void resetStats() { _hits = _misses = _evictions = 0; }
+    /**
+    * Elements from the most to the least recently used one.
+    */
+    std::vector<Val> getElements() const
+    {
+      std::vector<Val> elements;
+      for (const auto& e : _lru) {
+        elements.push_back(e._val);
+      }
+      return elements;
+    }
+    void clear()
+    {
+      _elements.clear();
+      _lru.clear();
+      _cost = 0;
+    }
+  private:
+    struct Entry
+    {
+      Entry(const Key& key, Val&& val) : _key(key), _val(std::move(val)) {}
+      Key _key;
+      Val _val;
+      size_t _cost = 0;
+      unsigned _pins = 0;
+    };
+    using Iterator = typename std::list<Entry>::iterator;
+    std::list<Entry> _lru; // Most recently used element first
+    std::unordered_map<Key, Iterator> _elements;
+    std::function<Val(CreateArgs...)> _createFunc;
+    CostFunc _costFunc;
+    EvictFunc _evictFunc;
+    size_t _budget;
+    size_t _cost = 0;
+    size_t _hits = 0;
+    size_t _misses = 0;
+    size_t _evictions = 0;
+    /**
+    * Evicts the least recently used elements until the cost is within the budget, except for pinned elements and keep.
+    */
+    void evict(Iterator keep)
+    {
+      auto it = _lru.end();
+      while (_cost > _budget && it != _lru.begin()) {
+        --it;
+        if (it->_pins || it == keep) {
+          continue;
+        }
+        _evictions++;
+        if (_evictFunc) {
+          _evictFunc(it->_key, it->_val);
+        }
+        _cost -= it->_cost;
+        _elements.erase(it->_key);
+        it = _lru.erase(it);
+      }
+    }
+  };
+}
+
+#endif
\ No newline at end of file
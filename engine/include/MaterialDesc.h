@@ -8,8 +8,15 @@
 #include <SoftwareCache.h>
 #include <StackPOD.h>
 #include <ShaderDesc.h>
+#include <IdPool.h>
 //#include <renderer/MeshRenderables.h>
 #include <PtrCache.h>
+#include <ShaderDiskCache.h>
+#include <JobSystem.h>
+#include <Profiler.h>
+#include <algorithm>
+#include <array>
+#include <cassert>
 
 namespace fly
 {
@@ -19,7 +26,8 @@ namespace fly
   /**
   * Wraps a single material and generates shaders based on the material properties.
   * The setup() method takes care of sending the necessary uniform data to the GPU once the material is bound.
-  * When the graphics settings change, all the shaders are recreated.
+  * When the graphics settings change, all the shaders are recreated. With asynchronous shader rebuilds, the sources are generated
+  * on the job system and the renderer swaps in the new shaders at the beginning of a frame, the old shaders are used until then.
   */
   template<typename API>
   class MaterialDesc : public GraphicsSettings::Listener
@@ -28,31 +36,153 @@ namespace fly
     using TextureCache = PtrCache<std::string, typename API::Texture, const std::string&>;
     using ShaderCache = PtrCache<std::string, typename API::Shader, typename API::ShaderSource&, typename API::ShaderSource&, typename API::ShaderSource&>;
     using ShaderDescCache = PtrCache<std::shared_ptr<typename API::Shader>, ShaderDesc<API>, const std::shared_ptr<typename API::Shader>&, unsigned, API&>;
+    /**
+    * Material descriptions with a pending asynchronous rebuild, owned by the render thread.
+    */
+    using RebuildQueue = std::vector<MaterialDesc*>;
     MaterialDesc(const std::shared_ptr<Material>& material, API& api, const GraphicsSettings& settings,
       TextureCache* texture_cache,
       ShaderDescCache* shader_desc_cache,
-      ShaderCache* shader_cache) :
+      ShaderCache* shader_cache,
+      RebuildQueue* rebuild_queue = nullptr) :
       _api(api),
       _material(material),
       _activeShader(api.getActiveShader()),
       _shaderDescCache(shader_desc_cache),
-      _shaderCache(shader_cache)
+      _shaderCache(shader_cache),
+      _rebuildQueue(rebuild_queue)
     {
       for (const auto& e : material->getTexturePaths()) {
          texture_cache->getOrCreate(e.second, _textures[e.first], e.second);
       }
       create(settings);
     }
+    virtual ~MaterialDesc()
+    {
+      JobSystem::getInstance().wait(_rebuildJob);
+      if (_rebuild) {
+        _rebuildQueue->erase(std::find(_rebuildQueue->begin(), _rebuildQueue->end(), this));
+      }
+      idPool().release(_id);
+    }
+    using ShaderSource = typename API::ShaderSource;
+    /**
+    * Sources of all mesh shader variants of a material. Generating them does not touch the graphics API, so it may run on worker threads.
+    */
+    struct ShaderSources
+    {
+      ShaderSource _vs;
+      ShaderSource _fs;
+      ShaderSource _vsInstanced;
+      ShaderSource _fsInstanced;
+      ShaderSource _vsDepth;
+      ShaderSource _fsDepth;
+      ShaderSource _vsDepthInstanced;
+      ShaderSource _vsWind;
+      ShaderSource _vsDepthWind;
+      ShaderSource _fsDepthWind;
+      bool _multiDraw;
+      ShaderSource _vsMultiDraw;
+      ShaderSource _fsMultiDraw;
+      ShaderSource _vsDepthMultiDraw;
+    };
+    static unsigned meshRenderFlags(const Material& material, const GraphicsSettings& settings)
+    {
+      using FLAG = MeshRenderFlag;
+      unsigned flag = FLAG::MR_NONE;
+      if (material.hasTexture(Material::TextureKey::ALBEDO)) {
+        flag |= FLAG::MR_DIFFUSE_MAP;
+      }
+      if (material.hasTexture(Material::TextureKey::ALPHA)) {
+        flag |= FLAG::MR_ALPHA_MAP;
+      }
+      if (material.hasTexture(Material::TextureKey::NORMAL) && settings.getNormalMapping()) {
+        flag |= FLAG::MR_NORMAL_MAP;
+      }
+      if (material.hasTexture(Material::TextureKey::NORMAL) && material.hasTexture(Material::TextureKey::HEIGHT) && settings.getNormalMapping() && settings.getParallaxMapping()) {
+        flag |= FLAG::MR_HEIGHT_MAP;
+      }
+      if (settings.getScreenSpaceReflections() && material.isReflective()) {
+        flag |= FLAG::MR_REFLECTIVE;
+      }
+      return flag;
+    }
+    static ShaderSources createShaderSources(unsigned flag, const GraphicsSettings& settings, const API& api)
+    {
+      using FLAG = MeshRenderFlag;
+      const auto& generator = api.getShaderGenerator();
+      ShaderSources sources;
+      sources._vs = generator.createMeshVertexShaderSource(flag, settings);
+      sources._fs = generator.createMeshFragmentShaderSource(flag, settings);
+      sources._vsInstanced = generator.createMeshVertexShaderSource(flag, settings, true);
+      sources._fsInstanced = generator.createMeshFragmentShaderSource(flag, settings, true);
+      sources._vsDepth = generator.createMeshVertexShaderDepthSource(flag, settings);
+      sources._fsDepth = generator.createMeshFragmentShaderDepthSource(flag, settings);
+      sources._vsDepthInstanced = generator.createMeshVertexShaderDepthSource(flag, settings, true);
+      sources._vsWind = generator.createMeshVertexShaderSource(flag | FLAG::MR_WIND, settings);
+      sources._vsDepthWind = generator.createMeshVertexShaderDepthSource(flag | FLAG::MR_WIND, settings);
+      sources._fsDepthWind = generator.createMeshFragmentShaderDepthSource(flag | FLAG::MR_WIND, settings);
+      sources._multiDraw = settings.getMultiDrawIndirect() && api.multiDrawIndirectSupported();
+      if (sources._multiDraw) {
+        sources._vsMultiDraw = generator.createMeshVertexShaderSource(flag | FLAG::MR_MULTI_DRAW, settings);
+        sources._fsMultiDraw = generator.createMeshFragmentShaderSource(flag | FLAG::MR_MULTI_DRAW, settings);
+        sources._vsDepthMultiDraw = generator.createMeshVertexShaderDepthSource(flag | FLAG::MR_MULTI_DRAW, settings);
+      }
+      return sources;
+    }
     void create(const GraphicsSettings& settings)
+    {
+      unsigned flag = meshRenderFlags(*_material, settings);
+      auto sources = createShaderSources(flag, settings, _api);
+      create(settings, flag, sources);
+    }
+    /**
+    * Generates the sources for settings on the job system and queues this material description, create() is not called until
+    * applyRebuild(). A newer request replaces one that was not applied yet.
+    */
+    void requestRebuild(const GraphicsSettings& settings)
+    {
+      auto& job_system = JobSystem::getInstance();
+      job_system.wait(_rebuildJob);
+      if (!_rebuild) {
+        _rebuildQueue->push_back(this);
+      }
+      // The job works on a copy of the settings, as the settings may change again while it runs.
+      _rebuild = std::make_shared<Rebuild>(settings);
+      auto rebuild = _rebuild;
+      auto material = _material;
+      auto& api = _api;
+      _rebuildJob = job_system.schedule([rebuild, material, &api]() {
+        PROFILE_ZONE("MaterialDesc::requestRebuild");
+        rebuild->_flag = meshRenderFlags(*material, rebuild->_settings);
+        rebuild->_sources = createShaderSources(rebuild->_flag, rebuild->_settings, api);
+      });
+    }
+    inline bool rebuildReady() const
+    {
+      return _rebuild && _rebuildJob.isDone();
+    }
+    /**
+    * Swaps in the shaders of a finished rebuild, must be called by the render thread while no frame is prepared.
+    * Variants whose sources did not change are taken from the shader cache, so only the changed ones are compiled.
+    * Returns true if any shader changed.
+    */
+    bool applyRebuild()
+    {
+      assert(rebuildReady());
+      auto rebuild = std::move(_rebuild);
+      auto shader_descs = getShaderDescs();
+      create(rebuild->_settings, rebuild->_flag, rebuild->_sources);
+      return shader_descs != getShaderDescs();
+    }
+    void create(const GraphicsSettings& settings, unsigned flag, ShaderSources& s)
     {
       _materialSetupFuncs.clear();
       _materialSetupFuncsDepth.clear();
 
       using FLAG = MeshRenderFlag;
-      unsigned flag = FLAG::MR_NONE;
       _materialSetupFuncs.push_back_secure(typename API::MaterialSetup::setupMaterialConstants);
-      if (_material->hasTexture(Material::TextureKey::ALBEDO)) {
-        flag |= FLAG::MR_DIFFUSE_MAP;
+      if (flag & FLAG::MR_DIFFUSE_MAP) {
         _materialSetupFuncs.push_back_secure(typename API::MaterialSetup::setupDiffuse);
       }
       else {
@@ -64,17 +194,14 @@ namespace fly
           _materialSetupFuncs.push_back_secure(typename API::MaterialSetup::setupDiffuseColor);
         }
       }
-      if (_material->hasTexture(Material::TextureKey::ALPHA)) {
-        flag |= FLAG::MR_ALPHA_MAP;
+      if (flag & FLAG::MR_ALPHA_MAP) {
         _materialSetupFuncs.push_back_secure(typename API::MaterialSetup::setupAlpha);
         _materialSetupFuncsDepth.push_back_secure(typename API::MaterialSetup::setupAlpha);
       }
-      if (_material->hasTexture(Material::TextureKey::NORMAL) && settings.getNormalMapping()) {
-        flag |= FLAG::MR_NORMAL_MAP;
+      if (flag & FLAG::MR_NORMAL_MAP) {
         _materialSetupFuncs.push_back_secure(typename API::MaterialSetup::setupNormal);
       }
-      if (_material->hasTexture(Material::TextureKey::NORMAL) && _material->hasTexture(Material::TextureKey::HEIGHT) && settings.getNormalMapping() && settings.getParallaxMapping()) {
-        flag |= FLAG::MR_HEIGHT_MAP;
+      if (flag & FLAG::MR_HEIGHT_MAP) {
         _materialSetupFuncs.push_back_secure(typename API::MaterialSetup::setupHeight);
         if (settings.getReliefMapping()) {
           _materialSetupFuncs.push_back_secure(typename API::MaterialSetup::setupRelief);
@@ -87,20 +214,23 @@ namespace fly
       if (settings.getShadows() || settings.getShadowsPCF()) {
         ss_flags |= ShaderSetupFlags::SS_SHADOWS;
       }
-      if (settings.getScreenSpaceReflections() && _material->isReflective()) {
-        flag |= FLAG::MR_REFLECTIVE;
+      if (flag & FLAG::MR_REFLECTIVE) {
         ss_flags |= ShaderSetupFlags::SS_V_INVERSE;
       }
-      auto fragment_source = _api.getShaderGenerator().createMeshFragmentShaderSource(flag, settings);
-      auto vertex_source = _api.getShaderGenerator().createMeshVertexShaderSource(flag, settings);
-      auto vertex_source_instanced = _api.getShaderGenerator().createMeshVertexShaderSource(flag, settings, true);
-      auto fragment_source_instanced = _api.getShaderGenerator().createMeshFragmentShaderSource(flag, settings, true);
-      _meshShaderDesc = createShaderDesc(createShader(vertex_source, fragment_source), ss_flags, _api);
-      _meshShaderDescDepth = createShaderDesc(createShader(_api.getShaderGenerator().createMeshVertexShaderDepthSource(flag, settings), _api.getShaderGenerator().createMeshFragmentShaderDepthSource(flag, settings)), ShaderSetupFlags::SS_VP, _api);
-      _meshShaderDescInstanced = createShaderDesc(createShader(vertex_source_instanced, fragment_source_instanced), ss_flags, _api);
-      _meshShaderDescDepthInstanced = createShaderDesc(createShader(_api.getShaderGenerator().createMeshVertexShaderDepthSource(flag, settings, true), _api.getShaderGenerator().createMeshFragmentShaderDepthSource(flag, settings)), ShaderSetupFlags::SS_VP, _api);
-      _meshShaderDescWind = createShaderDesc(createShader(_api.getShaderGenerator().createMeshVertexShaderSource(flag | FLAG::MR_WIND, settings), fragment_source), ss_flags | ShaderSetupFlags::SS_WIND | ShaderSetupFlags::SS_TIME, _api);
-      _meshShaderDescDepthWind = createShaderDesc(createShader(_api.getShaderGenerator().createMeshVertexShaderDepthSource(flag | FLAG::MR_WIND, settings), _api.getShaderGenerator().createMeshFragmentShaderDepthSource(flag | FLAG::MR_WIND, settings)), ShaderSetupFlags::SS_VP | ShaderSetupFlags::SS_WIND | ShaderSetupFlags::SS_TIME, _api);
+      _meshShaderDesc = createShaderDesc(createShader(s._vs, s._fs), ss_flags, _api);
+      _meshShaderDescDepth = createShaderDesc(createShader(s._vsDepth, s._fsDepth), ShaderSetupFlags::SS_VP, _api);
+      _meshShaderDescInstanced = createShaderDesc(createShader(s._vsInstanced, s._fsInstanced), ss_flags, _api);
+      _meshShaderDescDepthInstanced = createShaderDesc(createShader(s._vsDepthInstanced, s._fsDepth), ShaderSetupFlags::SS_VP, _api);
+      _meshShaderDescWind = createShaderDesc(createShader(s._vsWind, s._fs), ss_flags | ShaderSetupFlags::SS_WIND | ShaderSetupFlags::SS_TIME, _api);
+      _meshShaderDescDepthWind = createShaderDesc(createShader(s._vsDepthWind, s._fsDepthWind), ShaderSetupFlags::SS_VP | ShaderSetupFlags::SS_WIND | ShaderSetupFlags::SS_TIME, _api);
+      if (s._multiDraw) {
+        _meshShaderDescMultiDraw = createShaderDesc(createShader(s._vsMultiDraw, s._fsMultiDraw), ss_flags, _api);
+        _meshShaderDescDepthMultiDraw = createShaderDesc(createShader(s._vsDepthMultiDraw, s._fsDepth), ShaderSetupFlags::SS_VP, _api);
+      }
+      else {
+        _meshShaderDescMultiDraw = nullptr;
+        _meshShaderDescDepthMultiDraw = nullptr;
+      }
     }
     template<bool depth>
     inline void setup() const
@@ -113,6 +243,13 @@ namespace fly
     {
       return _material;
     }
+    /**
+    * Dense id, used to sort draw calls by material. Ids of destroyed material descriptions are reused.
+    */
+    inline unsigned getId() const
+    {
+      return _id;
+    }
     inline const std::shared_ptr<ShaderDesc<API>>& getMeshShaderDesc() const
     {
       return _meshShaderDesc;
@@ -137,6 +274,18 @@ namespace fly
     {
       return _meshShaderDescDepthInstanced;
     }
+    /**
+    * Shaders for multi draw batches of static meshes, which read the model matrices from a storage buffer.
+    * Null if multi draw indirect is disabled or not supported.
+    */
+    inline const std::shared_ptr<ShaderDesc<API>>& getMeshShaderDescMultiDraw() const
+    {
+      return _meshShaderDescMultiDraw;
+    }
+    inline const std::shared_ptr<ShaderDesc<API>>& getMeshShaderDescDepthMultiDraw() const
+    {
+      return _meshShaderDescDepthMultiDraw;
+    }
     inline std::shared_ptr<ShaderDesc<API>> createShaderDesc(const std::shared_ptr<typename API::Shader>& shader, unsigned flags, API& api)
     {
       std::shared_ptr<ShaderDesc<API>> ret;
@@ -146,7 +295,8 @@ namespace fly
     inline std::shared_ptr<typename API::Shader> createShader(typename API::ShaderSource& vs, typename API::ShaderSource& fs, typename API::ShaderSource& gs = typename API::ShaderSource())
     {
       std::shared_ptr<typename API::Shader> shader;
-      auto key = vs._key + fs._key + gs._key;
+      // The keys of the sources don't cover all settings, the hash of the code makes sure a cached shader matches the sources.
+      auto key = vs._key + fs._key + gs._key + "_" + std::to_string(ShaderDiskCache::hash(vs._source + fs._source + gs._source));
       _shaderCache->getOrCreate(key, shader, vs, fs, gs);
       return shader;
     }
@@ -154,15 +304,25 @@ namespace fly
     {
       return _diffuseColorBuffer;
     }
-    virtual void normalMappingChanged(GraphicsSettings const * gs) override { create(*gs); }
-    virtual void shadowsChanged(GraphicsSettings const * gs) override { create(*gs); }
-    virtual void shadowMapSizeChanged(GraphicsSettings const * gs) override { create(*gs); }
-    virtual void depthOfFieldChanged(GraphicsSettings const * gs) override { create(*gs); }
-    virtual void compositingChanged(GraphicsSettings const * gs) override { create(*gs); }
-    virtual void anisotropyChanged(GraphicsSettings const * gs) override { create(*gs); }
-    virtual void gammaChanged(GraphicsSettings const * gs) override { create(*gs); }
-    virtual void screenSpaceReflectionsChanged(GraphicsSettings const * gs) override { create(*gs); }
-    virtual void godRaysChanged(GraphicsSettings const * gs) override { create(*gs); }
+    virtual void normalMappingChanged(GraphicsSettings const * gs) override { settingsChanged(*gs); }
+    virtual void shadowsChanged(GraphicsSettings const * gs) override { settingsChanged(*gs); }
+    virtual void shadowMapSizeChanged(GraphicsSettings const * gs) override { settingsChanged(*gs); }
+    virtual void depthOfFieldChanged(GraphicsSettings const * gs) override { settingsChanged(*gs); }
+    virtual void compositingChanged(GraphicsSettings const * gs) override { settingsChanged(*gs); }
+    virtual void anisotropyChanged(GraphicsSettings const * gs) override { settingsChanged(*gs); }
+    virtual void gammaChanged(GraphicsSettings const * gs) override { settingsChanged(*gs); }
+    virtual void screenSpaceReflectionsChanged(GraphicsSettings const * gs) override { settingsChanged(*gs); }
+    virtual void godRaysChanged(GraphicsSettings const * gs) override { settingsChanged(*gs); }
+    virtual void multiDrawIndirectChanged(GraphicsSettings const * gs) override { settingsChanged(*gs); }
+    void settingsChanged(const GraphicsSettings& settings)
+    {
+      if (settings.getAsyncShaderRebuild() && _rebuildQueue) {
+        requestRebuild(settings);
+      }
+      else {
+        create(settings);
+      }
+    }
     inline const std::shared_ptr<typename API::Texture>& getTexture(Material::TextureKey key) const noexcept
     {
       return _textures.at(key);
@@ -179,10 +339,33 @@ namespace fly
     std::shared_ptr<ShaderDesc<API>> _meshShaderDescDepthWind;
     std::shared_ptr<ShaderDesc<API>> _meshShaderDescInstanced;
     std::shared_ptr<ShaderDesc<API>> _meshShaderDescDepthInstanced;
+    std::shared_ptr<ShaderDesc<API>> _meshShaderDescMultiDraw;
+    std::shared_ptr<ShaderDesc<API>> _meshShaderDescDepthMultiDraw;
     std::map<Material::TextureKey, std::shared_ptr<typename API::Texture>> _textures;
     typename API::StorageBuffer _diffuseColorBuffer;
     ShaderDescCache* const _shaderDescCache;
     ShaderCache* const _shaderCache;
+    RebuildQueue* const _rebuildQueue;
+    struct Rebuild
+    {
+      Rebuild(const GraphicsSettings& settings) : _settings(settings) {}
+      GraphicsSettings _settings;
+      unsigned _flag;
+      ShaderSources _sources;
+    };
+    std::shared_ptr<Rebuild> _rebuild;
+    JobSystem::JobHandle _rebuildJob;
+    std::array<std::shared_ptr<ShaderDesc<API>>, 8> getShaderDescs() const
+    {
+      return { _meshShaderDesc, _meshShaderDescDepth, _meshShaderDescWind, _meshShaderDescDepthWind,
+        _meshShaderDescInstanced, _meshShaderDescDepthInstanced, _meshShaderDescMultiDraw, _meshShaderDescDepthMultiDraw };
+    }
+    unsigned const _id = idPool().acquire();
+    static IdPool& idPool()
+    {
+      static IdPool id_pool;
+      return id_pool;
+    }
   };
 }
 
@@ -0,0 +1,164 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1 // The build may define it as 0 to compile all zones out
+#endif
+
+#if PROFILER_ENABLED
+#define PROFILER_CONCAT_IMPL(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_IMPL(a, b)
+/**
+* Records a zone from this line to the end of the enclosing scope. name must point to memory that outlives the profiler, e.g. a string literal.
+*/
+#define PROFILE_ZONE(name) fly::Profiler::Zone PROFILER_CONCAT(profiler_zone_, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#endif
+
+namespace fly
+{
+  /**
+  * Hierarchical profiler for scoped zones. Each thread writes its zones into its own ring buffer without locks, nesting is
+  * tracked per thread with a depth counter. Old zones are overwritten once a ring buffer is full, so the profiler can stay enabled
+  * in production and the last frames can be inspected or exported when a frame spike occurs.
+  * The buffers can be read from any thread while zones are recorded, zones that are overwritten during the read are skipped.
+  */
+  class Profiler
+  {
+    struct ThreadBuffer;
+  public:
+    struct ZoneRecord
+    {
+      const char* _name;
+      uint64_t _beginNanoSeconds;
+      uint64_t _endNanoSeconds;
+      unsigned _depth;
+      unsigned _threadIndex;
+    };
+    struct FrameRecord
+    {
+      uint64_t _beginNanoSeconds;
+      uint64_t _endNanoSeconds;
+    };
+    class Zone
+    {
+    public:
+      inline Zone(const char* name) :
+        _buffer(getInstance().isEnabled() ? &threadBuffer() : nullptr)
+      {
+        if (_buffer) {
+          _name = name;
+          _depth = _buffer->_depth++;
+          _begin = now();
+        }
+      }
+      inline ~Zone()
+      {
+        if (_buffer) {
+          _buffer->push(_name, _begin, now(), _depth);
+          _buffer->_depth--;
+        }
+      }
+      Zone(const Zone& other) = delete;
+      Zone& operator=(const Zone& other) = delete;
+    private:
+      ThreadBuffer* _buffer;
+      const char* _name;
+      uint64_t _begin;
+      unsigned _depth;
+    };
+    /**
+    * zones_per_thread is the capacity of each ring buffer, the profiler keeps at most that many of the latest zones per thread.
+    */
+    Profiler(unsigned zones_per_thread = 1u << 16, unsigned max_frames = 256u);
+    Profiler(const Profiler& other) = delete;
+    Profiler& operator=(const Profiler& other) = delete;
+    static Profiler& getInstance();
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+    /**
+    * Marks the beginning of a new frame, called once per frame by the thread that drives the frame loop.
+    */
+    void markFrame();
+    /**
+    * The latest frames, oldest first. The last frame ends at the time of the call.
+    */
+    std::vector<FrameRecord> getFrames() const;
+    /**
+    * All zones that are still in the ring buffers, sorted by begin time.
+    */
+    std::vector<ZoneRecord> getZones() const;
+    /**
+    * Zones that began during frame.
+    */
+    std::vector<ZoneRecord> getZones(const FrameRecord& frame) const;
+    /**
+    * Name of the timeline of a thread, e.g. "Worker 3".
+    */
+    std::string getThreadName(unsigned thread_index) const;
+    /**
+    * Writes all recorded zones in the Chrome trace event format, which can be opened with chrome://tracing or Perfetto.
+    */
+    void writeChromeTrace(std::ostream& os) const;
+    void saveChromeTrace(const std::string& path) const;
+    static uint64_t now();
+  private:
+    /**
+    * Slots are atomics, so concurrent reads are well defined. Only the owning thread writes, relaxed stores compile to plain stores.
+    */
+    struct Slot
+    {
+      std::atomic<const char*> _name;
+      std::atomic<uint64_t> _begin;
+      std::atomic<uint64_t> _end;
+      std::atomic<unsigned> _depth;
+    };
+    struct ThreadBuffer
+    {
+      ThreadBuffer(unsigned capacity, unsigned thread_index, const std::string& name);
+      std::unique_ptr<Slot[]> _slots;
+      unsigned const _capacity;
+      unsigned const _threadIndex;
+      std::string const _name;
+      /**
+      * Number of zones that were written so far, the next zone goes to _slots[_numZones % _capacity].
+      */
+      std::atomic<uint64_t> _numZones{ 0u };
+      unsigned _depth = 0;
+      inline void push(const char* name, uint64_t begin, uint64_t end, unsigned depth)
+      {
+        auto index = _numZones.load(std::memory_order_relaxed);
+        // Orders the previous increment of _numZones before the slot writes, so readers detect overwritten slots.
+        std::atomic_thread_fence(std::memory_order_release);
+        auto& slot = _slots[index % _capacity];
+        slot._name.store(name, std::memory_order_relaxed);
+        slot._begin.store(begin, std::memory_order_relaxed);
+        slot._end.store(end, std::memory_order_relaxed);
+        slot._depth.store(depth, std::memory_order_relaxed);
+        _numZones.store(index + 1u, std::memory_order_release);
+      }
+    };
+    unsigned const _zonesPerThread;
+    std::atomic<bool> _enabled{ true };
+    mutable std::mutex _mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> _threadBuffers;
+    std::vector<uint64_t> _frameBegins;
+    unsigned const _maxFrames;
+    uint64_t _numFrames = 0;
+    static thread_local ThreadBuffer* _currentThreadBuffer;
+    static ThreadBuffer& threadBuffer();
+    ThreadBuffer& registerThread();
+    void collectZones(const ThreadBuffer& buffer, std::vector<ZoneRecord>& zones) const;
+  };
+}
+
+#endif
\ No newline at end of file
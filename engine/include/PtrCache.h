@@ -2,70 +2,160 @@
 #define PTRCACHE_H
 
 #include <memory>
-#include <map>
+#include <unordered_map>
 #include <functional>
 #include <mutex>
+#include <shared_mutex>
+#include <future>
 
 namespace fly
 {
+  /**
+  * Thread safe cache of shared objects, which are removed from the cache once the last reference is released.
+  * The keys are distributed across shards by hash, each shard has its own reader writer lock, so lookups of different keys
+  * and concurrent lookups of the same key do not serialize. Objects are created outside of the lock. Threads that request
+  * a key that is being created wait for that creation instead of creating the object a second time.
+  */
   template<typename Key, typename Val, typename ... Args>
   class PtrCache
   {
   public:
-    PtrCache(const std::function<Val*(Args...)>& creator) : 
+    PtrCache(const std::function<Val*(Args...)>& creator) :
       _creator(creator),
-      _mutex(std::make_unique<std::mutex>())
+      _shards(std::make_unique<Shard[]>(numShards))
     {}
     PtrCache(const PtrCache& other) = delete;
     PtrCache& operator=(const PtrCache& other) = delete;
     PtrCache(PtrCache&& other) :
-      _cache(std::move(other._cache)),
       _creator(std::move(other._creator)),
-      _mutex(std::move(other._mutex))
+      _shards(std::move(other._shards))
     {}
     PtrCache& operator=(PtrCache&& other)
     {
       if (this != &other) {
-        _cache = std::move(other._cache);
         _creator = std::move(other._creator);
-        _mutex = std::move(other._mutex);
+        _shards = std::move(other._shards);
       }
       return *this;
     }
     /**
-    * Returns true if ret was taken from the cache, false otherwise.
+    * Returns true if ret was taken from the cache, false otherwise. If the creator throws, the exception is passed on
+    * to this call and to all calls that waited for the same key.
     */
     bool getOrCreate(const Key& key, std::shared_ptr<Val>& ret, Args... args)
     {
-      std::lock_guard<std::mutex> lock(*_mutex);
-      auto it = _cache.find(key);
-      if (it != _cache.end()) {
-        ret = std::shared_ptr<Val>(it->second); // Construct from weak_ptr
+      auto& shard = _shards[std::hash<Key>()(key) % numShards];
+      std::shared_future<std::shared_ptr<Val>> pending;
+      {
+        std::shared_lock<std::shared_timed_mutex> lock(shard._mutex);
+        if (find(shard, key, ret, pending)) {
+          return true;
+        }
+      }
+      std::promise<std::shared_ptr<Val>> promise;
+      if (!pending.valid()) {
+        std::unique_lock<std::shared_timed_mutex> lock(shard._mutex);
+        if (!find(shard, key, ret, pending)) {
+          if (pending.valid()) {
+            lock.unlock();
+          }
+          else {
+            auto& entry = shard._cache[key];
+            entry._val.reset();
+            entry._pending = promise.get_future().share();
+          }
+        }
+        else {
+          return true;
+        }
+      }
+      if (pending.valid()) {
+        ret = pending.get();
         return true;
       }
-      ret = std::shared_ptr<Val>(_creator(args...), [this, key](Val* ptr) { // Construct from creator and pass custom deleter which removes the element from the cache.
-        std::lock_guard<std::mutex> lock(*_mutex);
-        _cache.erase(key);
-        delete ptr;
-      });
-      _cache[key] = ret;
+      try {
+        // Construct from creator and pass custom deleter which removes the element from the cache.
+        auto shard_ptr = &shard;
+        ret = std::shared_ptr<Val>(_creator(args...), [shard_ptr, key](Val* ptr) {
+          {
+            std::lock_guard<std::shared_timed_mutex> lock(shard_ptr->_mutex);
+            auto it = shard_ptr->_cache.find(key);
+            // The key may already belong to a newer object that was created after this one expired.
+            if (it != shard_ptr->_cache.end() && it->second._val.expired() && !it->second._pending.valid()) {
+              shard_ptr->_cache.erase(it);
+            }
+          }
+          delete ptr;
+        });
+      }
+      catch (...) {
+        {
+          std::lock_guard<std::shared_timed_mutex> lock(shard._mutex);
+          shard._cache.erase(key);
+        }
+        promise.set_exception(std::current_exception());
+        throw;
+      }
+      {
+        std::lock_guard<std::shared_timed_mutex> lock(shard._mutex);
+        auto& entry = shard._cache[key];
+        entry._val = ret;
+        entry._pending = {};
+      }
+      promise.set_value(ret);
       return false;
     }
     inline void clear()
     {
-      std::lock_guard<std::mutex> lock(*_mutex);
-      _cache.clear();
+      for (unsigned i = 0; i < numShards; i++) {
+        std::lock_guard<std::shared_timed_mutex> lock(_shards[i]._mutex);
+        _shards[i]._cache.clear();
+      }
     }
     inline size_t size()
     {
-      std::lock_guard<std::mutex> lock(*_mutex);
-      return _cache.size();
+      size_t num_entries = 0;
+      for (unsigned i = 0; i < numShards; i++) {
+        std::shared_lock<std::shared_timed_mutex> lock(_shards[i]._mutex);
+        num_entries += _shards[i]._cache.size();
+      }
+      return num_entries;
     }
   private:
-    std::map<Key, std::weak_ptr<Val>> _cache;
+    struct Entry
+    {
+      std::weak_ptr<Val> _val;
+      /**
+      * Valid while the object is being created.
+      */
+      std::shared_future<std::shared_ptr<Val>> _pending;
+    };
+    struct Shard
+    {
+      std::shared_timed_mutex _mutex;
+      std::unordered_map<Key, Entry> _cache;
+    };
+    static const unsigned numShards = 16;
     std::function<Val*(Args...)> _creator;
-    std::unique_ptr<std::mutex> _mutex;
+    std::unique_ptr<Shard[]> _shards;
+    /**
+    * Returns true and sets ret if the key maps to a living object, sets pending if the object is being created.
+    * Must be called with the lock of the shard held.
+    */
+    static inline bool find(Shard& shard, const Key& key, std::shared_ptr<Val>& ret, std::shared_future<std::shared_ptr<Val>>& pending)
+    {
+      auto it = shard._cache.find(key);
+      if (it == shard._cache.end()) {
+        return false;
+      }
+      if (it->second._pending.valid()) {
+        pending = it->second._pending;
+        return false;
+      }
+      ret = it->second._val.lock();
+      return ret != nullptr;
+    }
   };
 }
 
-#endif
+#endif
\ No newline at end of file
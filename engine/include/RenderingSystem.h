@@ -22,6 +22,7 @@ namespace fly
     virtual void init(const Vec2i& window_size) = 0;
     virtual void setSkybox(const std::array<std::string, 6u>& paths) = 0;
     virtual void setSkydome(const std::shared_ptr<Mesh>& mesh) = 0;
+    RenderingSystem();
     virtual ~RenderingSystem();
     virtual void initShaders() = 0;
     virtual void onComponentAdded(Entity* entity, const std::shared_ptr<Component>& component) override;
@@ -2,6 +2,7 @@
 #define SHADERDESC_H
 
 #include <memory>
+#include <IdPool.h>
 #include <StackPOD.h>
 #include <Flags.h>
 #include <functional>
@@ -49,6 +50,19 @@ namespace fly
         _setupFuncs.push_back_secure(typename API::ShaderSetup::setupVInverse);
       }
     }
+    ShaderDesc(const ShaderDesc& other) = delete;
+    ShaderDesc& operator=(const ShaderDesc& other) = delete;
+    ~ShaderDesc()
+    {
+      idPool().release(_id);
+    }
+    /**
+    * Dense id, used to sort draw calls by shader. Ids of destroyed shader descriptions are reused.
+    */
+    inline unsigned getId() const
+    {
+      return _id;
+    }
     inline void setup(const GlobalShaderParams& params) const
     {
       _api.bindShader(_shader.get());
@@ -60,6 +74,12 @@ namespace fly
     std::shared_ptr<typename API::Shader> _shader;
     StackPOD<void(*)(const GlobalShaderParams&, typename API::Shader const *)> _setupFuncs;
     API & _api;
+    unsigned const _id = idPool().acquire();
+    static IdPool& idPool()
+    {
+      static IdPool id_pool;
+      return id_pool;
+    }
   };
 }
 
@@ -0,0 +1,53 @@
+#ifndef SHADERDISKCACHE_H
+#define SHADERDISKCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fly
+{
+  /**
+  * Persistent cache for generated shader sources and linked program binaries, independent of the graphics API.
+  * Every entry is a file in the cache directory, named after the hash of its key. The full key is stored in the file as well,
+  * so hash collisions and files of other versions are detected and treated as misses.
+  * Sources are also kept in memory once they were loaded or stored, so repeated lookups within a session don't touch the disk.
+  * All methods may be called concurrently, e.g. by worker threads that warm up the cache.
+  */
+  class ShaderDiskCache
+  {
+  public:
+    /**
+    * directory must exist and end with a path separator.
+    */
+    ShaderDiskCache(const std::string& directory);
+    ShaderDiskCache(const ShaderDiskCache& other) = delete;
+    ShaderDiskCache& operator=(const ShaderDiskCache& other) = delete;
+    bool loadSource(const std::string& key, std::string& source);
+    void storeSource(const std::string& key, const std::string& source);
+    /**
+    * format is the API specific binary format, e.g. the one returned by glGetProgramBinary.
+    */
+    bool loadBinary(const std::string& key, unsigned& format, std::vector<char>& binary);
+    void storeBinary(const std::string& key, unsigned format, const std::vector<char>& binary);
+    const std::string& getDirectory() const;
+    unsigned getHits() const;
+    unsigned getMisses() const;
+    static uint64_t hash(const std::string& str);
+  private:
+    static const uint32_t _fileVersion = 1;
+    std::string _directory;
+    std::mutex _mutex;
+    std::unordered_map<std::string, std::string> _sources;
+    std::atomic<unsigned> _hits{ 0u };
+    std::atomic<unsigned> _misses{ 0u };
+    std::string path(const std::string& key, const char* extension) const;
+    bool read(const std::string& key, const char* extension, uint32_t& format, std::string& data) const;
+    void write(const std::string& key, const char* extension, uint32_t format, const char* data, size_t size) const;
+  };
+}
+
+#endif
\ No newline at end of file
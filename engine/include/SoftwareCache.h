@@ -1,38 +1,33 @@
 #ifndef SOFTWARECACHE_H
 #define SOFTWARECACHE_H
 
-#include <map>
-#include <functional>
-#include <vector>
+#include <LRUCache.h>
 
 namespace fly
 {
+  /**
+  * Unbounded by default. With a maximum number of elements, the least recently used elements are evicted, see LRUCache.
+  */
   template <typename Key, typename Val, typename... CreateArgs>
   class SoftwareCache
   {
   public:
-    SoftwareCache(const std::function<Val(CreateArgs...)>& create_func) : _createFunc(create_func)
+    SoftwareCache(const std::function<Val(CreateArgs...)>& create_func, size_t max_elements = std::numeric_limits<size_t>::max()) :
+      _elements(create_func, max_elements)
     {}
     inline const Val& getOrCreate(const Key& key, CreateArgs... args) {
-      auto it = _elements.find(key);
-      if (it != _elements.end()) { // Element with this key already exists
-        return it->second; // Return the cached element
-      }
-      _elements[key] = _createFunc(args...); // Create new element
-      return _elements[key]; // Return the newly created element
+      return _elements.getOrCreate(key, args...);
     }
     std::vector<Val> getElements() const
     {
-      std::vector<Val> elements;
-      for (const auto& e : _elements) {
-        elements.push_back(e.second);
-      }
-      return elements;
+      return _elements.getElements();
     }
+    void setMaxElements(size_t max_elements) { _elements.setBudget(max_elements); }
+    size_t size() const { return _elements.size(); }
+    size_t getEvictions() const { return _elements.getEvictions(); }
     void clear() { _elements.clear(); }
   private:
-    std::map<Key, Val> _elements;
-    std::function<Val(CreateArgs...)> _createFunc;
+    LRUCache<Key, Val, CreateArgs...> _elements;
   };
 }
 
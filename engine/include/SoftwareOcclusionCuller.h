@@ -0,0 +1,88 @@
+#ifndef SOFTWAREOCCLUSIONCULLER_H
+#define SOFTWAREOCCLUSIONCULLER_H
+
+#include <math/FlyMath.h>
+#include <ZNearMapping.h>
+#include <vector>
+
+namespace fly
+{
+  class AABB;
+  class Sphere;
+  class Mesh;
+
+  /**
+  * CPU occlusion culling that doesn't need a GPU. Designated occluders (e.g. the walls of a building) are rasterized with SSE into a
+  * small depth buffer, from which a hierarchical depth buffer (HiZ) is built. Each HiZ texel stores the farthest depth of the texels
+  * it covers, so a bounding volume can be tested against a few texels only. Rasterization is split into horizontal bands that
+  * are processed in parallel. After rasterizeOccluders() returns, isOccluded() is thread safe.
+  * Depth is NDC depth (z / w), which is independent of the z near mapping of the API, smaller values are closer to the camera.
+  */
+  class SoftwareOcclusionCuller
+  {
+  public:
+    /**
+    * The width is rounded up to a multiple of four, because the rasterizer processes four pixels at once.
+    */
+    SoftwareOcclusionCuller(unsigned width = 256, unsigned height = 128);
+    /**
+    * Adds all triangles of mesh, transformed by model_matrix, to the occluders.
+    */
+    void addOccluder(const Mesh& mesh, const Mat4f& model_matrix);
+    /**
+    * Adds triangles that are already in world space, e.g. a simplified version of a mesh that was created by hand.
+    */
+    void addOccluder(const std::vector<Vec3f>& positions, const std::vector<unsigned>& indices);
+    void clearOccluders();
+    unsigned numOccluderTriangles() const;
+    /**
+    * Renders all occluders from the view defined by view_projection and builds the depth hierarchy.
+    * z_near_mapping must be the one view_projection was built with, the occluders are clipped against its near plane.
+    */
+    void rasterizeOccluders(const Mat4f& view_projection, ZNearMapping z_near_mapping);
+    /**
+    * Returns true if the bounding volume is completely hidden behind the occluders. Bounding volumes that intersect the near plane
+    * or are outside of the view are never reported as occluded.
+    */
+    bool isOccluded(const AABB& aabb) const;
+    bool isOccluded(const Sphere& sphere) const;
+    unsigned getWidth() const;
+    unsigned getHeight() const;
+    const std::vector<float>& getDepthBuffer() const;
+  private:
+    struct ScreenTriangle
+    {
+      Vec3f _v[3]; // x and y in pixels, z is NDC depth
+    };
+    /**
+    * The near plane in clip space is z + w * _nearPlaneW >= 0, i.e. z >= 0 for ZNearMapping::ZERO and z >= -w for ZNearMapping::MINUS_ONE.
+    * Clipping against it cuts the triangles at the z near of the projection, where w is positive.
+    */
+    float _nearPlaneW = 1.f;
+    static const unsigned _minTrianglesPerTask = 1024;
+    static const unsigned _minRowsPerBand = 16;
+    unsigned _width;
+    unsigned _height;
+    std::vector<Vec3f> _occluderVertices;
+    std::vector<unsigned> _occluderIndices;
+    std::vector<std::vector<ScreenTriangle>> _screenTriangles;
+    /**
+    * _hiZ[0] is the depth buffer, each following level halves the resolution.
+    */
+    std::vector<std::vector<float>> _hiZ;
+    std::vector<Vec2u> _hiZSize;
+    Mat4f _viewProjection;
+    inline float nearPlaneDistance(const Vec4f& clip) const
+    {
+      return clip[2] + clip[3] * _nearPlaneW;
+    }
+    void transformTriangles(unsigned begin, unsigned end, std::vector<ScreenTriangle>& triangles) const;
+    void clipAndAdd(const Vec4f* clip, std::vector<ScreenTriangle>& triangles) const;
+    void rasterizeBand(unsigned y_begin, unsigned y_end);
+    void rasterizeTriangle(const ScreenTriangle& triangle, unsigned y_begin, unsigned y_end);
+    void buildHiZ();
+    bool isOccluded(const Vec3f& bb_min, const Vec3f& bb_max) const;
+  };
+}
+
+#endif
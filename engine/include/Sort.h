@@ -2,7 +2,13 @@
 #define SORT_H
 
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <type_traits>
+#include <JobSystem.h>
+#include <FrameArena.h>
 
 namespace fly
 {
@@ -17,6 +23,79 @@ namespace fly
       }
     }
   }
+  /**
+  * Stable LSD radix sort by the 64 bit key get_key(element), one byte per pass. Bytes that are equal for all keys are skipped,
+  * so keys with few distinct high bits only cost a few passes. The scratch buffers and histograms are taken from arena, so sorting
+  * does not touch the heap. Histograms and scattering are distributed across the job system in ranges of at least min_range_size elements.
+  */
+  template<typename T, typename GetKey>
+  void radixSort(T* begin, T* end, FrameArena& arena, const GetKey& get_key, unsigned min_range_size = 4096u)
+  {
+    static_assert(std::is_pod<T>::value, "T must be a POD type");
+    unsigned num_elements = static_cast<unsigned>(end - begin);
+    if (num_elements < 2u) {
+      return;
+    }
+    auto& job_system = JobSystem::getInstance();
+    unsigned num_ranges = std::max(std::min(job_system.getNumThreads(), num_elements / std::max(min_range_size, 1u)), 1u);
+    unsigned range_size = (num_elements + num_ranges - 1u) / num_ranges;
+    auto offsets = arena.allocate<std::array<unsigned, 256>>(num_ranges);
+    auto range_diffs = arena.allocate<uint64_t>(num_ranges);
+    auto first_key = get_key(*begin);
+    job_system.parallelFor(0, num_ranges, 1, [&](unsigned range_begin, unsigned range_end) {
+      for (unsigned r = range_begin; r < range_end; r++) {
+        uint64_t diff = 0;
+        for (unsigned i = r * range_size; i < std::min((r + 1u) * range_size, num_elements); i++) {
+          diff |= get_key(begin[i]) ^ first_key;
+        }
+        range_diffs[r] = diff;
+      }
+    });
+    uint64_t diff = 0;
+    for (unsigned r = 0; r < num_ranges; r++) {
+      diff |= range_diffs[r];
+    }
+    if (!diff) {
+      return;
+    }
+    T* src = begin;
+    T* dst = arena.allocate<T>(num_elements);
+    for (unsigned shift = 0; shift < 64u; shift += 8u) {
+      if (!((diff >> shift) & 0xff)) {
+        continue;
+      }
+      job_system.parallelFor(0, num_ranges, 1, [&](unsigned range_begin, unsigned range_end) {
+        for (unsigned r = range_begin; r < range_end; r++) {
+          auto& histogram = offsets[r];
+          histogram.fill(0);
+          for (unsigned i = r * range_size; i < std::min((r + 1u) * range_size, num_elements); i++) {
+            histogram[(get_key(src[i]) >> shift) & 0xff]++;
+          }
+        }
+      });
+      // Exclusive prefix sum over all digits, the ranges of each digit are placed in order to keep the sort stable.
+      unsigned sum = 0;
+      for (unsigned d = 0; d < 256u; d++) {
+        for (unsigned r = 0; r < num_ranges; r++) {
+          unsigned count = offsets[r][d];
+          offsets[r][d] = sum;
+          sum += count;
+        }
+      }
+      job_system.parallelFor(0, num_ranges, 1, [&](unsigned range_begin, unsigned range_end) {
+        for (unsigned r = range_begin; r < range_end; r++) {
+          auto& offset = offsets[r];
+          for (unsigned i = r * range_size; i < std::min((r + 1u) * range_size, num_elements); i++) {
+            dst[offset[(get_key(src[i]) >> shift) & 0xff]++] = src[i];
+          }
+        }
+      });
+      std::swap(src, dst);
+    }
+    if (src != begin) {
+      std::memcpy(begin, src, num_elements * sizeof(T));
+    }
+  }
 }
 
 #endif // !SORT_H
@@ -3,6 +3,8 @@
 
 #include <math/FlyMath.h>
 #include <ostream>
+#include <algorithm>
+#include <cmath>
 
 namespace fly
 {
@@ -41,6 +43,14 @@ namespace fly
     {
       return isLargeEnough(cam_pos, error_tresh, size2());
     }
+    /**
+    * Conservative variant that returns true if the sphere may be large enough for any camera position within cam_tolerance of cam_pos.
+    */
+    inline bool isLargeEnough(const Vec3f& cam_pos, float tresh, float size, float cam_tolerance) const
+    {
+      float dist = std::max(std::abs(distance(_center, cam_pos) - _radius) - cam_tolerance, 0.f);
+      return size > tresh * dist * dist;
+    }
     inline unsigned getLongestAxis(unsigned depth) const
     {
       return depth % 3;
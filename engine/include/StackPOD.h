@@ -1,18 +1,45 @@
 #ifndef STACKPOD_H
 #define STACKPOD_H
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdlib>
+#include <cstring>
+#include <new>
 #include <type_traits>
+#include <utility>
+#include <FrameArena.h>
 
 namespace fly
 {
+  /**
+  * Inline storage of a StackPOD. Empty if num_bytes is zero, so stacks without inline storage don't grow.
+  */
+  template<size_t num_bytes, size_t alignment>
+  struct StackPODStorage
+  {
+    inline char* inlineData() { return _inlineData; }
+    alignas(alignment) char _inlineData[num_bytes];
+  };
+  template<size_t alignment>
+  struct StackPODStorage<0, alignment>
+  {
+    inline char* inlineData() { return nullptr; }
+  };
+
   /**
   * A lightweight alternative to std::vector for POD (Plain Old Data) types.
+  * Transient stacks can allocate from a FrameArena instead of the heap. A copy constructed stack allocates from the heap again,
+  * assignments keep the allocator of the assigned-to stack and only transfer the elements.
+  * The first inline_capacity elements are stored in the stack itself, so small stacks don't allocate at all.
+  * The storage is aligned to alignment bytes, which may exceed the alignment of T, e.g. for aligned SIMD loads.
   */
-  template<typename T, size_t initial_capacity = 0>
-  class StackPOD
+  template<typename T, size_t initial_capacity = 0, size_t inline_capacity = 0, size_t alignment = alignof(T)>
+  class StackPOD : private StackPODStorage<inline_capacity * sizeof(T), alignment>
   {
     static_assert(std::is_pod<T>::value, "T must be a POD type");
+    static_assert(alignment >= alignof(T) && !(alignment & (alignment - 1)), "alignment must be a power of two and at least alignof(T)");
+    template<typename, size_t, size_t, size_t> friend class StackPOD;
 
   public:
     StackPOD()
@@ -23,42 +50,52 @@ namespace fly
     }
     StackPOD(size_t size)
     {
-      allocate(size);
+      reserve(size);
       _end = _begin + size;
     }
+    /**
+    * The stack must not be used after the next reset() of the arena.
+    */
+    explicit StackPOD(FrameArena& arena) :
+      _arena(&arena)
+    {
+      if (initial_capacity) {
+        reserve(initial_capacity);
+      }
+    }
     StackPOD(const StackPOD& other)
     {
-      allocate(other._capacity);
+      reserve(other._capacity);
       std::memcpy(_begin, other._begin, other.size() * sizeof(T));
       _end = _begin + other.size();
     }
+    /**
+    * Reuses the storage of this stack if it is large enough. This stack keeps allocating from its own arena or the heap.
+    */
     StackPOD& operator=(const StackPOD& other)
     {
-      deallocate();
-      allocate(other._capacity);
-      std::memcpy(_begin, other._begin, other.size() * sizeof(T));
-      _end = _begin + other.size();
+      if (this != &other) {
+        _end = _begin;
+        reserve(other.size());
+        std::memcpy(_begin, other._begin, other.size() * sizeof(T));
+        _end = _begin + other.size();
+      }
       return *this;
     }
-    StackPOD(StackPOD&& other) :
-      _begin(other._begin),
-      _end(other._end),
-      _capacity(other._capacity)
+    /**
+    * Takes over the storage of other, unless other stores its elements inline, in which case they are copied.
+    */
+    StackPOD(StackPOD&& other) noexcept :
+      _arena(other._arena)
     {
-      other._begin = nullptr;
-      other._end = nullptr;
-      other._capacity = 0;
+      take(other);
     }
-    StackPOD& operator=(StackPOD&& other)
+    StackPOD& operator=(StackPOD&& other) noexcept
     {
       if (this != &other) {
         deallocate();
-        _begin = other._begin;
-        _end = other._end;
-        _capacity = other._capacity;
-        other._begin = nullptr;
-        other._end = nullptr;
-        other._capacity = 0;
+        _arena = other._arena;
+        take(other);
       }
       return *this;
     }
@@ -66,14 +103,21 @@ namespace fly
     {
       deallocate();
     }
-    inline void append(const StackPOD& other)
+    template<size_t other_initial_capacity, size_t other_inline_capacity, size_t other_alignment>
+    inline void append(const StackPOD<T, other_initial_capacity, other_inline_capacity, other_alignment>& other)
     {
-      auto new_size = size() + other.size();
-      while (_capacity < new_size) {
-        allocate(_capacity ? _capacity * 2u : 1u);
+      append(other._begin, other.size());
+    }
+    /**
+    * Appends count elements with a single allocation at most.
+    */
+    inline void append(const T* elements, size_t count)
+    {
+      if (count) {
+        reserveFor(size() + count);
+        std::memcpy(_end, elements, count * sizeof(T));
+        _end += count;
       }
-      std::memcpy(_end, other._begin, other.size() * sizeof(T));
-      _end += other.size();
     }
     inline void reserve(size_t new_capacity)
     {
@@ -86,6 +130,14 @@ namespace fly
       _end = _begin;
     }
     /**
+    * Changes the size of the stack, new elements are not initialized.
+    */
+    inline void resize(size_t new_size)
+    {
+      reserve(new_size);
+      _end = _begin + new_size;
+    }
+    /**
     * Adds the element to the end of the stack. No range check is performed.
     */
     inline void push_back(const T& element)
@@ -103,6 +155,17 @@ namespace fly
       }
       push_back(element);
     }
+    /**
+    * Constructs the element in place at the end of the stack, grows the stack like push_back_secure.
+    */
+    template<typename... Args>
+    inline T& emplace_back(Args&&... args)
+    {
+      if (size() == _capacity) {
+        allocate(_capacity ? _capacity * 2u : 1u);
+      }
+      return *new (_end++) T{ std::forward<Args>(args)... };
+    }
     inline T* begin() const
     {
       return _begin;
@@ -145,25 +208,100 @@ namespace fly
       return _end;
     }
   private:
-    T * _begin = nullptr;
-    T * _end = nullptr;
-    size_t _capacity = 0;
+    T * _begin = inlineBegin();
+    T * _end = _begin;
+    size_t _capacity = inline_capacity;
+    FrameArena* _arena = nullptr;
 
+    inline T* inlineBegin()
+    {
+      return reinterpret_cast<T*>(this->inlineData());
+    }
+    inline bool isInline()
+    {
+      return inline_capacity && _begin == inlineBegin();
+    }
+    /**
+    * Grows the capacity geometrically, so repeated appends take amortized constant time per element.
+    */
+    inline void reserveFor(size_t new_size)
+    {
+      if (new_size > _capacity) {
+        allocate(std::max(new_size, _capacity * 2u));
+      }
+    }
     inline void allocate(size_t new_capacity)
     {
       size_t size_old = size();
-      _begin = reinterpret_cast<T*>(std::realloc(_begin, new_capacity * sizeof(T)));
+      if (_arena || isInline() || alignment > alignof(std::max_align_t)) {
+        // Arena memory is never freed individually, the old block stays unused until the arena is reset.
+        auto new_begin = _arena ? static_cast<T*>(_arena->allocate(new_capacity * sizeof(T), alignment)) : heapAllocate(new_capacity);
+        if (size_old) {
+          std::memcpy(new_begin, _begin, size_old * sizeof(T));
+        }
+        if (!_arena && !isInline()) {
+          heapFree(_begin);
+        }
+        _begin = new_begin;
+      }
+      else {
+        _begin = reinterpret_cast<T*>(std::realloc(_begin, new_capacity * sizeof(T)));
+      }
       _capacity = new_capacity;
       _end = _begin + size_old;
     }
     inline void deallocate()
     {
-      if (_begin) {
-        std::free(_begin);
+      if (!_arena && !isInline()) {
+        heapFree(_begin);
+      }
+      _capacity = inline_capacity;
+      _begin = inlineBegin();
+      _end = _begin;
+    }
+    /**
+    * Moves the elements of other into this stack, which must be empty, and leaves other empty.
+    */
+    inline void take(StackPOD& other)
+    {
+      if (other.isInline()) {
+        std::memcpy(_begin, other._begin, other.size() * sizeof(T));
+        _end = _begin + other.size();
+        other._end = other._begin;
+      }
+      else {
+        _begin = other._begin;
+        _end = other._end;
+        _capacity = other._capacity;
+        other._capacity = inline_capacity;
+        other._begin = other.inlineBegin();
+        other._end = other._begin;
+      }
+    }
+    static inline T* heapAllocate(size_t capacity)
+    {
+      if (alignment <= alignof(std::max_align_t)) {
+        return reinterpret_cast<T*>(std::malloc(capacity * sizeof(T)));
+      }
+#ifdef _MSC_VER
+      return reinterpret_cast<T*>(_aligned_malloc(capacity * sizeof(T), alignment));
+#else
+      void* ptr;
+      return posix_memalign(&ptr, alignment, capacity * sizeof(T)) ? nullptr : reinterpret_cast<T*>(ptr);
+#endif
+    }
+    static inline void heapFree(T* ptr)
+    {
+      if (alignment <= alignof(std::max_align_t)) {
+        std::free(ptr);
+      }
+      else {
+#ifdef _MSC_VER
+        _aligned_free(ptr);
+#else
+        std::free(ptr);
+#endif
       }
-      _capacity = 0;
-      _begin = nullptr;
-      _end = nullptr;
     }
   };
 }
@@ -3,6 +3,8 @@
 
 #include <memory>
 #include <map>
+#include <string>
+#include <vector>
 
 namespace fly
 {
@@ -10,6 +12,12 @@ namespace fly
   class Component;
   class GameTimer;
 
+  /**
+  * A system is updated once per frame by the Engine. Systems that declare the data they read and write, e.g. a camera
+  * that is shared with other systems, can be updated concurrently with all systems they don't conflict with.
+  * Systems that don't declare any data access are updated on the main thread, in the order they were added to the Engine,
+  * and don't run concurrently with any other system.
+  */
   class System
   {
   public:
@@ -17,8 +25,50 @@ namespace fly
     virtual ~System();
     void setGameTimer(GameTimer const * game_timer);
     virtual void update() = 0;
+    /**
+    * Declares that update() reads data. Declarations that are made after the system was added to the Engine,
+    * e.g. once the data exists, take effect with the next Engine::update().
+    */
+    void addRead(void const * data);
+    /**
+    * Declares that update() modifies data.
+    */
+    void addWrite(void const * data);
+    /**
+    * Stands for the scene as a whole: the transforms of the entities and everything that follows them, e.g. rigid bodies
+    * and dynamic mesh renderables. Systems that move objects write it, systems that draw or query objects read it.
+    */
+    static void const * sceneData();
+    /**
+    * update() of this system is only called after update() of system has finished, regardless of the declared data.
+    */
+    void addDependency(System const * system);
+    /**
+    * Systems that make graphics API calls, e.g. the renderer, have to be updated on the thread that calls Engine::update().
+    */
+    void setMainThreadOnly(bool main_thread_only);
+    bool runsOnMainThread() const;
+    /**
+    * Returns true if both systems would access the same data, and one of them modifies it.
+    */
+    bool conflictsWith(const System& other) const;
+    bool dependsOn(System const * system) const;
+    void setName(const std::string& name);
+    const std::string& getName() const;
   protected:
     GameTimer const * _gameTimer;
+  private:
+    friend class Engine;
+    std::vector<void const *> _reads;
+    std::vector<void const *> _writes;
+    std::vector<System const *> _dependencies;
+    bool _mainThreadOnly = false;
+    /**
+    * Set by every declaration, reset by the Engine once it has rebuilt its dependency graph.
+    */
+    bool _declarationsChanged = false;
+    std::string _name;
+    bool declaresDataAccess() const;
   };
 }
 
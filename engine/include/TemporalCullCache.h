@@ -0,0 +1,124 @@
+#ifndef TEMPORALCULLCACHE_H
+#define TEMPORALCULLCACHE_H
+
+#include <Camera.h>
+#include <CullResult.h>
+#include <StackPOD.h>
+#include <algorithm>
+#include <cmath>
+
+namespace fly
+{
+  /**
+  * Exploits temporal coherence for a still or slowly moving camera. A full culling pass classifies the objects conservatively
+  * (see Camera::TemporalCullingParams) into stable objects, which stay visible as long as the camera moves less than the tolerance,
+  * and boundary objects close to the frustum planes, which need fine culling in every frame. Both sets are reused until
+  * the camera moved further, so the BVH traversal is skipped for most frames. Objects outside of both sets stay invisible.
+  * The cache must be invalidated whenever the BVH changes.
+  */
+  template<typename T>
+  class TemporalCullCache
+  {
+  public:
+    TemporalCullCache(float tolerance = 0.5f) : _tolerance(tolerance)
+    {
+    }
+    void setTolerance(float tolerance)
+    {
+      _tolerance = tolerance;
+      invalidate();
+    }
+    float getTolerance() const
+    {
+      return _tolerance;
+    }
+    void reserve(size_t size)
+    {
+      _stableObjects.reserve(size);
+      _boundaryObjects.reserve(size);
+    }
+    void invalidate()
+    {
+      _valid = false;
+    }
+    /**
+    * Appends the stable objects to cull_result._fullyVisibleObjects and the boundary objects to cull_result._probablyVisibleObjects.
+    * The BVH is only traversed if the cached sets are not valid for cp anymore.
+    */
+    template<typename BVH>
+    void cullVisibleObjects(const BVH& bvh, const Camera::CullingParams& cp, CullResult<T>& cull_result)
+    {
+      if (isValid(cp, bvh.getBV())) {
+        _hits++;
+      }
+      else {
+        _misses++;
+        _tcp._camPos = cp._camPos;
+        _tcp._thresh = cp._thresh;
+        _tcp._tolerance = _tolerance;
+        for (unsigned i = 0; i < 6; i++) {
+          _tcp._innerFrustumPlanes[i] = cp._frustumPlanes[i] + Vec4f(0.f, 0.f, 0.f, _tolerance);
+          _tcp._outerFrustumPlanes[i] = cp._frustumPlanes[i] - Vec4f(0.f, 0.f, 0.f, _tolerance);
+        }
+        _frustumPlanes = cp._frustumPlanes;
+        _stableObjects.clear();
+        _boundaryObjects.clear();
+        bvh.cullVisibleObjects(_tcp, _stableObjects, _boundaryObjects);
+        _valid = true;
+      }
+      cull_result._fullyVisibleObjects.append(_stableObjects);
+      cull_result._probablyVisibleObjects.append(_boundaryObjects);
+    }
+    unsigned getHits() const
+    {
+      return _hits;
+    }
+    unsigned getMisses() const
+    {
+      return _misses;
+    }
+    /**
+    * Fraction of culling passes that didn't need to traverse the BVH.
+    */
+    float getHitRate() const
+    {
+      unsigned total = _hits + _misses;
+      return total ? static_cast<float>(_hits) / static_cast<float>(total) : 0.f;
+    }
+    void resetStats()
+    {
+      _hits = 0;
+      _misses = 0;
+    }
+  private:
+    float _tolerance;
+    bool _valid = false;
+    unsigned _hits = 0;
+    unsigned _misses = 0;
+    Camera::TemporalCullingParams _tcp;
+    std::array<Vec4f, 6> _frustumPlanes;
+    StackPOD<T> _stableObjects;
+    StackPOD<T> _boundaryObjects;
+    /**
+    * The cached sets are valid if the camera moved less than the tolerance, and the signed distance of every point in
+    * scene_bounds to each frustum plane changed by less than the tolerance.
+    */
+    template<typename BV>
+    bool isValid(const Camera::CullingParams& cp, const BV& scene_bounds) const
+    {
+      if (!_valid || cp._thresh != _tcp._thresh || distance(cp._camPos, _tcp._camPos) > _tolerance) {
+        return false;
+      }
+      auto max_abs = maximum(abs(scene_bounds.getMin()), abs(scene_bounds.getMax()));
+      for (unsigned i = 0; i < 6; i++) {
+        auto delta = cp._frustumPlanes[i] - _frustumPlanes[i];
+        if (dot(abs(delta.xyz()), max_abs) + std::abs(delta[3]) > _tolerance) {
+          return false;
+        }
+      }
+      return true;
+    }
+  };
+}
+
+#endif // !TEMPORALCULLCACHE_H
@@ -2,6 +2,7 @@
 #define TIMING_H
 
 #include <chrono>
+#include <iosfwd>
 
 namespace fly
 {
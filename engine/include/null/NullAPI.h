@@ -0,0 +1,293 @@
+#ifndef NULLAPI_H
+#define NULLAPI_H
+
+#include <math/FlyMath.h>
+#include <ZNearMapping.h>
+#include <memory>
+#include <vector>
+#include <array>
+#include <string>
+#include <StackPOD.h>
+#include <SoftwareCache.h>
+#include <InstanceData.h>
+#include <ShaderDiskCache.h>
+
+namespace fly
+{
+  class Mesh;
+  class AABB;
+  class Sphere;
+  class Material;
+  struct GlobalShaderParams;
+  struct WindParamsLocal;
+  class GraphicsSettings;
+  template<typename API>
+  class MaterialDesc;
+
+  /**
+  * Headless implementation of the API concept that Renderer and the mesh renderables rely on. No graphics context is required
+  * and every call returns immediately, so all the CPU side frame work (culling, lod selection, display list sorting, command recording,
+  * shadow map setup) runs unchanged and can be profiled or tested on machines without a GPU.
+  * Calls are counted per type and can optionally be recorded in order.
+  */
+  class NullAPI
+  {
+  public:
+    enum class Call : unsigned
+    {
+      BEGIN_FRAME, END_FRAME, SET_VIEWPORT, CLEAR_RENDERTARGET, SET_RENDERTARGETS, BIND_BACKBUFFER, SET_STATE, BIND_SHADER, BIND_SHADOWMAP,
+      RENDER_MESH, RENDER_MESHES_INDIRECT, SET_MULTI_DRAW_DATA, CULL_INSTANCES, RENDER_INSTANCES, RENDER_SKYDOME, RENDER_DEBUG, POST_PROCESSING,
+      NUM_CALLS
+    };
+    NullAPI(const Vec4f& clear_color);
+    ~NullAPI();
+    ZNearMapping getZNearMapping() const;
+    void setViewport(const Vec2u& size) const;
+    enum class TexFilter
+    {
+      NEAREST, LINEAR
+    };
+    void clearRendertarget(bool color, bool depth, bool stencil) const;
+    static const size_t _maxRendertargets = 8;
+    template<bool enable> inline void setDepthTestEnabled() const { count(Call::SET_STATE); }
+    template<bool enable> inline void setFaceCullingEnabled() const { count(Call::SET_STATE); }
+    template<bool enable> inline void setDepthClampEnabled() const { count(Call::SET_STATE); }
+    template<bool enable> inline void setDepthWriteEnabled() const { count(Call::SET_STATE); }
+    enum class DepthFunc { NEVER, LESS, EQUAL, LEQUAL, GREATER, NOTEQUAL, GEQUAL, ALWAYS };
+    template<DepthFunc f> inline void setDepthFunc() const { count(Call::SET_STATE); }
+    enum class CullMode{BACK, FRONT};
+    template<CullMode m> inline void setCullMode() const { count(Call::SET_STATE); }
+    /**
+    * Textures only remember their size.
+    */
+    class Texture
+    {
+    public:
+      Texture() = default;
+      Texture(const Vec3u& size) : _size(size) {}
+      inline unsigned width() const { return _size[0]; }
+      inline unsigned height() const { return _size[1]; }
+      inline unsigned depth() const { return _size[2]; }
+      inline size_t sizeInBytes() const { return static_cast<size_t>(_size[0]) * _size[1] * _size[2] * 4u; }
+    private:
+      friend class NullAPI;
+      Vec3u _size = Vec3u(1u);
+    };
+    struct ShaderSource
+    {
+      std::string _key;
+      std::string _source; // Always empty
+    };
+    /**
+    * Shaders only keep the keys of their sources, which makes them distinguishable in the shader caches.
+    */
+    class Shader
+    {
+    public:
+      Shader() = default;
+      Shader(const std::string& key) : _key(key) {}
+      inline const std::string& getKey() const { return _key; }
+    private:
+      std::string _key;
+    };
+    /**
+    * Generates a unique key per flag combination and the settings that the GLSL generator depends on, but no source code.
+    */
+    class ShaderGenerator
+    {
+    public:
+      ShaderSource createMeshVertexShaderSource(unsigned flags, const GraphicsSettings& settings, bool instanced = false) const;
+      ShaderSource createMeshFragmentShaderSource(unsigned flags, const GraphicsSettings& settings, bool instanced = false) const;
+      ShaderSource createMeshVertexShaderDepthSource(unsigned flags, const GraphicsSettings& settings, bool instanced = false) const;
+      ShaderSource createMeshFragmentShaderDepthSource(unsigned flags, const GraphicsSettings& settings) const;
+    private:
+      static ShaderSource createSource(const char* prefix, unsigned flags, const GraphicsSettings& settings, bool instanced);
+    };
+    class MaterialSetup
+    {
+    public:
+      MaterialSetup() = delete;
+      static void setupDiffuse(Shader const & shader, const MaterialDesc<NullAPI>& desc) {}
+      static void setupAlpha(Shader const & shader, const MaterialDesc<NullAPI>& desc) {}
+      static void setupNormal(Shader const & shader, const MaterialDesc<NullAPI>& desc) {}
+      static void setupHeight(Shader const & shader, const MaterialDesc<NullAPI>& desc) {}
+      static void setupDiffuseColor(Shader const & shader, const MaterialDesc<NullAPI>& desc) {}
+      static void setupRelief(Shader const & shader, const MaterialDesc<NullAPI>& desc) {}
+      static void setupMaterialConstants(Shader const & shader, const MaterialDesc<NullAPI>& desc) {}
+      static void setupDiffuseColors(Shader const & shader, const MaterialDesc<NullAPI>& desc) {}
+    };
+    class ShaderSetup
+    {
+    public:
+      ShaderSetup() = delete;
+      static void setupVP(const GlobalShaderParams& params, Shader const * shader) {}
+      static void setupWorldToLight(const GlobalShaderParams& params, Shader const * shader) {}
+      static void setupLighting(const GlobalShaderParams& params, Shader const * shader) {}
+      static void setupShadows(const GlobalShaderParams& params, Shader const * shader) {}
+      static void setupTime(const GlobalShaderParams& params, Shader const * shader) {}
+      static void setupWind(const GlobalShaderParams& params, Shader const * shader) {}
+      static void setupGamma(const GlobalShaderParams& params, Shader const * shader) {}
+      static void setupVInverse(const GlobalShaderParams& params, Shader const * shader) {}
+    };
+    /**
+    * Buffers only remember their size in bytes.
+    */
+    struct Buffer
+    {
+      size_t _size = 0;
+    };
+    using RTT = Texture;
+    using Depthbuffer = Texture;
+    using Shadowmap = Texture;
+    using RendertargetStack = StackPOD<RTT const *, 0, _maxRendertargets>;
+    using StorageBuffer = Buffer;
+    using IndirectBuffer = Buffer;
+    struct MeshData
+    {
+      unsigned _count; // Number of indices
+      unsigned _id; // Sequential index of the mesh in the geometry storage
+      unsigned _firstIndex;
+      unsigned _baseVertex;
+      unsigned _type; // Size of an index in bytes, 2 or 4
+      inline unsigned numTriangles() const { return _count / 3; }
+    };
+    /**
+    * Assigns the same offsets as a packed vertex and index buffer would, but does not keep the geometry.
+    */
+    class MeshGeometryStorage
+    {
+    public:
+      MeshGeometryStorage();
+      void bind() const {}
+      MeshData addMesh(const std::shared_ptr<Mesh>& mesh);
+    private:
+      SoftwareCache<std::shared_ptr<Mesh>, MeshData, const std::shared_ptr<Mesh>&> _meshDataCache;
+      unsigned _indices = 0;
+      unsigned _baseVertex = 0;
+      unsigned _numMeshes = 0;
+    };
+    struct IndirectInfo
+    {
+      unsigned _count;
+      unsigned _primCount;
+      unsigned _firstIndex;
+      unsigned _baseVertex;
+      unsigned _baseInstance;
+      unsigned _type;
+      IndirectInfo() = default;
+      IndirectInfo(const MeshData& mesh_data) :
+        _count(mesh_data._count),
+        _primCount(0),
+        _firstIndex(mesh_data._firstIndex),
+        _baseVertex(mesh_data._baseVertex),
+        _baseInstance(0),
+        _type(mesh_data._type)
+      {}
+    };
+    std::vector<IndirectInfo> indirectFromMeshData(const std::vector<MeshData>& mesh_data) const;
+    struct MultiDrawBuffers
+    {
+      Buffer _drawData;
+      Buffer _indirectBuffer;
+    };
+    void beginFrame() const;
+    void bindShader(Shader const * shader);
+    void bindShadowmap(const Shadowmap& shadowmap) const;
+    void renderMesh(const MeshData& mesh_data) const;
+    void renderMesh(const MeshData& mesh_data, const Mat4f& model_matrix) const;
+    void renderMesh(const MeshData& mesh_data, const Mat4f& model_matrix, const Mat3f& model_matrix_inverse) const;
+    void renderMesh(const MeshData& mesh_data, const Mat4f& model_matrix, const WindParamsLocal& wind_params, const AABB& aabb) const;
+    void renderMesh(const MeshData& mesh_data, const Mat4f& model_matrix, const Mat3f& model_matrix_inverse, const WindParamsLocal& wind_params, const AABB& aabb) const;
+    void renderMesh(const MeshData& mesh_data, const Mat4f& model_matrix, const WindParamsLocal& wind_params, const Sphere& sphere) const;
+    void renderMesh(const MeshData& mesh_data, const Mat4f& model_matrix, const Mat3f& model_matrix_inverse, const WindParamsLocal& wind_params, const Sphere& sphere) const;
+    void renderMeshMVP(const MeshData& mesh_data, const Mat4f& mvp) const;
+    void renderBVs(const StackPOD<AABB const *>& aabbs, const Mat4f& transform, const Vec3f& col);
+    void renderBVs(const StackPOD<Sphere const *>& spheres, const Mat4f& transform, const Vec3f& col);
+    void renderDebugFrustum(const Mat4f& vp_debug_frustum, const Mat4f& vp);
+    void prepareCulling(const std::array<Vec4f, 6>& frustum_planes, const Vec3f& cam_pos_world, float lod_range, float thresh);
+    void prepareLod(const Vec3f& cam_pos_world, float lod_range, float thresh);
+    void endCulling() const;
+    /**
+    * Marks all instances visible in the highest detail level, there is no GPU that could cull them.
+    */
+    void cullInstances(const StorageBuffer& aabb_buffer, unsigned num_instances, const StorageBuffer& visible_instances,
+      const IndirectBuffer& indirect_draw_buffer, std::vector<IndirectInfo>& info) const;
+    void renderInstances(const StorageBuffer& visible_instance_buffer, const IndirectBuffer& indirect_draw_buffer, const StorageBuffer& instance_data,
+      const std::vector<IndirectInfo>& info, unsigned num_instances) const;
+    bool multiDrawIndirectSupported() const;
+    void setMultiDrawData(const StackPOD<InstanceData>& draw_data, const StackPOD<IndirectInfo>& indirect_info, MultiDrawBuffers& buffers) const;
+    void renderMeshesIndirect(const MultiDrawBuffers& buffers, unsigned type, unsigned first_draw, unsigned num_draws) const;
+    void setRendertargets(const RendertargetStack& rtts, const Depthbuffer* depth_buffer);
+    void setRendertargets(const RendertargetStack& rtts, const Depthbuffer* depth_buffer, unsigned depth_buffer_layer);
+    void bindBackbuffer(unsigned id) const;
+    void ssr(const RTT& lighting_buffer, const RTT& view_space_normals, const Depthbuffer& depth_buffer, const Mat4f& projection_matrix, const Vec4f& blend_weight, RTT& lighting_buffer_copy);
+    void separableBlur(const RTT& in, const std::array<std::shared_ptr<RTT>, 2>& out, RendertargetStack& rtt_stack);
+    void renderGodRays(const Depthbuffer& depth_buffer, const RTT& lighting_buffer, const Vec2f& light_pos_uv);
+    void composite(const RTT& lighting_buffer, const GlobalShaderParams& params);
+    void composite(const RTT& lighting_buffer, const GlobalShaderParams& params, const RTT& dof_buffer, const Depthbuffer& depth_buffer);
+    void composite(const RTT& lighting_buffer, const GlobalShaderParams& params, const RTT& dof_buffer, const Depthbuffer& depth_buffer, const RTT& god_ray_buffer, const Vec3f& god_ray_intensity);
+    void endFrame() const;
+    void setAnisotropy(unsigned anisotropy);
+    void enablePolygonOffset(float factor, float units) const;
+    void disablePolygonOffset() const;
+    void renderSkydome(const Mat4f& view_projection_matrix, const MeshData& mesh_data);
+    static Texture* createTexture(const std::string& path);
+    /**
+    * Looks up the shader key in the shader disk cache like OpenGLAPI does for program binaries, the key is stored as binary.
+    */
+    Shader* createShader(ShaderSource& vs, ShaderSource& fs, ShaderSource& gs = ShaderSource());
+    std::unique_ptr<RTT> createRenderToTexture(const Vec2u& size, TexFilter filter);
+    std::unique_ptr<Depthbuffer> createDepthbuffer(const Vec2u& size);
+    std::unique_ptr<Shadowmap> createShadowmap(const GraphicsSettings& settings);
+    template<typename T>
+    StorageBuffer createStorageBuffer(T const* data, size_t num_elements) const
+    {
+      StorageBuffer buffer;
+      buffer._size = num_elements * sizeof(T);
+      return buffer;
+    }
+    IndirectBuffer createIndirectBuffer(const IndirectInfo& info) const;
+    IndirectBuffer createIndirectBuffer(const std::vector<IndirectInfo>& info) const;
+    void resizeShadowmap(Shadowmap* shadow_map, const GraphicsSettings& settings);
+    void createBlurShader(const GraphicsSettings& gs);
+    void createCompositeShader(const GraphicsSettings& gs);
+    void createScreenSpaceReflectionsShader(const GraphicsSettings& gs);
+    void createGodRayShader(const GraphicsSettings& gs);
+    const ShaderGenerator& getShaderGenerator() const;
+    Shader const *& getActiveShader();
+    void setShaderDiskCache(const std::string& directory);
+    const ShaderDiskCache* getShaderDiskCache() const;
+    /**
+    * Number of calls of the given type since construction or the last call to resetCounters().
+    */
+    unsigned getCount(Call call) const;
+    /**
+    * Number of triangles that would have been drawn, instanced draws count the highest detail level for every instance.
+    */
+    unsigned getNumTriangles() const;
+    void resetCounters();
+    /**
+    * If enabled, every call is also appended to the call list, in order.
+    */
+    void setRecording(bool enabled);
+    const StackPOD<Call>& getRecordedCalls() const;
+    void clearRecordedCalls();
+  private:
+    Shader const * _activeShader = nullptr;
+    ShaderGenerator _shaderGenerator;
+    std::unique_ptr<ShaderDiskCache> _shaderDiskCache;
+    mutable std::array<unsigned, static_cast<size_t>(Call::NUM_CALLS)> _counts;
+    mutable unsigned _numTriangles = 0;
+    mutable StackPOD<Call> _recordedCalls;
+    bool _recording = false;
+    inline void count(Call call) const
+    {
+      _counts[static_cast<size_t>(call)]++;
+      if (_recording) {
+        _recordedCalls.push_back_secure(call);
+      }
+    }
+  };
+}
+
+#endif
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <opengl/GLShaderSource.h>
+#include <ShaderDiskCache.h>
 
 namespace fly
 {
@@ -14,6 +15,18 @@ namespace fly
   {
   public:
     GLSLShaderGenerator();
+    /**
+    * Bump if the generated code changes, sources that were cached by an older version are not used anymore.
+    */
+    static constexpr const unsigned version = 1;
+    /**
+    * Mesh shader sources are taken from the cache if possible and stored to it after they were generated. nullptr disables the cache.
+    */
+    void setDiskCache(ShaderDiskCache* disk_cache);
+    /**
+    * Identifies a mesh shader variant by its key, the flags, the generator version and all settings the generated code depends on.
+    */
+    std::string variantKey(const std::string& key, unsigned flags, const GraphicsSettings& settings, bool instanced) const;
     GLShaderSource createMeshVertexShaderSource(unsigned flags, const GraphicsSettings& settings, bool instanced = false) const;
     GLShaderSource createMeshFragmentShaderSource(unsigned flags, const GraphicsSettings& settings, bool instanced = false) const;
     GLShaderSource createMeshVertexShaderDepthSource(unsigned flags, const GraphicsSettings& settings, bool instanced = false) const;
@@ -105,7 +118,24 @@ float noise(vec2 p)\n\
     std::string _windParamString;
     std::string _windCodeString;
     std::string _instanceDataStr;
+    std::string _multiDrawExtensionStr;
+    std::string _drawDataStr;
     GLShaderSource _compositeVertexSource;
+    ShaderDiskCache* _diskCache = nullptr;
+    template<typename Generate>
+    inline std::string cachedSource(const std::string& key, unsigned flags, const GraphicsSettings& settings, bool instanced, const Generate& generate) const
+    {
+      if (!_diskCache) {
+        return generate();
+      }
+      auto variant_key = variantKey(key, flags, settings, instanced);
+      std::string source;
+      if (!_diskCache->loadSource(variant_key, source)) {
+        source = generate();
+        _diskCache->storeSource(variant_key, source);
+      }
+      return source;
+    }
   };
 }
 
@@ -19,6 +19,15 @@ namespace fly
     GLShaderProgram& operator=(GLShaderProgram&& other);
     void add(GLShaderSource& source);
     void link();
+    /**
+    * Replaces compilation and linking by a binary from getBinary(). Returns false if the driver rejects the binary, e.g. after a driver update.
+    * sources are only remembered, they are not compiled.
+    */
+    bool linkBinary(GLenum format, const std::vector<char>& binary, const std::vector<GLShaderSource>& sources);
+    /**
+    * Binary of the linked program, format is empty if the driver does not provide one.
+    */
+    void getBinary(GLenum& format, std::vector<char>& binary) const;
     void bind() const;
     inline const GLint & uniformLocation(const char* name) const
     {
@@ -38,6 +47,7 @@ namespace fly
     std::vector<char*> _uniformNames;
     std::vector<GLShaderSource> _sources;
     void cleanup();
+    void initUniforms();
 
   };
 }
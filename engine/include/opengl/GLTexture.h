@@ -17,6 +17,11 @@ namespace fly
     void bind() const;
     void image2D(GLint level, GLint internal_format, const Vec2u& size, GLint border, GLenum format, GLenum type, const void* data);
     void image3D(GLint level, GLint internal_format, const Vec3u& size, GLint border, GLenum format, GLenum type, const void* data);
+    /**
+    * Queries the size and internal format of the base level, for textures that were filled outside of this class, e.g. by SOIL.
+    * The texture must be bound.
+    */
+    void querySize();
     void param(GLenum name, GLint val) const;
     void param(GLenum name, const GLfloat* val) const;
     unsigned width() const;
@@ -24,6 +29,10 @@ namespace fly
     unsigned depth() const;
     GLuint format() const;
     GLenum target() const;
+    /**
+    * Memory of the base level, estimated from the internal format. Drivers pad three channel formats to four bytes per pixel.
+    */
+    size_t sizeInBytes() const;
     ~GLTexture();
   private:
     GLuint _id;
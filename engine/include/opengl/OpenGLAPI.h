@@ -25,6 +25,8 @@
 #include <opengl/GLShaderInterface.h>
 #include <opengl/GLMaterialSetup.h>
 #include <SoftwareCache.h>
+#include <InstanceData.h>
+#include <ShaderDiskCache.h>
 
 namespace fly
 {
@@ -108,7 +110,7 @@ namespace fly
     using Shadowmap = GLTexture;
     using Texture = GLTexture;
     using Shader = GLShaderProgram;
-    using RendertargetStack = StackPOD<RTT const *>;
+    using RendertargetStack = StackPOD<RTT const *, 0, _maxRendertargets>;
     using ShaderGenerator = GLSLShaderGenerator;
     using MaterialSetup = GLMaterialSetup;
     using ShaderSetup = GLShaderSetup;
@@ -118,6 +120,7 @@ namespace fly
     struct MeshData // For each mesh
     {
       GLsizei _count; // Number of indices (i.e. num triangles * 3)
+      unsigned _id; // Sequential index of the mesh in the geometry storage
       GLvoid* _indices; // Byte offset into the index buffer
       GLint _baseVertex; // Offset into the vertex buffer
       GLenum _type; // Either GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, depending on the number of vertices of this mesh.
@@ -144,6 +147,7 @@ namespace fly
       SoftwareCache<std::shared_ptr<Mesh>, MeshData, const std::shared_ptr<Mesh>&> _meshDataCache;
       size_t _indices = 0;
       size_t _baseVertex = 0;
+      unsigned _numMeshes = 0;
     };
     struct IndirectInfo
     {
@@ -151,8 +155,9 @@ namespace fly
       unsigned _primCount; // Number of instances, typically reset each frame an then atomically incremented by a compute shader
       unsigned _firstIndex; // Corresponds to MeshData::_indices, but this is an index instead of a byte offset.
       unsigned _baseVertex; // Same as MeshData::_baseVertex
-      unsigned _baseInstance; // Currently not used
+      unsigned _baseInstance; // Index of the draw data for multi draw batches, otherwise not used
       GLenum _type; // Same as MeshData::_type
+      IndirectInfo() = default;
       IndirectInfo(const MeshData& mesh_data)
       {
         _count = mesh_data._count;
@@ -164,6 +169,14 @@ namespace fly
       }
     };
     std::vector<IndirectInfo> indirectFromMeshData(const std::vector<MeshData>& mesh_data) const;
+    /**
+    * GPU copies of the per draw data and the indirect draws of a recorded multi draw batch list.
+    */
+    struct MultiDrawBuffers
+    {
+      StorageBuffer _drawData = StorageBuffer(GL_SHADER_STORAGE_BUFFER);
+      IndirectBuffer _indirectBuffer = IndirectBuffer(GL_DRAW_INDIRECT_BUFFER);
+    };
     // Texture unit bindings
     static constexpr const int diffuseTexUnit = 0;
     static constexpr const int alphaTexUnit = 1;
@@ -195,6 +208,15 @@ namespace fly
       const IndirectBuffer& indirect_draw_buffer, std::vector<IndirectInfo>& info) const;
     void renderInstances(const StorageBuffer& visible_instance_buffer, const IndirectBuffer& indirect_draw_buffer, const StorageBuffer& instance_data, 
       const std::vector<IndirectInfo>& info, unsigned num_instances) const;
+    /**
+    * Multi draw indirect requires gl_BaseInstanceARB in the vertex shader to fetch the per draw data.
+    */
+    bool multiDrawIndirectSupported() const;
+    void setMultiDrawData(const StackPOD<InstanceData>& draw_data, const StackPOD<IndirectInfo>& indirect_info, MultiDrawBuffers& buffers) const;
+    /**
+    * Draws num_draws indirect draws starting at first_draw with a single call, all of them must have the same index type.
+    */
+    void renderMeshesIndirect(const MultiDrawBuffers& buffers, GLenum type, unsigned first_draw, unsigned num_draws) const;
     void setRendertargets(const RendertargetStack& rtts, const Depthbuffer* depth_buffer);
     void setRendertargets(const RendertargetStack& rtts, const Depthbuffer* depth_buffer, unsigned depth_buffer_layer);
     void bindBackbuffer(unsigned id) const;
@@ -210,7 +232,10 @@ namespace fly
     void disablePolygonOffset() const;
     void renderSkydome(const Mat4f& view_projection_matrix, const MeshData& mesh_data);
     static Texture* createTexture(const std::string& path);
-    static Shader* createShader(ShaderSource& vs, ShaderSource& fs, ShaderSource& gs = ShaderSource());
+    /**
+    * Loads the program binary from the shader disk cache if possible, otherwise compiles and links the sources and caches the binary.
+    */
+    Shader* createShader(ShaderSource& vs, ShaderSource& fs, ShaderSource& gs = ShaderSource());
     Shader createComputeShader(ShaderSource& source);
     std::unique_ptr<RTT> createRenderToTexture(const Vec2u& size, TexFilter filter);
     std::unique_ptr<Depthbuffer> createDepthbuffer(const Vec2u& size);
@@ -231,6 +256,12 @@ namespace fly
     void createGodRayShader(const GraphicsSettings& gs);
     const ShaderGenerator& getShaderGenerator() const;
     Shader const *& getActiveShader();
+    /**
+    * Enables the persistent cache for generated mesh shader sources and program binaries, directory must exist.
+    * An empty directory disables the cache.
+    */
+    void setShaderDiskCache(const std::string& directory);
+    const ShaderDiskCache* getShaderDiskCache() const;
   private:
     struct GlewInit
     {
@@ -241,7 +272,7 @@ namespace fly
     GlewInit _glewInit;
     GLShaderProgram const * _activeShader;
     GLFramebuffer _offScreenFramebuffer;
-    StackPOD<GLenum> _drawBuffers;
+    StackPOD<GLenum, 0, _maxRendertargets> _drawBuffers;
     Shader _compositeShader;
     Shader _skydomeShader;
     GLShaderProgram _ssrShader;
@@ -252,6 +283,11 @@ namespace fly
     GLVertexArray _vaoAABB;
     GLBuffer _vboAABB;
     ShaderGenerator _shaderGenerator;
+    std::unique_ptr<ShaderDiskCache> _shaderDiskCache;
+    /**
+    * Program binaries are only valid for the driver that created them, so the driver is part of their keys.
+    */
+    std::string _driverKey;
     GLSampler _samplerAnisotropic;
     GLint _glVersionMajor, _glVersionMinor;
     Shader _debugFrustumShader;
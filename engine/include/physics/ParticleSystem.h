@@ -42,6 +42,7 @@ namespace fly
     void getParticleTransformations(std::vector<Mat4f>& transformations) const;
     std::deque<Particle>& getParticles();
   private:
+    static const unsigned _minParticlesPerJob = 1024;
     ParticleSystemDesc _desc;
     Particle emitParticle(float time);
   //  glm::vec3 _gravity = glm::vec3(0.f, 0.01f, 0.f);
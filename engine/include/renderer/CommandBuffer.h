@@ -0,0 +1,273 @@
+#ifndef COMMANDBUFFER_H
+#define COMMANDBUFFER_H
+
+#include <StackPOD.h>
+#include <math/FlyMath.h>
+#include <GlobalShaderParams.h>
+#include <InstanceData.h>
+#include <cstring>
+
+namespace fly
+{
+  template<typename API>
+  class ShaderDesc;
+  template<typename API>
+  class MaterialDesc;
+  template<typename API, typename BV>
+  class IMeshRenderable;
+
+  /**
+  * Recorded stream of POD draw commands. Recording only writes CPU memory and never calls the graphics API, so
+  * several buffers can be recorded by worker threads in parallel. The thread that owns the API replays them with execute().
+  * Model matrices are stored separately, draw commands refer to them by offset.
+  * If multi draw is enabled, consecutive static mesh draws with the same material are merged into a single MULTI_DRAW command,
+  * the per draw data and the indirect draws are uploaded once per buffer before the replay.
+  */
+  template<typename API, typename BV>
+  class CommandBuffer
+  {
+  public:
+    enum class CommandType : unsigned
+    {
+      SET_SHADER, SET_MATERIAL, DRAW_MESH, DRAW_RENDERABLE, MULTI_DRAW
+    };
+    struct Command
+    {
+      CommandType _type;
+      unsigned _matrixOffset; // DRAW_MESH: Index into the model matrices, MULTI_DRAW: Index of the first indirect draw
+      unsigned _count; // Only used by MULTI_DRAW
+      union
+      {
+        ShaderDesc<API> const * _shaderDesc;
+        MaterialDesc<API> const * _materialDesc;
+        typename API::MeshData const * _meshData;
+        IMeshRenderable<API, BV> const * _meshRenderable; // For renderables that need more than a model matrix, replayed with render() or renderDepth()
+      };
+    };
+    /**
+    * Shader and material that are bound on the API side, shared across all buffers that are replayed in sequence.
+    */
+    struct ExecutionState
+    {
+      ShaderDesc<API> const * _shaderDesc = nullptr;
+      MaterialDesc<API> const * _materialDesc = nullptr;
+    };
+    void clear()
+    {
+      _commands.clear();
+      _modelMatrices.clear();
+      _modelMatricesInverse.clear();
+      _drawData.clear();
+      _indirectInfo.clear();
+      _shaderDesc = nullptr;
+      _materialDesc = nullptr;
+      _boundShaderDesc = nullptr;
+      _boundMaterialDesc = nullptr;
+    }
+    /**
+    * Static mesh draws are merged into multi draw batches if enabled and if the material provides multi draw shaders.
+    */
+    inline void setMultiDraw(bool enabled)
+    {
+      _multiDraw = enabled;
+    }
+    /**
+    * Shader and material changes are recorded lazily with the next draw, because multi draw batches
+    * replace the shader. Redundant changes are not recorded.
+    */
+    inline void setShader(ShaderDesc<API> const * shader_desc)
+    {
+      _shaderDesc = shader_desc;
+    }
+    inline void setMaterial(MaterialDesc<API> const * material_desc)
+    {
+      _materialDesc = material_desc;
+    }
+    /**
+    * Draw with a model matrix only, for depth passes.
+    */
+    inline void drawMesh(const typename API::MeshData& mesh_data, const Mat4f& model_matrix)
+    {
+      if (auto shader_desc = multiDrawShader(true)) {
+        pushMultiDraw(shader_desc, mesh_data, model_matrix, Mat4f());
+      }
+      else {
+        pushDrawMesh(mesh_data);
+        _modelMatrices.push_back_secure(model_matrix);
+      }
+    }
+    inline void drawMesh(const typename API::MeshData& mesh_data, const Mat4f& model_matrix, const Mat3f& model_matrix_inverse)
+    {
+      if (auto shader_desc = multiDrawShader(false)) {
+        pushMultiDraw(shader_desc, mesh_data, model_matrix, Mat4f(glm::mat4(glm::mat3(model_matrix_inverse))));
+      }
+      else {
+        pushDrawMesh(mesh_data);
+        _modelMatrices.push_back_secure(model_matrix);
+        _modelMatricesInverse.push_back_secure(model_matrix_inverse);
+      }
+    }
+    inline void drawRenderable(IMeshRenderable<API, BV> const * mesh_renderable)
+    {
+      bind(_shaderDesc);
+      Command cmd = {};
+      cmd._type = CommandType::DRAW_RENDERABLE;
+      cmd._meshRenderable = mesh_renderable;
+      _commands.push_back_secure(cmd);
+    }
+    /**
+    * Replays the commands. The buffer must have been recorded for the same pass type, i.e. depth passes
+    * replay draws without inverse model matrices. The multi draw data is uploaded to buffers first.
+    */
+    template<bool depth>
+    void execute(const API& api, const GlobalShaderParams& gsp, ExecutionState& state, typename API::MultiDrawBuffers& multi_draw_buffers) const
+    {
+      if (_indirectInfo.size()) {
+        api.setMultiDrawData(_drawData, _indirectInfo, multi_draw_buffers);
+      }
+      for (const auto& cmd : _commands) {
+        switch (cmd._type) {
+        case CommandType::SET_SHADER:
+          if (cmd._shaderDesc != state._shaderDesc) {
+            cmd._shaderDesc->setup(gsp);
+            state._shaderDesc = cmd._shaderDesc;
+            state._materialDesc = nullptr;
+          }
+          break;
+        case CommandType::SET_MATERIAL:
+          if (cmd._materialDesc != state._materialDesc) {
+            cmd._materialDesc->template setup<depth>();
+            state._materialDesc = cmd._materialDesc;
+          }
+          break;
+        case CommandType::DRAW_MESH:
+          depth ? api.renderMesh(*cmd._meshData, _modelMatrices[cmd._matrixOffset]) :
+            api.renderMesh(*cmd._meshData, _modelMatrices[cmd._matrixOffset], _modelMatricesInverse[cmd._matrixOffset]);
+          break;
+        case CommandType::DRAW_RENDERABLE:
+          depth ? cmd._meshRenderable->renderDepth(api) : cmd._meshRenderable->render(api);
+          break;
+        case CommandType::MULTI_DRAW:
+          api.renderMeshesIndirect(multi_draw_buffers, _indirectInfo[cmd._matrixOffset]._type, cmd._matrixOffset, cmd._count);
+          break;
+        }
+      }
+    }
+    inline const StackPOD<Command>& getCommands() const
+    {
+      return _commands;
+    }
+    inline size_t size() const
+    {
+      return _commands.size();
+    }
+    inline const StackPOD<InstanceData>& getDrawData() const
+    {
+      return _drawData;
+    }
+    inline const StackPOD<typename API::IndirectInfo>& getIndirectInfo() const
+    {
+      return _indirectInfo;
+    }
+    unsigned count(CommandType type) const
+    {
+      unsigned num = 0;
+      for (const auto& cmd : _commands) {
+        num += cmd._type == type;
+      }
+      return num;
+    }
+    /**
+    * Two buffers are equal if they contain the same commands and the same matrices.
+    */
+    bool operator==(const CommandBuffer& other) const
+    {
+      return equal(_commands, other._commands) && equal(_modelMatrices, other._modelMatrices) && equal(_modelMatricesInverse, other._modelMatricesInverse)
+        && equal(_drawData, other._drawData) && equal(_indirectInfo, other._indirectInfo);
+    }
+    bool operator!=(const CommandBuffer& other) const
+    {
+      return !(*this == other);
+    }
+  private:
+    StackPOD<Command> _commands;
+    StackPOD<Mat4f> _modelMatrices;
+    StackPOD<Mat3f> _modelMatricesInverse;
+    StackPOD<InstanceData> _drawData;
+    StackPOD<typename API::IndirectInfo> _indirectInfo;
+    bool _multiDraw = false;
+    /**
+    * Requested state and the state the recorded commands leave bound.
+    */
+    ShaderDesc<API> const * _shaderDesc = nullptr;
+    MaterialDesc<API> const * _materialDesc = nullptr;
+    ShaderDesc<API> const * _boundShaderDesc = nullptr;
+    MaterialDesc<API> const * _boundMaterialDesc = nullptr;
+    inline void bind(ShaderDesc<API> const * shader_desc)
+    {
+      if (shader_desc != _boundShaderDesc) {
+        Command cmd = {};
+        cmd._type = CommandType::SET_SHADER;
+        cmd._shaderDesc = shader_desc;
+        _commands.push_back_secure(cmd);
+        _boundShaderDesc = shader_desc;
+        _boundMaterialDesc = nullptr;
+      }
+      if (_materialDesc != _boundMaterialDesc) {
+        Command cmd = {};
+        cmd._type = CommandType::SET_MATERIAL;
+        cmd._materialDesc = _materialDesc;
+        _commands.push_back_secure(cmd);
+        _boundMaterialDesc = _materialDesc;
+      }
+    }
+    inline ShaderDesc<API> const * multiDrawShader(bool depth) const
+    {
+      if (!_multiDraw || !_materialDesc) {
+        return nullptr;
+      }
+      return (depth ? _materialDesc->getMeshShaderDescDepthMultiDraw() : _materialDesc->getMeshShaderDescMultiDraw()).get();
+    }
+    /**
+    * Appends the draw to the previous MULTI_DRAW command if nothing was bound in between and the index type matches.
+    */
+    inline void pushMultiDraw(ShaderDesc<API> const * shader_desc, const typename API::MeshData& mesh_data, const Mat4f& model_matrix, const Mat4f& model_matrix_inverse)
+    {
+      bind(shader_desc);
+      typename API::IndirectInfo info(mesh_data);
+      info._primCount = 1;
+      info._baseInstance = static_cast<unsigned>(_indirectInfo.size());
+      if (_commands.size() && _commands.back()._type == CommandType::MULTI_DRAW && _indirectInfo.back()._type == info._type) {
+        _commands.back()._count++;
+      }
+      else {
+        Command cmd = {};
+        cmd._type = CommandType::MULTI_DRAW;
+        cmd._matrixOffset = info._baseInstance;
+        cmd._count = 1;
+        _commands.push_back_secure(cmd);
+      }
+      _indirectInfo.push_back_secure(info);
+      InstanceData draw_data = {};
+      draw_data._modelMatrix = model_matrix;
+      draw_data._modelMatrixInverse = model_matrix_inverse;
+      _drawData.push_back_secure(draw_data);
+    }
+    inline void pushDrawMesh(const typename API::MeshData& mesh_data)
+    {
+      bind(_shaderDesc);
+      Command cmd = {};
+      cmd._type = CommandType::DRAW_MESH;
+      cmd._matrixOffset = static_cast<unsigned>(_modelMatrices.size());
+      cmd._meshData = &mesh_data;
+      _commands.push_back_secure(cmd);
+    }
+    template<typename T>
+    static bool equal(const StackPOD<T>& a, const StackPOD<T>& b)
+    {
+      return a.size() == b.size() && !std::memcmp(a.begin(), b.begin(), a.size() * sizeof(T));
+    }
+  };
+}
+
+#endif // !COMMANDBUFFER_H
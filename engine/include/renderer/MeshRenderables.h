@@ -9,14 +9,22 @@
 #include <AABB.h>
 #include <WindParamsLocal.h>
 #include <Transform.h>
+#include <InstanceData.h>
 #include <Sphere.h>
 #include <IntersectionTests.h>
 #include <Camera.h>
+#include <KdTree.h>
+#include <renderer/CommandBuffer.h>
 #include <boost/pool/object_pool.hpp>
 
 namespace fly
 {
   template<typename API, typename BV>
+  class IMeshRenderable;
+  /**
+  * The BVH type used for the static scene geometry can be exchanged, e.g. for KdTreeLinear or a KdTree built with BinnedSAHSplit.
+  */
+  template<typename API, typename BV, typename BVHType = KdTree<IMeshRenderable<API, BV>*, BV>>
   class Renderer;
   template<typename API, typename BV>
   class RenderList;
@@ -48,6 +56,18 @@ namespace fly
     inline MaterialDesc<API> * getMaterialDesc() const { return _materialDesc.get(); }
     virtual void renderDepth(API const & api) const = 0;
     virtual void render(API const & api) const = 0;
+    /**
+    * Records the draw into a command buffer instead of calling the API directly. May be called from worker threads.
+    * By default, the renderable itself is recorded and replayed with render() or renderDepth().
+    */
+    virtual void record(CommandBuffer<API, BV>& command_buffer) const
+    {
+      command_buffer.drawRenderable(this);
+    }
+    virtual void recordDepth(CommandBuffer<API, BV>& command_buffer) const
+    {
+      command_buffer.drawRenderable(this);
+    }
     inline const BV& getBV() const { return _bv; }
     /**
     * Called for fully visible meshes.
@@ -67,6 +87,13 @@ namespace fly
         renderlist.addVisibleMesh(this);
       }
     }
+    /**
+    * Called for meshes whose bounding volume was already found to intersect the view frustum, e.g. by a batched frustum test.
+    */
+    virtual void addIfLargeEnoughIntersecting(const Camera::CullingParams& cp, RenderList<API, BV>& renderlist)
+    {
+      addIfLargeEnough(cp, renderlist);
+    }
     virtual float getLargestObjectBVSize() const
     {
       return _bv.size2();
@@ -76,6 +103,13 @@ namespace fly
       return 1;
     }
     virtual unsigned numTriangles() const = 0;
+    /**
+    * Id of the geometry that is drawn, used to sort draw calls by mesh. Zero if there is no single mesh.
+    */
+    virtual unsigned getMeshId() const
+    {
+      return 0;
+    }
   protected:
     std::shared_ptr<MaterialDesc<API>> _materialDesc;
     std::shared_ptr<ShaderDesc<API>> const * _shaderDesc;
@@ -103,7 +137,8 @@ namespace fly
   {
   public:
     typename API::MeshData _meshData;
-    SkydomeRenderable(Renderer<API, BV>& renderer, const std::shared_ptr<Mesh>& mesh) :
+    template<typename BVHType>
+    SkydomeRenderable(Renderer<API, BV, BVHType>& renderer, const std::shared_ptr<Mesh>& mesh) :
       _meshData(renderer.addMesh(mesh))
     {
     }
@@ -116,7 +151,8 @@ namespace fly
   class StaticMeshRenderable : public IMeshRenderable<API, BV>
   {
   public:
-    StaticMeshRenderable(Renderer<API, BV>& renderer, const std::shared_ptr<Mesh>& mesh,
+    template<typename BVHType>
+    StaticMeshRenderable(Renderer<API, BV, BVHType>& renderer, const std::shared_ptr<Mesh>& mesh,
       const std::shared_ptr<Material>& material, const Transform& transform) :
       _meshData(renderer.addMesh(mesh)),
       _modelMatrix(transform.getModelMatrix()),
@@ -136,10 +172,22 @@ namespace fly
     {
       api.renderMesh(_meshData, _modelMatrix);
     }
+    virtual void record(CommandBuffer<API, BV>& command_buffer) const override
+    {
+      command_buffer.drawMesh(_meshData, _modelMatrix, _modelMatrixInverse);
+    }
+    virtual void recordDepth(CommandBuffer<API, BV>& command_buffer) const override
+    {
+      command_buffer.drawMesh(_meshData, _modelMatrix);
+    }
     virtual unsigned numTriangles() const override
     {
       return _meshData.numTriangles();
     }
+    virtual unsigned getMeshId() const override
+    {
+      return _meshData._id;
+    }
     void setTransform(const Transform& transform, const std::shared_ptr<Mesh>& mesh)
     {
       _modelMatrix = transform.getModelMatrix();
@@ -159,7 +207,8 @@ namespace fly
   class StaticMeshRenderableWind : public StaticMeshRenderable<API, BV>
   {
   public:
-    StaticMeshRenderableWind(Renderer<API, BV>& renderer, const std::shared_ptr<Mesh>& mesh,
+    template<typename BVHType>
+    StaticMeshRenderableWind(Renderer<API, BV, BVHType>& renderer, const std::shared_ptr<Mesh>& mesh,
       const std::shared_ptr<Material>& material, const Transform& transform) :
       StaticMeshRenderable<API, BV>(renderer, mesh, material, transform)
     {
@@ -177,6 +226,17 @@ namespace fly
     {
       api.renderMesh(_meshData, _modelMatrix, _windParams, _bv);
     }
+    /**
+    * The wind parameters are set per draw, so the renderable itself is recorded.
+    */
+    virtual void record(CommandBuffer<API, BV>& command_buffer) const override
+    {
+      command_buffer.drawRenderable(this);
+    }
+    virtual void recordDepth(CommandBuffer<API, BV>& command_buffer) const override
+    {
+      command_buffer.drawRenderable(this);
+    }
     void setWindParams(const WindParamsLocal& params)
     {
       _windParams = params;
@@ -188,18 +248,12 @@ namespace fly
   protected:
     WindParamsLocal _windParams;
   };
-  struct InstanceData
-  {
-    Mat4f _modelMatrix;
-    Mat4f _modelMatrixInverse;
-    unsigned _index; // Currently an index into a color array
-    unsigned _padding[3];
-  };
   template<typename API, typename BV>
   class StaticInstancedMeshRenderable : public IMeshRenderable<API, BV>, public GPURenderable<API>
   {
   public:
-    StaticInstancedMeshRenderable(Renderer<API, BV>& renderer, const std::vector<std::shared_ptr<Mesh>>& lods,
+    template<typename BVHType>
+    StaticInstancedMeshRenderable(Renderer<API, BV, BVHType>& renderer, const std::vector<std::shared_ptr<Mesh>>& lods,
       const std::shared_ptr<Material>& material, const std::vector<InstanceData>& instance_data) :
       _visibleInstances(renderer.getApi()->createStorageBuffer<unsigned>(nullptr, instance_data.size() * lods.size())),
       _instanceData(renderer.getApi()->createStorageBuffer<InstanceData>(instance_data.data(), instance_data.size())),
@@ -262,6 +316,13 @@ namespace fly
         }
       }
     }
+    virtual void addIfLargeEnoughIntersecting(const Camera::CullingParams& cp, RenderList<API, BV>& renderlist) override
+    {
+      if (_bv.isLargeEnough(cp._camPos, cp._thresh, _largestBVSize)) {
+        renderlist.addVisibleMesh(this);
+        renderlist.addToGPUCullList(this);
+      }
+    }
     virtual unsigned numTriangles() const override
     {
       // TODO calculate correct triangle count, without stalling the pipeline
@@ -289,7 +350,8 @@ namespace fly
   class StaticMeshRenderableLod : public IMeshRenderable<API, BV>, public LodRenderable
   {
   public:
-    StaticMeshRenderableLod(Renderer<API, BV>& renderer, const std::vector<std::shared_ptr<Mesh>>& meshes,
+    template<typename BVHType>
+    StaticMeshRenderableLod(Renderer<API, BV, BVHType>& renderer, const std::vector<std::shared_ptr<Mesh>>& meshes,
       const std::shared_ptr<Material>& material, const Transform& transform) :
       _modelMatrix(transform.getModelMatrix()),
       _modelMatrixInverse(inverse(glm::mat3(transform.getModelMatrix())))
@@ -314,10 +376,22 @@ namespace fly
     {
       api.renderMesh(_meshData[_lod], _modelMatrix);
     }
+    virtual void record(CommandBuffer<API, BV>& command_buffer) const override
+    {
+      command_buffer.drawMesh(_meshData[_lod], _modelMatrix, _modelMatrixInverse);
+    }
+    virtual void recordDepth(CommandBuffer<API, BV>& command_buffer) const override
+    {
+      command_buffer.drawMesh(_meshData[_lod], _modelMatrix);
+    }
     virtual unsigned numTriangles() const override
     {
       return _meshData[_lod].numTriangles();
     }
+    virtual unsigned getMeshId() const override
+    {
+      return _meshData[_lod]._id;
+    }
     virtual void addIfLargeEnough(const Camera::CullingParams& cp, RenderList<API, BV>& renderlist) override
     {
       if (largeEnough(cp)) {
@@ -352,25 +426,28 @@ namespace fly
     using StaticMeshRenderableWind = StaticMeshRenderableWind<API, BV>;
     using StaticMeshRenderableLod = StaticMeshRenderableLod<API, BV>;
     using StaticInstancedMeshRenderable = StaticInstancedMeshRenderable<API, BV>;
-    using Renderer = Renderer<API, BV>;
   public:
     MeshRenderablePool() = default;
-    inline auto* createStaticMeshRenderable(Renderer& renderer, const std::shared_ptr<Mesh>& mesh,
+    template<typename BVHType>
+    inline auto* createStaticMeshRenderable(Renderer<API, BV, BVHType>& renderer, const std::shared_ptr<Mesh>& mesh,
       const std::shared_ptr<Material>& material, const Transform& transform)
     {
       return new(_poolSmr.malloc()) StaticMeshRenderable(renderer, mesh, material, transform);
     }
-    inline auto* createStaticMeshRenderableWind(Renderer& renderer, const std::shared_ptr<Mesh>& mesh,
+    template<typename BVHType>
+    inline auto* createStaticMeshRenderableWind(Renderer<API, BV, BVHType>& renderer, const std::shared_ptr<Mesh>& mesh,
       const std::shared_ptr<Material>& material, const Transform& transform)
     {
       return new(_poolSmrWind.malloc()) StaticMeshRenderableWind(renderer, mesh, material, transform);
     }
-    inline auto* createStaticMeshRenderableLod(Renderer& renderer, const std::vector<std::shared_ptr<Mesh>>& meshes,
+    template<typename BVHType>
+    inline auto* createStaticMeshRenderableLod(Renderer<API, BV, BVHType>& renderer, const std::vector<std::shared_ptr<Mesh>>& meshes,
       const std::shared_ptr<Material>& material, const Transform& transform)
     {
       return new(_poolSmrLod.malloc()) StaticMeshRenderableLod(renderer, meshes, material, transform);
     }
-    inline auto* createStaticInstancedMeshRenderable(Renderer& renderer, const std::vector<std::shared_ptr<Mesh>>& lods,
+    template<typename BVHType>
+    inline auto* createStaticInstancedMeshRenderable(Renderer<API, BV, BVHType>& renderer, const std::vector<std::shared_ptr<Mesh>>& lods,
       const std::shared_ptr<Material>& material, const std::vector<InstanceData>& instance_data)
     {
       return new(_poolSmrInstanced.malloc()) StaticInstancedMeshRenderable(renderer, lods, material, instance_data);
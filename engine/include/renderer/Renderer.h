@@ -6,6 +6,8 @@
 #include <math/FlyMath.h>
 #include <glm/gtx/quaternion.hpp>
 #include <map>
+#include <algorithm>
+#include <cstring>
 #include <Model.h>
 #include <memory>
 #include <Camera.h>
@@ -21,26 +23,35 @@
 #include <Flags.h>
 #include <MaterialDesc.h>
 #include <SoftwareCache.h>
+#include <LRUCache.h>
 #include <renderer/MeshRenderables.h>
+#include <renderer/CommandBuffer.h>
 #include <set>
 #include <GameTimer.h>
 #include <GlobalShaderParams.h>
-#include <future>
 #include <KdTree.h>
 #include <RenderList.h>
 #include <PtrCache.h>
+#include <SoftwareOcclusionCuller.h>
+#include <TemporalCullCache.h>
+#include <JobSystem.h>
+#include <Sort.h>
+#include <FrameArena.h>
+#include <Profiler.h>
 
 #define RENDERER_STATS 1
 
 namespace fly
 {
-  template<typename API, typename BV>
+  template<typename API, typename BV, typename BVHType>
   class Renderer : public System, public GraphicsSettings::Listener
   {
   public:
     using MeshRenderable = IMeshRenderable<API, BV>;
     using RenderList = RenderList<API, BV>;
     using MeshRenderablePtr = MeshRenderable * ;
+    using CommandBuffer = CommandBuffer<API, BV>;
+    using TextureRetention = LRUCache<std::string, std::shared_ptr<typename API::Texture>, const std::shared_ptr<typename API::Texture>&>;
     using MaterialDescCache = PtrCache<std::shared_ptr<Material>, MaterialDesc<API>, const std::shared_ptr<Material>&, const GraphicsSettings&>;
     using ShaderSource = typename API::ShaderSource;
 #if RENDERER_STATS
@@ -48,6 +59,7 @@ namespace fly
     {
       unsigned _bvhTraversalMicroSeconds;
       unsigned _fineCullingMicroSeconds;
+      unsigned _occluderRasterizationMicroSeconds;
     };
     struct RendererStats
     {
@@ -63,13 +75,17 @@ namespace fly
       unsigned _shadowMapGroupingMicroSeconds;
       unsigned _rendererTotalCPUMicroSeconds;
       unsigned _rendererIdleTimeMicroSeconds;
+      /**
+      * Only counts the blocks the frame arena took from the heap, other per frame allocations, e.g. of jobs, are not included.
+      */
+      unsigned _frameArenaHeapAllocations;
     };
 
     const RendererStats& getStats() const { return _stats; }
 #endif
     Renderer(GraphicsSettings * gs) : _api(Vec4f(0.149f, 0.509f, 0.929f, 1.f)), _gs(gs),
       _materialDescCache([this](const std::shared_ptr<Material>& material, const GraphicsSettings& gs) {
-      return new MaterialDesc<API>(material, _api, gs, &_textureCache, &_shaderDescCache, &_shaderCache);
+      return new MaterialDesc<API>(material, _api, gs, &_textureCache, &_shaderDescCache, &_shaderCache, &_shaderRebuildQueue);
     }),
       _shaderDescCache([](const std::shared_ptr<typename API::Shader>& shader, unsigned flags, API& api) {
       return new ShaderDesc<API>(shader, flags, api);
@@ -77,15 +93,27 @@ namespace fly
       _textureCache([](const std::string& path) {
       return API::createTexture(path);
     }),
-      _shaderCache([](ShaderSource& vertex_source, ShaderSource& fragment_source, ShaderSource& geometry_source) {
-      return API::createShader(vertex_source, fragment_source, geometry_source);
+      _shaderCache([this](ShaderSource& vertex_source, ShaderSource& fragment_source, ShaderSource& geometry_source) {
+      return _api.createShader(vertex_source, fragment_source, geometry_source);
+    }),
+      _textureRetention([](const std::shared_ptr<typename API::Texture>& texture) {
+      return texture;
+    }, size_t(256u) << 20u, [](const std::shared_ptr<typename API::Texture>& texture) {
+      // Textures from files always get a full mip chain, which adds a third to the base level.
+      return texture ? texture->sizeInBytes() * 4u / 3u : size_t(0);
     })
     {
       _renderTargets.reserve(_api._maxRendertargets);
+      // Graphics API calls have to be made on the thread that owns the context.
+      setMainThreadOnly(true);
+      addWrite(this);
+      addRead(gs);
+      addRead(sceneData());
     }
     virtual ~Renderer() 
     {
       std::cout << "~Renderer()" << std::endl;
+      _textureRetention.clear();
       if (_shaderCache.size() || _shaderDescCache.size() || _materialDescCache.size() || _textureCache.size()) {
         std::cout << "Error: Potential space leak detected!" << std::endl;
         std::cout << "Num shader descriptions:" << _shaderDescCache.size() << std::endl;
@@ -130,12 +158,14 @@ namespace fly
     }
     virtual void shadowMapSizeChanged(GraphicsSettings const * gs) override
     {
+      discardPreparedFrames();
       if (_shadowMap) {
         _api.resizeShadowmap(_shadowMap.get(), *_gs);
       }
     }
     virtual void compositingChanged(GraphicsSettings const * gs) override
     {
+      discardPreparedFrames();
       _offScreenRendering = gs->depthPrepassEnabled() || gs->postProcessingEnabled();
       if (_offScreenRendering) {
         _lightingBuffer = _api.createRenderToTexture(_viewPortSize, API::TexFilter::NEAREST);
@@ -173,6 +203,10 @@ namespace fly
       graphicsSettingsChanged();
       compositingChanged(gs);
     }
+    virtual void multiDrawIndirectChanged(GraphicsSettings const * gs) override
+    {
+      meshShadersChanged();
+    }
     void addStaticMeshRenderable(MeshRenderablePtr smr) 
     {
       _meshRenderables.push_back(smr);
@@ -185,6 +219,70 @@ namespace fly
         _sceneBounds = _sceneBounds.getUnion(smr->getBV());
       }
     }
+    /**
+    * Must be called after the bounding volume of a mesh renderable in the static BVH has changed, e.g. after StaticMeshRenderable::setTransform().
+    * The BVH is refitted, which costs O(depth), and rebuilt if its quality degraded too much.
+    */
+    void updateStaticMeshRenderable(MeshRenderablePtr smr)
+    {
+      _sceneBounds = _sceneBounds.getUnion(smr->getBV());
+      _bvhStatic->refit(smr);
+      discardPreparedFrames();
+      _temporalCullCache.invalidate();
+      rebuildBVHIfNeeded();
+    }
+    /**
+    * Adds a mesh renderable to the static BVH after it was built, without rebuilding the BVH.
+    */
+    void insertStaticMeshRenderable(MeshRenderablePtr smr)
+    {
+      addStaticMeshRenderable(smr);
+      _bvhStatic->insert(smr);
+      discardPreparedFrames();
+      reserveCullBuffers();
+      rebuildBVHIfNeeded();
+    }
+    void removeStaticMeshRenderable(MeshRenderablePtr smr)
+    {
+      auto it = std::find(_meshRenderables.begin(), _meshRenderables.end(), smr);
+      if (it == _meshRenderables.end()) {
+        throw std::exception("Mesh renderable is not part of the renderer.");
+      }
+      *it = _meshRenderables.back();
+      _meshRenderables.pop_back();
+      _bvhStatic->remove(smr);
+      discardPreparedFrames();
+      _temporalCullCache.invalidate();
+      rebuildBVHIfNeeded();
+    }
+    /**
+    * Designates a mesh as occluder for software occlusion culling of the camera view, e.g. a wall, or a simplified version of a large mesh.
+    * Occluders must not be larger than the visible geometry they represent, otherwise visible meshes are culled.
+    */
+    void addOccluder(const std::shared_ptr<Mesh>& mesh, const Transform& transform)
+    {
+      _occlusionCuller.addOccluder(*mesh, transform.getModelMatrix());
+    }
+    /**
+    * Automatic occluder selection: meshes whose world space bounding box diagonal is at least min_size are added as occluders.
+    * Meshes with more than max_triangles triangles are skipped, because the rasterization cost grows with the number of triangles.
+    */
+    void addLargeMeshesAsOccluders(const std::vector<std::shared_ptr<Mesh>>& meshes, const Transform& transform, float min_size, unsigned max_triangles)
+    {
+      for (const auto& m : meshes) {
+        if (AABB(m->getAABB(), transform.getModelMatrix()).size() >= min_size && m->getIndices().size() / 3u <= max_triangles) {
+          addOccluder(m, transform);
+        }
+      }
+    }
+    const SoftwareOcclusionCuller& getOcclusionCuller() const
+    {
+      return _occlusionCuller;
+    }
+    const TemporalCullCache<MeshRenderable*>& getTemporalCullCache() const
+    {
+      return _temporalCullCache;
+    }
     void setSkydome(const std::shared_ptr<SkydomeRenderable<API, BV>>& sdr)
     {
       _skydomeRenderable = sdr;
@@ -196,27 +294,46 @@ namespace fly
     void setCamera(const std::shared_ptr<Camera>& camera)
     {
       _camera = camera;
+      addRead(camera.get());
     }
     void setDirectionalLight(const std::shared_ptr<DirectionalLight>& dl)
     {
       _directionalLight = dl;
+      addRead(dl.get());
     }
     virtual void update() override
     {
+      PROFILE_ZONE("Renderer::update");
 #if RENDERER_STATS
       _stats = {};
       Timing timing_total;
 #endif
       assert(_camera && _directionalLight);
-      _multiThreadedCulling = _gs->getMultithreadedCulling() && _shadowMapping;
-      _renderListScene = _multiThreadedCulling ? &_renderListAsync : &_renderList;
+      _pipelinedRendering = _gs->getPipelinedRendering();
+      _multiThreadedCulling = _gs->getMultithreadedCulling() && _shadowMapping && !_pipelinedRendering;
+      _occlusionCulling = _gs->getOcclusionCulling() && _occlusionCuller.numOccluderTriangles();
+      _temporalCulling = _gs->getTemporalCulling();
+      _multithreadedBVHTraversal = _gs->getMultithreadedBVHTraversal() && !_temporalCulling;
+      if (_temporalCullCache.getTolerance() != _gs->getTemporalCullingTolerance()) {
+        _temporalCullCache.setTolerance(_gs->getTemporalCullingTolerance());
+      }
+      applyShaderRebuilds();
+      _frameArena.reset();
       _api.beginFrame();
-      _gsp._camPosworld = _camera->getPosition();
-      _gsp._viewMatrix = _camera->updateViewMatrix();
-      _gsp._projectionMatrix = MathHelpers::getProjectionMatrixPerspective(_camera->getParams()._fovDegrees, _viewPortSize[0] / _viewPortSize[1], _camera->getParams()._near, _camera->getParams()._far, _api.getZNearMapping());
-      (*_cullCamera)->updateViewMatrix();
-      _gsp._viewMatrixInverse = _camera->getViewMatrixInverse();
-      _vpScene = _gsp._projectionMatrix * _gsp._viewMatrix;
+      if (_pipelinedRendering) {
+        beginPipelinedFrame();
+      }
+      else {
+        discardPreparedFrames();
+        _submittedFrame = nullptr;
+        _renderListScene = _multiThreadedCulling ? &_renderListAsync : &_renderList;
+        _gsp._camPosworld = _camera->getPosition();
+        _gsp._viewMatrix = _camera->updateViewMatrix();
+        _gsp._projectionMatrix = projectionMatrix();
+        (*_cullCamera)->updateViewMatrix();
+        _gsp._viewMatrixInverse = _camera->getViewMatrixInverse();
+        _vpScene = _gsp._projectionMatrix * _gsp._viewMatrix;
+      }
       _api.setDepthTestEnabled<true>();
       _api.setFaceCullingEnabled<true>();
       _api.setCullMode<API::CullMode::BACK>();
@@ -228,33 +345,43 @@ namespace fly
       _gsp._exposure = _gs->getExposure();
       _gsp._gamma = _gs->getGamma();
       _meshGeometryStorage.bind();
-      std::future<void> async;
-      auto cull_vp = _gsp._projectionMatrix * (*_cullCamera)->getViewMatrix();
-      if (_multiThreadedCulling) {
-        async = std::async(std::launch::async, [this, cull_vp]() {
-          _stats._cullStats = cullMeshes(cull_vp, **_cullCamera, *_renderListScene, _cullResultAsync);
-        });
-      }
-      if (_shadowMapping) {
-        renderShadowMap();
+      if (_pipelinedRendering) {
+        if (_shadowMapping) {
+          renderShadowMap(*_submittedFrame);
+        }
+        cullGPU(*_renderListScene, _submittedFrame->_cullCamera, _submittedFrame->_cullVP);
       }
-      if (_multiThreadedCulling) {
-        {
+      else {
+        JobSystem::JobHandle cull_job;
+        auto cull_vp = _gsp._projectionMatrix * (*_cullCamera)->getViewMatrix();
+        if (_multiThreadedCulling) {
+          cull_job = JobSystem::getInstance().schedule([this, cull_vp]() {
+            _stats._cullStats = cullMeshes(cull_vp, **_cullCamera, *_renderListScene, _cullResultAsync);
+          });
+        }
+        if (_shadowMapping) {
+          renderShadowMap(cull_vp);
+        }
+        if (_multiThreadedCulling) {
+          {
 #if RENDERER_STATS
-          Timing timing;
+            Timing timing;
 #endif
-          async.get();
+            JobSystem::getInstance().wait(cull_job);
 #if RENDERER_STATS
-          _stats._rendererIdleTimeMicroSeconds = timing.duration<std::chrono::microseconds>();
+            _stats._rendererIdleTimeMicroSeconds = timing.duration<std::chrono::microseconds>();
 #endif
+          }
+          cullGPU(*_renderListScene, **_cullCamera, cull_vp);
+          selectLod(*_renderListScene, **_cullCamera);
+        }
+        else {
+          if (!_shadowMapping || !cullSceneWithShadowCascades()) {
+            _stats._cullStats = cullMeshes(cull_vp, **_cullCamera, *_renderListScene, _cullResult);
+          }
+          cullGPU(*_renderListScene, **_cullCamera, cull_vp);
+          selectLod(*_renderListScene, **_cullCamera);
         }
-        cullGPU(*_renderListScene, **_cullCamera, cull_vp);
-        selectLod(*_renderListScene, **_cullCamera);
-      }
-      else {
-        _stats._cullStats = cullMeshes(cull_vp, **_cullCamera, *_renderListScene, _cullResult);
-        cullGPU(*_renderListScene, **_cullCamera, cull_vp);
-        selectLod(*_renderListScene, **_cullCamera);
       }
       _api.setViewport(_viewPortSize);
       _gsp._VP = &_vpScene;
@@ -262,8 +389,13 @@ namespace fly
         _renderTargets.clear();
         _api.setRendertargets(_renderTargets, _depthBuffer.get());
         _api.clearRendertarget(false, true, false);
-        groupMeshes<true>(_renderListScene->getVisibleMeshes());
-        renderMeshes<true>();
+        if (_submittedFrame) {
+          executePass<true>(_submittedFrame->_depthPrepass);
+        }
+        else {
+          groupMeshes<true>(_renderListScene->getVisibleMeshes(), _gsp._camPosworld);
+          renderMeshes<true>();
+        }
         _api.setDepthWriteEnabled<false>();
         _api.setDepthFunc<API::DepthFunc::EQUAL>();
       }
@@ -342,7 +474,13 @@ namespace fly
         }
       }
       _api.endFrame();
+      if (_pipelinedRendering) {
+        endPipelinedFrame();
+      }
+#if RENDERER_STATS
+      _stats._frameArenaHeapAllocations = _frameArena.getNumHeapAllocations();
       _stats._rendererTotalCPUMicroSeconds = timing_total.duration<std::chrono::microseconds>();
+#endif
     }
     void onResize(const Vec2u& window_size)
     {
@@ -352,12 +490,11 @@ namespace fly
     }
     inline void setDefaultRendertarget(unsigned rt) { _defaultRenderTarget = rt; }
     API* getApi() { return &_api; }
-    std::vector<std::shared_ptr<Material>> getAllMaterials() { return _api.getAllMaterials(); }
     const Mat4f& getViewProjectionMatrix() const
     {
       return _vpScene;
     }
-    using BVH = KdTree<MeshRenderable*, BV>;
+    using BVH = BVHType;
     const std::unique_ptr<BVH>& getStaticBVH() const
     {
       return _bvhStatic;
@@ -371,9 +508,52 @@ namespace fly
       std::shared_ptr<MaterialDesc<API>> ret;
       if (!_materialDescCache.getOrCreate(material, ret, material, *_gs)) {
         _gs->addListener(ret);
+        for (const auto& e : material->getTexturePaths()) {
+          _textureRetention.getOrCreate(e.second, ret->getTexture(e.first));
+        }
       }
       return ret;
     }
+    /**
+    * Persists generated mesh shader sources and program binaries in directory, which must exist. An empty directory disables the cache.
+    */
+    void setShaderDiskCache(const std::string& directory)
+    {
+      _api.setShaderDiskCache(directory);
+    }
+    /**
+    * Generates the sources of all shader variants the materials need for the current settings on the job system.
+    * With a shader disk cache, the later creation of the materials takes the sources from the cache instead of generating them.
+    * Compiling and linking stays with the thread that creates the materials, as it needs the graphics context.
+    */
+    void warmUpShaders(const std::vector<std::shared_ptr<Material>>& materials)
+    {
+      PROFILE_ZONE("Renderer::warmUpShaders");
+      std::set<unsigned> unique_flags;
+      for (const auto& m : materials) {
+        unique_flags.insert(MaterialDesc<API>::meshRenderFlags(*m, *_gs));
+      }
+      std::vector<unsigned> flags(unique_flags.begin(), unique_flags.end());
+      JobSystem::getInstance().parallelFor(0u, static_cast<unsigned>(flags.size()), 1u, [this, &flags](unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end; i++) {
+          MaterialDesc<API>::createShaderSources(flags[i], *_gs, _api);
+        }
+      });
+    }
+    /**
+    * Budget in bytes of the texture retention cache, 256 MB by default. The cache keeps the most recently requested textures loaded
+    * after the last material that uses them was destroyed, so switching back to recent content does not reload them.
+    * It only bounds the memory of the textures it retains this way: textures that materials still use stay loaded regardless,
+    * and an evicted texture is released once its last material is gone. It is not a budget on the total texture memory.
+    */
+    void setTextureRetentionBudget(size_t num_bytes)
+    {
+      _textureRetention.setBudget(num_bytes);
+    }
+    const TextureRetention& getTextureRetention() const
+    {
+      return _textureRetention;
+    }
     typename API::MeshData addMesh(const std::shared_ptr<Mesh>& mesh)
     {
       return _meshGeometryStorage.addMesh(mesh);
@@ -389,23 +569,86 @@ namespace fly
     }
     void buildBVH()
     {
-      _cullResult.reserve(_meshRenderables.size());
-      _cullResultAsync.reserve(_cullResult.capacity());
-      std::cout << "Mesh renderables:" << _meshRenderables.size() << std::endl;
-      if (!_cullResult.capacity()) {
-        throw std::exception("No meshes were added to the renderer.");
-      }
+      reserveCullResults();
       Timing timing;
       _bvhStatic = std::make_unique<BVH>(_meshRenderables);
       std::cout << "BVH construction took " << timing.duration<std::chrono::milliseconds>() << " milliseconds." << std::endl;
-      std::cout << "BVH takes " << static_cast<float>(_bvhStatic->getSizeInBytes()) / 1024.f / 1024.f << " MB memory" << std::endl;
-      std::cout << "Scene bounds:" << _bvhStatic->getBV() << std::endl;
-      unsigned internal_nodes, leaf_nodes;
-      _bvhStatic->countNodes(internal_nodes, leaf_nodes);
-      std::cout << "BVH internal nodes:" << internal_nodes << std::endl;
-      std::cout << "BVH leaf nodes:" << leaf_nodes << std::endl;
+      printBVHInfo();
+    }
+    /**
+    * Same as buildBVH(), but loads the BVH from cache_file if it was saved for the same mesh renderables before,
+    * otherwise the BVH is built and saved to cache_file. Requires a BVH type that supports serialization, e.g. KdTreeLinear.
+    * A template, so renderers with other BVH types can still be instantiated explicitly.
+    */
+    template<typename SerializableBVH = BVH>
+    void buildBVH(const std::string& cache_file)
+    {
+      Timing timing;
+      auto bvh = SerializableBVH::load(cache_file, _meshRenderables);
+      if (!bvh) {
+        auto mesh_renderables = _meshRenderables;
+        buildBVH();
+        _bvhStatic->save(cache_file, mesh_renderables);
+        std::cout << "Saved BVH to " << cache_file << std::endl;
+        return;
+      }
+      reserveCullResults();
+      _bvhStatic = std::move(bvh);
+      std::cout << "BVH loading took " << timing.duration<std::chrono::milliseconds>() << " milliseconds." << std::endl;
+      printBVHInfo();
+    }
+    void rebuildBVHIfNeeded()
+    {
+      if (_bvhStatic->needsRebuild()) {
+        reserveCullResults();
+        _bvhStatic = std::make_unique<BVH>(_meshRenderables);
+      }
     }
   private:
+    struct MeshRenderStats
+    {
+      unsigned _renderedTriangles;
+      unsigned _renderedMeshes;
+    };
+    struct DisplayListEntry
+    {
+      uint64_t _key;
+      MeshRenderable const * _meshRenderable;
+    };
+    /**
+    * Command buffers of one pass. Recording and replay are separate, so a pass can be recorded on a worker and replayed by the render thread later.
+    */
+    struct RecordedPass
+    {
+      std::vector<CommandBuffer> _commandBuffers;
+      std::vector<MeshRenderStats> _commandBufferStats;
+      unsigned _numCommandBuffers = 0;
+    };
+    /**
+    * Everything the render thread needs to submit a pipelined frame: the camera snapshot, the render lists and the recorded passes.
+    */
+    struct FrameState
+    {
+      bool _prepared = false;
+      Camera _cullCamera = Camera(Vec3f(0.f), Vec3f(0.f));
+      Vec3f _camPos;
+      Mat4f _viewMatrix;
+      Mat4f _projectionMatrix;
+      Mat3f _viewMatrixInverse;
+      Mat4f _vpScene;
+      Mat4f _cullVP;
+      Vec4f _viewMatrixThirdRow;
+      StackPOD<Mat4f> _worldToLight;
+      StackPOD<Mat4f> _vpLightVolume;
+      RenderList _renderList;
+      std::vector<RenderList> _renderListsShadow;
+      std::vector<RecordedPass> _shadowPasses;
+      RecordedPass _depthPrepass;
+      RecordedPass _scenePass;
+#if RENDERER_STATS
+      RendererStats _stats;
+#endif
+    };
     API _api;
     GlobalShaderParams _gsp;
     Vec2f _viewPortSize = Vec2f(1.f);
@@ -428,6 +671,9 @@ namespace fly
     bool _offScreenRendering;
     bool _shadowMapping;
     bool _multiThreadedCulling;
+    bool _occlusionCulling;
+    bool _temporalCulling;
+    bool _multithreadedBVHTraversal;
     BV _sceneBounds;
 #if RENDERER_STATS
     RendererStats _stats;
@@ -437,24 +683,110 @@ namespace fly
     std::shared_ptr<SkydomeRenderable<API, BV>> _skydomeRenderable;
     CullResult<MeshRenderable*> _cullResult;
     CullResult<MeshRenderable*> _cullResultAsync;
+    MultiViewCullResult<MeshRenderable*> _multiViewCullResult;
+    SoftwareOcclusionCuller _occlusionCuller;
+    TemporalCullCache<MeshRenderable*> _temporalCullCache;
+    ParallelCullResult<MeshRenderable*> _parallelCullResult;
+    std::array<StackPOD<MeshRenderable*>, Camera::MultiViewCullingParams::maxViews> _probablyVisibleMeshes;
     RenderList _renderList;
     RenderList _renderListAsync;
+    std::vector<RenderList> _renderListsShadow;
+    StackPOD<Mat4f> _cullViewProjectionMatrices;
+    StackPOD<RenderList*> _cullRenderLists;
+    std::vector<RenderList> _detailCullingRenderLists;
+    std::vector<JobSystem::JobHandle> _detailCullingJobs;
     RenderList* _renderListScene;
-    std::map<ShaderDesc<API> const *, std::map<MaterialDesc<API> const *, StackPOD<MeshRenderable const*>>> _displayList;
+    /**
+    * Visible meshes of the current pass, sorted by sortKey().
+    */
+    StackPOD<DisplayListEntry> _displayList;
+    /**
+    * Memory for transient containers, reset at the beginning of each frame.
+    */
+    FrameArena _frameArena;
+    /**
+    * Pass that is recorded and replayed right away if pipelined rendering is disabled.
+    */
+    RecordedPass _pass;
+    /**
+    * Owned by the render thread, one per command buffer of the pass that is replayed.
+    */
+    std::vector<typename API::MultiDrawBuffers> _multiDrawBuffers;
+    std::vector<JobSystem::JobHandle> _commandRecordingJobs;
+    /**
+    * Pipelined rendering: _frames[_frameIndex] is submitted while the other frame is prepared by _prepareFrameJob.
+    */
+    std::array<FrameState, 2> _frames;
+    unsigned _frameIndex = 0;
+    FrameState* _submittedFrame = nullptr;
+    JobSystem::JobHandle _prepareFrameJob;
+    bool _pipelinedRendering = false;
+    /**
+    * Jobs record at least this many meshes, below that recording is not worth the scheduling overhead.
+    */
+    unsigned const _minMeshesPerRecordingJob = 512;
+    unsigned const _minMeshesPerSortKeyJob = 4096;
     std::unique_ptr<BVH> _bvhStatic;
     typename MaterialDesc<API>::TextureCache _textureCache;
     typename MaterialDesc<API>::ShaderCache _shaderCache;
     typename MaterialDesc<API>::ShaderDescCache _shaderDescCache;
     MaterialDescCache _materialDescCache;
+    /**
+    * Retention cache, holds extra references to the most recently requested textures so they outlive their materials for a while.
+    * The texture cache itself only keeps textures that are referenced. See setTextureRetentionBudget().
+    */
+    TextureRetention _textureRetention;
+    /**
+    * Material descriptions whose shaders are rebuilt in the background after a settings change.
+    */
+    typename MaterialDesc<API>::RebuildQueue _shaderRebuildQueue;
+    /**
+    * Time per frame that is spent compiling rebuilt shaders, at least one material is swapped per frame.
+    */
+    unsigned const _shaderRebuildBudgetMicroSeconds = 2000;
+    /**
+    * Culling fills these buffers without range checks, so they must be able to hold every mesh renderable.
+    */
+    void reserveCullBuffers()
+    {
+      _cullResult.reserve(_meshRenderables.size());
+      _cullResultAsync.reserve(_cullResult.capacity());
+      _multiViewCullResult.reserve(_meshRenderables.size());
+      _temporalCullCache.reserve(_meshRenderables.size());
+      _temporalCullCache.invalidate();
+      for (auto& m : _probablyVisibleMeshes) {
+        m.reserve(_meshRenderables.size());
+      }
+    }
+    void reserveCullResults()
+    {
+      reserveCullBuffers();
+      std::cout << "Mesh renderables:" << _meshRenderables.size() << std::endl;
+      if (!_cullResult.capacity()) {
+        throw std::exception("No meshes were added to the renderer.");
+      }
+    }
+    void printBVHInfo() const
+    {
+      std::cout << "BVH takes " << static_cast<float>(_bvhStatic->getSizeInBytes()) / 1024.f / 1024.f << " MB memory" << std::endl;
+      std::cout << "Scene bounds:" << _bvhStatic->getBV() << std::endl;
+      unsigned internal_nodes, leaf_nodes;
+      _bvhStatic->countNodes(internal_nodes, leaf_nodes);
+      std::cout << "BVH internal nodes:" << internal_nodes << std::endl;
+      std::cout << "BVH leaf nodes:" << leaf_nodes << std::endl;
+      auto quality = _bvhStatic->getQuality();
+      std::cout << "BVH SAH cost:" << quality._sahCost << std::endl;
+      std::cout << "BVH node overlap:" << quality._overlap << std::endl;
+    }
     void renderBVHNodes(Camera render_cam, Camera cull_cam)
     {
       cull_cam.extractFrustumPlanes(_gsp._projectionMatrix * cull_cam.getViewMatrix(), _api.getZNearMapping());
-      StackPOD<typename BVH::Node const *> visible_nodes;
+      StackPOD<typename BVH::Node const *> visible_nodes(_frameArena);
       _bvhStatic->cullVisibleNodes(cull_cam.getCullingParams(), visible_nodes);
       if (visible_nodes.size()) {
         _api.setDepthWriteEnabled<true>();
         _api.setDepthFunc<API::DepthFunc::LEQUAL>();
-        StackPOD<BV const *> bvs;
+        StackPOD<BV const *> bvs(_frameArena);
         bvs.reserve(visible_nodes.size());
         for (const auto& n : visible_nodes) {
           bvs.push_back(&n->getBV());
@@ -467,7 +799,7 @@ namespace fly
       if (_renderListScene->getVisibleMeshes().size()) {
         _api.setDepthWriteEnabled<true>();
         _api.setDepthFunc<API::DepthFunc::LEQUAL>();
-        StackPOD<BV const *> bvs;
+        StackPOD<BV const *> bvs(_frameArena);
         bvs.reserve(_renderListScene->getVisibleMeshes().size());
         for (auto m : _renderListScene->getVisibleMeshes()) {
           bvs.push_back(&m->getBV());
@@ -480,40 +812,83 @@ namespace fly
 #if RENDERER_STATS
       Timing timing;
 #endif
-      groupMeshes(_renderListScene->getVisibleMeshes());
+      if (!_submittedFrame) {
+        groupMeshes(_renderListScene->getVisibleMeshes(), _gsp._camPosworld);
 #if RENDERER_STATS
-      _stats._sceneMeshGroupingMicroSeconds = timing.duration<std::chrono::microseconds>();
-      timing.start();
+        _stats._sceneMeshGroupingMicroSeconds = timing.duration<std::chrono::microseconds>();
+        timing.start();
 #endif
-      auto stats = renderMeshes();
+      }
+      auto stats = _submittedFrame ? executePass(_submittedFrame->_scenePass) : renderMeshes();
 #if RENDERER_STATS
       _stats._renderedMeshes = stats._renderedMeshes;
       _stats._renderedTriangles = stats._renderedTriangles;
       _stats._sceneRenderingCPUMicroSeconds = timing.duration<std::chrono::microseconds>();
 #endif
     }
-    void renderShadowMap()
+    /**
+    * The camera view is culled in the same BVH traversal as the shadow cascades, unless it is culled asynchronously,
+    * or occlusion culling, temporal culling or the multithreaded BVH traversal is enabled, which only apply to the camera view.
+    */
+    inline bool cullSceneWithShadowCascades() const
+    {
+      return !_multiThreadedCulling && !_occlusionCulling && !_temporalCulling && !_multithreadedBVHTraversal;
+    }
+    /**
+    * Computes the light matrices for cull_camera and culls all shadow cascades in a single BVH traversal. If cullSceneWithShadowCascades() is true,
+    * the camera view is culled in the same traversal into renderlist_scene, using cull_vp.
+    */
+    CullingStats cullShadowCascades(Camera& cull_camera, const Mat4f& cull_vp, StackPOD<Mat4f>& world_to_light, StackPOD<Mat4f>& vp_light_volume,
+      std::vector<RenderList>& renderlists_shadow, RenderList& renderlist_scene)
+    {
+      _directionalLight->getViewProjectionMatrices(_viewPortSize[0] / _viewPortSize[1], cull_camera.getParams()._near, cull_camera.getParams()._fovDegrees, inverse(cull_camera.getViewMatrix()),
+        static_cast<float>(_gs->getShadowMapSize()), _gs->getFrustumSplits(), _api.getZNearMapping(), world_to_light, vp_light_volume);
+      unsigned num_cascades = static_cast<unsigned>(_gs->getFrustumSplits().size());
+      renderlists_shadow.resize(num_cascades);
+      _cullViewProjectionMatrices.clear();
+      _cullRenderLists.clear();
+      for (unsigned i = 0; i < num_cascades; i++) {
+        _cullViewProjectionMatrices.push_back_secure(vp_light_volume[i]);
+        _cullRenderLists.push_back_secure(&renderlists_shadow[i]);
+      }
+      if (cullSceneWithShadowCascades()) {
+        _cullViewProjectionMatrices.push_back_secure(cull_vp);
+        _cullRenderLists.push_back_secure(&renderlist_scene);
+      }
+      return cullMeshes(_cullViewProjectionMatrices.begin(), _cullRenderLists.begin(), static_cast<unsigned>(_cullRenderLists.size()), cull_camera);
+    }
+    void beginShadowMapPasses()
     {
-      _directionalLight->getViewProjectionMatrices(_viewPortSize[0] / _viewPortSize[1], (*_cullCamera)->getParams()._near, (*_cullCamera)->getParams()._fovDegrees, inverse((*_cullCamera)->getViewMatrix()),
-        static_cast<float>(_gs->getShadowMapSize()), _gs->getFrustumSplits(), _api.getZNearMapping(), _gsp._worldToLight, _vpLightVolume);
       _api.setDepthClampEnabled<true>();
       _api.enablePolygonOffset(_gs->getShadowPolygonOffsetFactor(), _gs->getShadowPolygonOffsetUnits());
       _api.setViewport(Vec2u(_gs->getShadowMapSize()));
       _renderTargets.clear();
-      for (unsigned i = 0; i < _gs->getFrustumSplits().size(); i++) {
-        {
-          auto stats = cullMeshes(_vpLightVolume[i], **_cullCamera, _renderList, _cullResult);
+    }
+    void endShadowMapPasses()
+    {
+      _api.disablePolygonOffset();
+      _gsp._smFrustumSplits = &_gs->getFrustumSplits();
+      _gsp._shadowDarkenFactor = _gs->getShadowDarkenFactor();
+      _api.setDepthClampEnabled<false>();
+    }
+    /**
+    * Culls and renders all shadow cascades. If cullSceneWithShadowCascades() is true, the render list of the camera view is ready after this call.
+    */
+    void renderShadowMap(const Mat4f& cull_vp)
+    {
+      PROFILE_ZONE("Renderer::renderShadowMap");
+      auto cull_stats = cullShadowCascades(**_cullCamera, cull_vp, _gsp._worldToLight, _vpLightVolume, _renderListsShadow, *_renderListScene);
 #if RENDERER_STATS
-          _stats._cullStatsSM._bvhTraversalMicroSeconds += stats._bvhTraversalMicroSeconds;
-          _stats._cullStatsSM._fineCullingMicroSeconds += stats._fineCullingMicroSeconds;
+      (cullSceneWithShadowCascades() ? _stats._cullStats : _stats._cullStatsSM) = cull_stats;
 #endif
-          cullGPU(_renderList, **_cullCamera, _vpLightVolume[i]);
-          selectLod(_renderList, **_cullCamera);
-        }
+      beginShadowMapPasses();
+      for (unsigned i = 0; i < _renderListsShadow.size(); i++) {
+        cullGPU(_renderListsShadow[i], **_cullCamera, _vpLightVolume[i]);
+        selectLod(_renderListsShadow[i], **_cullCamera);
 #if RENDERER_STATS
         Timing timing;
 #endif
-        groupMeshes<true>(_renderList.getVisibleMeshes());
+        groupMeshes<true>(_renderListsShadow[i].getVisibleMeshes(), _gsp._camPosworld);
 #if RENDERER_STATS
         _stats._shadowMapGroupingMicroSeconds += timing.duration<std::chrono::microseconds>();
         timing.start();
@@ -528,18 +903,199 @@ namespace fly
         _stats._renderedTrianglesShadow += stats._renderedTriangles;
 #endif
       }
-      _api.disablePolygonOffset();
-      _gsp._smFrustumSplits = &_gs->getFrustumSplits();
-      _gsp._shadowDarkenFactor = _gs->getShadowDarkenFactor();
-      _api.setDepthClampEnabled<false>();
+      endShadowMapPasses();
       _gsp._viewMatrixThirdRow = _debugCamera ? _debugCamera->getViewMatrix().row(2) : _gsp._viewMatrix.row(2);
     }
+    /**
+    * Replays the shadow passes of a prepared frame, only the GPU culling is left for the render thread.
+    */
+    void renderShadowMap(FrameState& frame)
+    {
+      PROFILE_ZONE("Renderer::renderShadowMap");
+      _gsp._worldToLight = frame._worldToLight;
+      beginShadowMapPasses();
+      for (unsigned i = 0; i < frame._renderListsShadow.size(); i++) {
+        cullGPU(frame._renderListsShadow[i], frame._cullCamera, frame._vpLightVolume[i]);
+#if RENDERER_STATS
+        Timing timing;
+#endif
+        _api.setRendertargets(_renderTargets, _shadowMap.get(), i);
+        _api.clearRendertarget(false, true, false);
+        _gsp._VP = &_gsp._worldToLight[i];
+        auto stats = executePass<true>(frame._shadowPasses[i]);
+#if RENDERER_STATS
+        _stats._shadowMapRenderCPUMicroSeconds += timing.duration<std::chrono::microseconds>();
+        _stats._renderedMeshesShadow += stats._renderedMeshes;
+        _stats._renderedTrianglesShadow += stats._renderedTriangles;
+#endif
+      }
+      endShadowMapPasses();
+      _gsp._viewMatrixThirdRow = frame._viewMatrixThirdRow;
+    }
+    Mat4f projectionMatrix() const
+    {
+      return MathHelpers::getProjectionMatrixPerspective(_camera->getParams()._fovDegrees, _viewPortSize[0] / _viewPortSize[1], _camera->getParams()._near, _camera->getParams()._far, _api.getZNearMapping());
+    }
+    /**
+    * Copies the camera state into frame on the render thread, so its preparation on a worker does not read the cameras while they move.
+    */
+    void snapshotFrame(FrameState& frame)
+    {
+      frame._camPos = _camera->getPosition();
+      frame._viewMatrix = _camera->updateViewMatrix();
+      frame._projectionMatrix = projectionMatrix();
+      frame._viewMatrixInverse = _camera->getViewMatrixInverse();
+      frame._vpScene = frame._projectionMatrix * frame._viewMatrix;
+      (*_cullCamera)->updateViewMatrix();
+      frame._cullCamera = **_cullCamera;
+      frame._cullVP = frame._projectionMatrix * frame._cullCamera.getViewMatrix();
+      frame._viewMatrixThirdRow = _debugCamera ? _debugCamera->getViewMatrix().row(2) : frame._viewMatrix.row(2);
+    }
+    /**
+    * CPU side of a pipelined frame: culls the camera view and the shadow cascades, selects the lods and records all passes.
+    * Runs on a worker while the render thread submits the previous frame, so it must neither call the API nor touch _gsp.
+    * Recording snapshots the model matrices and lods, the mesh renderables may change once the frame is prepared.
+    */
+    void prepareFrame(FrameState& frame)
+    {
+      PROFILE_ZONE("Renderer::prepareFrame");
+#if RENDERER_STATS
+      frame._stats = {};
+#endif
+      auto& camera = frame._cullCamera;
+      if (_shadowMapping) {
+        auto cull_stats = cullShadowCascades(camera, frame._cullVP, frame._worldToLight, frame._vpLightVolume, frame._renderListsShadow, frame._renderList);
+#if RENDERER_STATS
+        (cullSceneWithShadowCascades() ? frame._stats._cullStats : frame._stats._cullStatsSM) = cull_stats;
+#endif
+        frame._shadowPasses.resize(frame._renderListsShadow.size());
+        for (unsigned i = 0; i < frame._renderListsShadow.size(); i++) {
+          selectLod(frame._renderListsShadow[i], camera);
+#if RENDERER_STATS
+          Timing timing;
+#endif
+          recordPass<true>(frame._renderListsShadow[i].getVisibleMeshes(), frame._camPos, frame._shadowPasses[i]);
+#if RENDERER_STATS
+          frame._stats._shadowMapGroupingMicroSeconds += timing.duration<std::chrono::microseconds>();
+#endif
+        }
+      }
+      else {
+        frame._renderListsShadow.clear();
+      }
+      if (!_shadowMapping || !cullSceneWithShadowCascades()) {
+        auto cull_stats = cullMeshes(frame._cullVP, camera, frame._renderList, _cullResult);
+#if RENDERER_STATS
+        frame._stats._cullStats = cull_stats;
+#endif
+      }
+      selectLod(frame._renderList, camera);
+#if RENDERER_STATS
+      Timing timing;
+#endif
+      if (_gs->depthPrepassEnabled()) {
+        recordPass<true>(frame._renderList.getVisibleMeshes(), frame._camPos, frame._depthPrepass);
+      }
+      recordPass(frame._renderList.getVisibleMeshes(), frame._camPos, frame._scenePass);
+#if RENDERER_STATS
+      frame._stats._sceneMeshGroupingMicroSeconds = timing.duration<std::chrono::microseconds>();
+#endif
+      frame._prepared = true;
+    }
+    /**
+    * Starts the preparation of the next frame on a worker and sets up the frame that was prepared during the previous update for submission.
+    * The first frame, and frames whose preparation was discarded, are prepared right away.
+    */
+    void beginPipelinedFrame()
+    {
+      auto& frame = _frames[_frameIndex];
+      if (!frame._prepared) {
+        snapshotFrame(frame);
+        prepareFrame(frame);
+      }
+      auto& next_frame = _frames[_frameIndex ^ 1u];
+      snapshotFrame(next_frame);
+      _prepareFrameJob = JobSystem::getInstance().schedule([this, &next_frame]() {
+        prepareFrame(next_frame);
+      });
+      _submittedFrame = &frame;
+      _renderListScene = &frame._renderList;
+      _gsp._camPosworld = frame._camPos;
+      _gsp._viewMatrix = frame._viewMatrix;
+      _gsp._projectionMatrix = frame._projectionMatrix;
+      _gsp._viewMatrixInverse = frame._viewMatrixInverse;
+      _vpScene = frame._vpScene;
+#if RENDERER_STATS
+      _stats = frame._stats;
+#endif
+    }
+    /**
+    * Waits for the preparation of the next frame, so scene and settings changes between two updates never race with a worker.
+    */
+    void endPipelinedFrame()
+    {
+      {
+#if RENDERER_STATS
+        Timing timing;
+#endif
+        JobSystem::getInstance().wait(_prepareFrameJob);
+#if RENDERER_STATS
+        _stats._rendererIdleTimeMicroSeconds = timing.duration<std::chrono::microseconds>();
+#endif
+      }
+      _frames[_frameIndex]._prepared = false;
+      _frameIndex ^= 1u;
+    }
+    /**
+    * Prepared frames refer to shader descriptions, materials and mesh renderables, so they are dropped whenever these may have changed.
+    */
+    void discardPreparedFrames()
+    {
+      for (auto& f : _frames) {
+        f._prepared = false;
+      }
+    }
     void graphicsSettingsChanged()
     {
-      _shaderCache.clear();
-      _shaderDescCache.clear();
+      meshShadersChanged();
       _api.createCompositeShader(*_gs);
     }
+    void meshShadersChanged()
+    {
+      discardPreparedFrames();
+      // Rebuilt materials look up their shaders by source, so the caches are kept and unchanged shaders are reused.
+      if (!_gs->getAsyncShaderRebuild()) {
+        _shaderCache.clear();
+        _shaderDescCache.clear();
+      }
+    }
+    /**
+    * Swaps in the shaders of materials whose background rebuild has finished. Called at the frame boundary, before a new frame is prepared.
+    */
+    void applyShaderRebuilds()
+    {
+      if (_shaderRebuildQueue.empty()) {
+        return;
+      }
+      PROFILE_ZONE("Renderer::applyShaderRebuilds");
+      Timing timing;
+      bool changed = false;
+      unsigned num_applied = 0;
+      auto it = _shaderRebuildQueue.begin();
+      while (it != _shaderRebuildQueue.end() && (!num_applied || timing.duration<std::chrono::microseconds>() < _shaderRebuildBudgetMicroSeconds)) {
+        if ((*it)->rebuildReady()) {
+          changed = (*it)->applyRebuild() || changed;
+          num_applied++;
+          it = _shaderRebuildQueue.erase(it);
+        }
+        else {
+          ++it;
+        }
+      }
+      if (changed) {
+        discardPreparedFrames();
+      }
+    }
     inline unsigned elementsPerThread(unsigned num_elements, unsigned num_threads) const
     {
       return static_cast<unsigned>(std::ceil(static_cast<float>(num_elements) / static_cast<float>(num_threads)));
@@ -547,16 +1103,35 @@ namespace fly
     inline CullingStats cullMeshes(const Mat4f& view_projection_matrix, Camera camera,
       RenderList& renderlist, CullResult<MeshRenderable*>& cull_result)
     {
+      PROFILE_ZONE("Renderer::cullMeshes");
       camera.extractFrustumPlanes(view_projection_matrix, _api.getZNearMapping());
       renderlist.clear();
       cull_result.clear();
       auto cp = camera.getCullingParams();
-      CullingStats stats;
+      CullingStats stats = {};
+      if (_occlusionCulling) {
+#if RENDERER_STATS
+        Timing timing;
+#endif
+        _occlusionCuller.rasterizeOccluders(view_projection_matrix, _api.getZNearMapping());
+        cp._occlusionCuller = &_occlusionCuller;
+#if RENDERER_STATS
+        stats._occluderRasterizationMicroSeconds = timing.duration<std::chrono::microseconds>();
+#endif
+      }
       {
 #if RENDERER_STATS
         Timing timing;
 #endif
-        _bvhStatic->cullVisibleObjects(cp, cull_result);
+        if (_temporalCulling) {
+          _temporalCullCache.cullVisibleObjects(*_bvhStatic, cp, cull_result);
+        }
+        else if (_multithreadedBVHTraversal) {
+          _bvhStatic->cullVisibleObjects(cp, _parallelCullResult);
+        }
+        else {
+          _bvhStatic->cullVisibleObjects(cp, cull_result);
+        }
 #if RENDERER_STATS
         stats._bvhTraversalMicroSeconds = timing.duration<std::chrono::microseconds>();
 #endif
@@ -564,44 +1139,181 @@ namespace fly
 #if RENDERER_STATS
       Timing timing;
 #endif
+      if (_multithreadedBVHTraversal) {
+        cullChunks(cp, renderlist);
+#if RENDERER_STATS
+        stats._fineCullingMicroSeconds = timing.duration<std::chrono::microseconds>();
+#endif
+        return stats;
+      }
       renderlist.reserve(cull_result.size());
-      auto num_threads = std::thread::hardware_concurrency();
+      auto& job_system = JobSystem::getInstance();
+      auto num_threads = job_system.getNumThreads();
       unsigned num_meshes = static_cast<unsigned>(cull_result._fullyVisibleObjects.size());
       auto elements_per_thread = elementsPerThread(num_meshes, num_threads);
       if (_gs->getMultithreadedDetailCulling() && elements_per_thread >= 256) {
-        std::vector<std::future<RenderList>> futures;
-        futures.reserve(num_threads);
-        unsigned start = 0;
+        // One render list per job, kept across frames so their memory is reused.
+        _detailCullingRenderLists.resize(num_threads);
+        _detailCullingJobs.clear();
         const auto& meshes_to_cull = cull_result._fullyVisibleObjects;
-        for (unsigned i = 0; i < num_threads; i++) {
-          unsigned end = std::min(start + elements_per_thread, num_meshes);
-          futures.push_back(std::async(std::launch::async, [start, end, cp, &meshes_to_cull]() {
-            RenderList renderlist;
-            renderlist.reserve(end - start);
-            for (unsigned i = start; i < end; i++) {
+        auto cull_range = [&cp, &meshes_to_cull](unsigned start, unsigned end, RenderList& renderlist) {
+          PROFILE_ZONE("Renderer::cullMeshes detail culling");
+          renderlist.clear();
+          renderlist.reserve(end - start);
+          for (unsigned i = start; i < end; i++) {
+            if (!isOccluded(cp, meshes_to_cull[i])) {
               meshes_to_cull[i]->addIfLargeEnough(cp, renderlist);
             }
-            return renderlist;
+          }
+        };
+        for (unsigned i = 1; i < num_threads; i++) {
+          unsigned start = std::min(i * elements_per_thread, num_meshes);
+          unsigned end = std::min(start + elements_per_thread, num_meshes);
+          auto& range_renderlist = _detailCullingRenderLists[i];
+          _detailCullingJobs.push_back(job_system.schedule([&cull_range, start, end, &range_renderlist]() {
+            cull_range(start, end, range_renderlist);
           }));
-          start += elements_per_thread;
         }
-        for (auto& f : futures) {
-          renderlist.append(f.get());
+        cull_range(0, std::min(elements_per_thread, num_meshes), _detailCullingRenderLists[0]);
+        for (const auto& j : _detailCullingJobs) {
+          job_system.wait(j);
+        }
+        for (const auto& l : _detailCullingRenderLists) {
+          renderlist.append(l);
         }
       }
       else {
         for (const auto& m : cull_result._fullyVisibleObjects) {
-          m->addIfLargeEnough(cp, renderlist);
+          if (!isOccluded(cp, m)) {
+            m->addIfLargeEnough(cp, renderlist);
+          }
         }
       }
-      for (const auto& m : cull_result._probablyVisibleObjects) { // No need to multithread probably visible meshes, because the amount is usually much smaller compared to fully visible meshes.
-        m->addIfLargeEnoughAndVisible(cp, renderlist);
-      }
+      cullProbablyVisibleMeshes(cp, cull_result._probablyVisibleObjects, renderlist);
 #if RENDERER_STATS
       stats._fineCullingMicroSeconds = timing.duration<std::chrono::microseconds>();
 #endif
       return stats;
     }
+    /**
+    * Fine culling after the multithreaded BVH traversal. Each chunk of _parallelCullResult is culled into its own render list,
+    * which are then appended to renderlist.
+    */
+    inline void cullChunks(const Camera::CullingParams& cp, RenderList& renderlist)
+    {
+      unsigned num_chunks = _parallelCullResult.getNumChunks();
+      if (_detailCullingRenderLists.size() < num_chunks) {
+        _detailCullingRenderLists.resize(num_chunks);
+      }
+      JobSystem::getInstance().parallelFor(0, num_chunks, 1, [this, &cp](unsigned begin, unsigned end) {
+        PROFILE_ZONE("Renderer::cullChunks");
+        for (unsigned i = begin; i < end; i++) {
+          auto& chunk = _parallelCullResult.getChunk(i);
+          auto& chunk_renderlist = _detailCullingRenderLists[i];
+          chunk_renderlist.clear();
+          chunk_renderlist.reserve(chunk.size());
+          for (const auto& m : chunk._fullyVisibleObjects) {
+            if (!isOccluded(cp, m)) {
+              m->addIfLargeEnough(cp, chunk_renderlist);
+            }
+          }
+          cullProbablyVisibleMeshes(cp, chunk._probablyVisibleObjects, chunk_renderlist);
+        }
+      });
+      renderlist.reserve(_parallelCullResult.size());
+      for (unsigned i = 0; i < num_chunks; i++) {
+        renderlist.append(_detailCullingRenderLists[i]);
+      }
+    }
+    /**
+    * Culls num_views views with a single BVH traversal and fills one render list per view. All views share the detail culling
+    * parameters of camera, only the view projection matrices differ. Views are processed in groups of up to Camera::MultiViewCullingParams::maxViews.
+    */
+    inline CullingStats cullMeshes(const Mat4f* view_projection_matrices, RenderList* const * renderlists, unsigned num_views, const Camera& camera)
+    {
+      PROFILE_ZONE("Renderer::cullMeshes multi view");
+      CullingStats stats = {};
+      for (unsigned first = 0; first < num_views; first += Camera::MultiViewCullingParams::maxViews) {
+        unsigned count = std::min(num_views - first, Camera::MultiViewCullingParams::maxViews);
+        std::array<Camera::CullingParams, Camera::MultiViewCullingParams::maxViews> cps;
+        Camera::MultiViewCullingParams mcp;
+        for (unsigned i = 0; i < count; i++) {
+          cps[i] = camera.getCullingParams(view_projection_matrices[first + i], _api.getZNearMapping());
+          mcp._frustumPlanes[i] = cps[i]._frustumPlanes;
+        }
+        mcp._camPos = cps[0]._camPos;
+        mcp._thresh = cps[0]._thresh;
+        mcp._numViews = count;
+        _multiViewCullResult.clear();
+        {
+#if RENDERER_STATS
+          Timing timing;
+#endif
+          _bvhStatic->cullVisibleObjects(mcp, _multiViewCullResult);
+#if RENDERER_STATS
+          stats._bvhTraversalMicroSeconds += timing.duration<std::chrono::microseconds>();
+#endif
+        }
+#if RENDERER_STATS
+        Timing timing;
+#endif
+        for (unsigned i = 0; i < count; i++) {
+          renderlists[first + i]->clear();
+          renderlists[first + i]->reserve(_multiViewCullResult.size());
+          _probablyVisibleMeshes[i].clear();
+        }
+        for (const auto& e : _multiViewCullResult._objects) {
+          for (unsigned i = 0; i < count; i++) {
+            if (e._fullyVisibleViews & (1u << i)) {
+              e._object->addIfLargeEnough(cps[i], *renderlists[first + i]);
+            }
+            else if (e._probablyVisibleViews & (1u << i)) {
+              _probablyVisibleMeshes[i].push_back(e._object);
+            }
+          }
+        }
+        for (unsigned i = 0; i < count; i++) {
+          cullProbablyVisibleMeshes(cps[i], _probablyVisibleMeshes[i], *renderlists[first + i]);
+        }
+#if RENDERER_STATS
+        stats._fineCullingMicroSeconds += timing.duration<std::chrono::microseconds>();
+#endif
+      }
+      return stats;
+    }
+    /**
+    * Fine culling of meshes whose BVH node intersects the view frustum. The frustum tests are performed in batches of four,
+    * no need to multithread probably visible meshes, because the amount is usually much smaller compared to fully visible meshes.
+    */
+    inline void cullProbablyVisibleMeshes(const Camera::CullingParams& cp, const StackPOD<MeshRenderable*>& meshes, RenderList& renderlist) const
+    {
+      FrustumPlanesSIMD planes(cp._frustumPlanes);
+      BV const * bvs[4];
+      IntersectionResult results[4];
+      unsigned num_meshes = static_cast<unsigned>(meshes.size());
+      for (unsigned i = 0; i < num_meshes; i += 4u) {
+        unsigned count = std::min(num_meshes - i, 4u);
+        for (unsigned j = 0; j < count; j++) {
+          bvs[j] = &meshes[i + j]->getBV();
+        }
+        IntersectionTests::frustumIntersectsBoundingVolumes(bvs, count, planes, results);
+        for (unsigned j = 0; j < count; j++) {
+          if (results[j] == IntersectionResult::OUTSIDE || isOccluded(cp, meshes[i + j])) {
+            continue;
+          }
+          if (results[j] == IntersectionResult::INSIDE) {
+            meshes[i + j]->addIfLargeEnough(cp, renderlist);
+          }
+          else {
+            meshes[i + j]->addIfLargeEnoughIntersecting(cp, renderlist);
+          }
+        }
+      }
+    }
+    static inline bool isOccluded(const Camera::CullingParams& cp, const MeshRenderable* mesh)
+    {
+      return cp._occlusionCuller && cp._occlusionCuller->isOccluded(mesh->getBV());
+    }
     inline void cullGPU(const RenderList& renderlist, Camera camera, const Mat4f& view_projection_matrix)
     {
       if (renderlist.getGPUCullList().size() || renderlist.getGPULodList().size()) {
@@ -632,38 +1344,132 @@ namespace fly
         m->selectLod(cp);
       }
     }
-    template<bool depth = false>
-    inline void groupMeshes(const StackPOD<MeshRenderable const *>& visible_meshes)
+    /**
+    * Packs, from the most significant bit on: pass (1 bit), shader id (12 bits), material id (16 bits), mesh id (19 bits)
+    * and the distance to the camera (16 bits), so sorting by key groups state changes and draws front to back within a group.
+    * Shader and material ids are recycled, so they only exceed their bits with more than 4096 shaders or 65536 materials alive
+    * at the same time. Ids that do wrap around cost redundant state changes, but the recording compares the actual shader
+    * and material, so the output stays correct.
+    */
+    template<bool depth>
+    inline uint64_t sortKey(const MeshRenderable& m, const Vec3f& cam_pos) const
     {
-      for (const auto& m : visible_meshes) {
-        _displayList[depth ? m->getShaderDescDepth()->get() : m->getShaderDesc()->get()][m->getMaterialDesc()].push_back_secure(m);
-      }
+      uint64_t shader_id = (depth ? m.getShaderDescDepth()->get() : m.getShaderDesc()->get())->getId() & 0xfff;
+      uint64_t material_id = m.getMaterialDesc()->getId() & 0xffff;
+      uint64_t mesh_id = m.getMeshId() & 0x7ffff;
+      // The bit pattern of a positive float is monotonic, its upper 16 bits are enough to sort draws front to back.
+      float dist2 = distance2(m.getBV().center(), cam_pos);
+      uint32_t dist_bits;
+      std::memcpy(&dist_bits, &dist2, sizeof dist_bits);
+      return (static_cast<uint64_t>(depth ? 0u : 1u) << 63) | (shader_id << 51) | (material_id << 35) | (mesh_id << 16) | (dist_bits >> 16);
     }
-    struct MeshRenderStats
+    template<bool depth = false>
+    inline void groupMeshes(const StackPOD<MeshRenderable const *>& visible_meshes, const Vec3f& cam_pos)
     {
-      unsigned _renderedTriangles;
-      unsigned _renderedMeshes;
-    };
+      PROFILE_ZONE("Renderer::groupMeshes");
+      unsigned num_meshes = static_cast<unsigned>(visible_meshes.size());
+      _displayList.resize(num_meshes);
+      JobSystem::getInstance().parallelFor(0, num_meshes, _minMeshesPerSortKeyJob, [this, &visible_meshes, &cam_pos](unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end; i++) {
+          _displayList[i]._key = sortKey<depth>(*visible_meshes[i], cam_pos);
+          _displayList[i]._meshRenderable = visible_meshes[i];
+        }
+      });
+      radixSort(_displayList.begin(), _displayList.end(), _frameArena, [](const DisplayListEntry& e) {
+        return e._key;
+      });
+    }
+    /**
+    * Records the display list into command buffers and replays them, the API is only called during the replay.
+    */
     template<bool depth = false>
     inline MeshRenderStats renderMeshes()
     {
+      recordCommands<depth>(_pass);
+      _displayList.clear();
+      return executePass<depth>(_pass);
+    }
+    /**
+    * Groups and records visible_meshes into pass without calling the API, the pass can be replayed later with executePass().
+    */
+    template<bool depth = false>
+    void recordPass(const StackPOD<MeshRenderable const *>& visible_meshes, const Vec3f& cam_pos, RecordedPass& pass)
+    {
+      groupMeshes<depth>(visible_meshes, cam_pos);
+      recordCommands<depth>(pass);
+      _displayList.clear();
+    }
+    template<bool depth = false>
+    MeshRenderStats executePass(const RecordedPass& pass)
+    {
+      PROFILE_ZONE("Renderer::executePass");
+      if (_multiDrawBuffers.size() < pass._numCommandBuffers) {
+        _multiDrawBuffers.resize(pass._numCommandBuffers);
+      }
       MeshRenderStats stats = {};
-      for (const auto& shader : _displayList) {
-        shader.first->setup(_gsp);
-        for (const auto& material : shader.second) {
-          material.first->setup<depth>();
-          for (const auto& mr : material.second) {
-            depth ? mr->renderDepth(_api) : mr->render(_api);
+      typename CommandBuffer::ExecutionState state;
+      for (unsigned i = 0; i < pass._numCommandBuffers; i++) {
+        pass._commandBuffers[i].template execute<depth>(_api, _gsp, state, _multiDrawBuffers[i]);
 #if RENDERER_STATS
-            stats._renderedTriangles += mr->numTriangles();
-            stats._renderedMeshes += mr->numMeshes();
+        stats._renderedTriangles += pass._commandBufferStats[i]._renderedTriangles;
+        stats._renderedMeshes += pass._commandBufferStats[i]._renderedMeshes;
 #endif
-          }
-        }
       }
-      _displayList.clear();
       return stats;
     }
+    /**
+    * Splits the display list into contiguous mesh ranges and records each range into its own command buffer,
+    * on worker threads if multithreaded command recording is enabled. Replaying the buffers in order preserves the
+    * sorting of the display list.
+    */
+    template<bool depth>
+    void recordCommands(RecordedPass& pass)
+    {
+      unsigned num_meshes = static_cast<unsigned>(_displayList.size());
+      auto& job_system = JobSystem::getInstance();
+      pass._numCommandBuffers = 1;
+      if (_gs->getMultithreadedCommandRecording()) {
+        pass._numCommandBuffers = std::max(std::min(job_system.getNumThreads(), num_meshes / _minMeshesPerRecordingJob), 1u);
+      }
+      if (pass._commandBuffers.size() < pass._numCommandBuffers) {
+        pass._commandBuffers.resize(pass._numCommandBuffers);
+        pass._commandBufferStats.resize(pass._numCommandBuffers);
+      }
+      auto meshes_per_buffer = elementsPerThread(num_meshes, pass._numCommandBuffers);
+      _commandRecordingJobs.clear();
+      for (unsigned i = 1; i < pass._numCommandBuffers; i++) {
+        unsigned start = std::min(i * meshes_per_buffer, num_meshes);
+        unsigned end = std::min(start + meshes_per_buffer, num_meshes);
+        _commandRecordingJobs.push_back(job_system.schedule([this, &pass, i, start, end]() {
+          recordCommands<depth>(start, end, pass._commandBuffers[i], pass._commandBufferStats[i]);
+        }));
+      }
+      recordCommands<depth>(0, std::min(meshes_per_buffer, num_meshes), pass._commandBuffers[0], pass._commandBufferStats[0]);
+      for (const auto& j : _commandRecordingJobs) {
+        job_system.wait(j);
+      }
+    }
+    /**
+    * Records the meshes [begin, end) of the display list. Only reads renderer state, so it is safe to call from worker threads.
+    */
+    template<bool depth>
+    void recordCommands(unsigned begin, unsigned end, CommandBuffer& command_buffer, MeshRenderStats& stats) const
+    {
+      PROFILE_ZONE("Renderer::recordCommands");
+      command_buffer.clear();
+      command_buffer.setMultiDraw(_gs->getMultiDrawIndirect());
+      stats = {};
+      for (unsigned i = begin; i < end; i++) {
+        auto mr = _displayList[i]._meshRenderable;
+        command_buffer.setShader(depth ? mr->getShaderDescDepth()->get() : mr->getShaderDesc()->get());
+        command_buffer.setMaterial(mr->getMaterialDesc());
+        depth ? mr->recordDepth(command_buffer) : mr->record(command_buffer);
+#if RENDERER_STATS
+        stats._renderedTriangles += mr->numTriangles();
+        stats._renderedMeshes += mr->numMeshes();
+#endif
+      }
+    }
   };
 }
 
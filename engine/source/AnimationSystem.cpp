@@ -8,6 +8,10 @@ namespace fly
 {
   AnimationSystem::AnimationSystem()
   {
+    // The update functions usually modify application state that is not meant to be touched by worker threads.
+    setMainThreadOnly(true);
+    addWrite(&_animations);
+    addWrite(sceneData());
   }
   AnimationSystem::~AnimationSystem()
   {
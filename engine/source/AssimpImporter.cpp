@@ -2,6 +2,7 @@
 #include <Model.h>
 #include <Vertex.h>
 #include <Mesh.h>
+#include <JobSystem.h>
 
 #define FLY_VEC2(vec) fly::Vec2f(vec.x, vec.y)
 #define FLY_VEC3(vec) fly::Vec3f(vec.x, vec.y, vec.z)
@@ -20,9 +21,11 @@ namespace fly
     for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
       materials[i] = processMaterial(scene->mMaterials[i], path);
     }
-    for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
-      meshes[i] = processMesh(scene->mMeshes[i], materials);
-    }
+    JobSystem::getInstance().parallelFor(0, scene->mNumMeshes, 1, [this, scene, &meshes, &materials](unsigned begin, unsigned end) {
+      for (unsigned i = begin; i < end; i++) {
+        meshes[i] = processMesh(scene->mMeshes[i], materials);
+      }
+    });
     return std::make_shared<Model>(meshes, materials);
   }
   std::shared_ptr<Mesh> AssimpImporter::processMesh(aiMesh * mesh, const std::vector<std::shared_ptr<Material>>& materials)
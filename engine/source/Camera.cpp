@@ -76,14 +76,18 @@ namespace fly
   }
   void Camera::extractFrustumPlanes(const Mat4f & vp, ZNearMapping z_near_mapping)
   {
-    _frustumPlanes[0] = (vp.row(3) + vp.row(0)) * -1.f; // left plane
-    _frustumPlanes[1] = (vp.row(3) - vp.row(0)) * -1.f; // right plane
-    _frustumPlanes[2] = (vp.row(3) + vp.row(1)) * -1.f; // bottom plane
-    _frustumPlanes[3] = (vp.row(3) - vp.row(1)) * -1.f; // top plane
-    _frustumPlanes[4] = (z_near_mapping == ZNearMapping::ZERO ? vp.row(2) : (vp.row(3) + vp.row(2))) * -1.f; // near plane
-    _frustumPlanes[5] = (vp.row(3) - vp.row(2)) * -1.f; // far plane
+    extractFrustumPlanes(vp, z_near_mapping, _frustumPlanes);
+  }
+  void Camera::extractFrustumPlanes(const Mat4f & vp, ZNearMapping z_near_mapping, std::array<Vec4f, 6>& frustum_planes)
+  {
+    frustum_planes[0] = (vp.row(3) + vp.row(0)) * -1.f; // left plane
+    frustum_planes[1] = (vp.row(3) - vp.row(0)) * -1.f; // right plane
+    frustum_planes[2] = (vp.row(3) + vp.row(1)) * -1.f; // bottom plane
+    frustum_planes[3] = (vp.row(3) - vp.row(1)) * -1.f; // top plane
+    frustum_planes[4] = (z_near_mapping == ZNearMapping::ZERO ? vp.row(2) : (vp.row(3) + vp.row(2))) * -1.f; // near plane
+    frustum_planes[5] = (vp.row(3) - vp.row(2)) * -1.f; // far plane
 
-    for (auto& p : _frustumPlanes) {
+    for (auto& p : frustum_planes) {
       p /= p.xyz().length();
     }
   }
@@ -111,6 +115,12 @@ namespace fly
   {
     return { _pos, _detailCullingThreshold, _frustumPlanes, (_detailCullingThreshold * _lodRangeMultiplier) - _detailCullingThreshold };
   }
+  Camera::CullingParams Camera::getCullingParams(const Mat4f & vp, ZNearMapping z_near_mapping) const
+  {
+    auto cp = getCullingParams();
+    extractFrustumPlanes(vp, z_near_mapping, cp._frustumPlanes);
+    return cp;
+  }
   const Camera::Params & Camera::getParams() const
   {
     return _params;
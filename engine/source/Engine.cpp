@@ -1,5 +1,8 @@
 #include <Engine.h>
 #include <System.h>
+#include <Timing.h>
+#include <Profiler.h>
+#include <typeinfo>
 
 namespace fly
 {
@@ -10,25 +13,160 @@ namespace fly
   {
     system->setGameTimer(&_gameTimer);
     _systems.push_back(system);
+    try {
+      buildDependencyGraph();
+    }
+    catch (...) {
+      // The graph of the other systems is still intact, as it is only replaced once the new one is complete.
+      _systems.pop_back();
+      throw;
+    }
   }
   void Engine::removeSystem(const std::shared_ptr<System>& system)
   {
     for (unsigned i = 0; i < _systems.size(); i++) {
       if (_systems[i] == system) {
         _systems.erase(_systems.begin() + i);
+        buildDependencyGraph();
         return;
       }
     }
   }
   void Engine::update()
   {
+    Profiler::getInstance().markFrame();
+    PROFILE_ZONE("Engine::update");
     _gameTimer.tick();
+    bool declarations_changed = false;
     for (const auto& s : _systems) {
-      s->update();
+      declarations_changed = s->_declarationsChanged || declarations_changed;
+    }
+    if (declarations_changed) {
+      buildDependencyGraph();
+    }
+    if (!_parallelUpdates) {
+      for (auto i : _order) {
+        updateSystem(i);
+      }
+      return;
+    }
+    auto& job_system = JobSystem::getInstance();
+    for (auto i : _order) {
+      _dependencyJobs.clear();
+      for (auto p : _predecessors[i]) {
+        _dependencyJobs.push_back(_jobs[p]);
+      }
+      // Jobs must not throw, the exception is passed on to the caller of update() instead.
+      auto func = [this, i]() {
+        {
+          std::lock_guard<std::mutex> lock(_updateExceptionMutex);
+          if (_updateException) {
+            return;
+          }
+        }
+        try {
+          updateSystem(i);
+        }
+        catch (...) {
+          std::lock_guard<std::mutex> lock(_updateExceptionMutex);
+          if (!_updateException) {
+            _updateException = std::current_exception();
+          }
+        }
+      };
+      auto num_dependencies = static_cast<unsigned>(_dependencyJobs.size());
+      _jobs[i] = _systems[i]->runsOnMainThread() ? job_system.scheduleOnMainThread(func, _dependencyJobs.data(), num_dependencies) :
+        job_system.schedule(func, _dependencyJobs.data(), num_dependencies);
+    }
+    for (const auto& j : _jobs) {
+      job_system.waitOnMainThread(j);
+    }
+    if (_updateException) {
+      auto exception = _updateException;
+      _updateException = nullptr;
+      std::rethrow_exception(exception);
     }
   }
   GameTimer* Engine::getGameTimer()
   {
     return &_gameTimer;
   }
-}
\ No newline at end of file
+  void Engine::setParallelUpdates(bool enabled)
+  {
+    _parallelUpdates = enabled;
+  }
+  bool Engine::getParallelUpdates() const
+  {
+    return _parallelUpdates;
+  }
+  const std::vector<std::shared_ptr<System>>& Engine::getSystems() const
+  {
+    return _systems;
+  }
+  const std::vector<unsigned>& Engine::getSystemMicroSeconds() const
+  {
+    return _systemMicroSeconds;
+  }
+  void Engine::buildDependencyGraph()
+  {
+    unsigned num_systems = static_cast<unsigned>(_systems.size());
+    std::vector<std::vector<unsigned>> predecessors(num_systems);
+    std::vector<std::vector<unsigned>> successors(num_systems);
+    auto add_edge = [&predecessors, &successors](unsigned from, unsigned to) {
+      predecessors[to].push_back(from);
+      successors[from].push_back(to);
+    };
+    for (unsigned i = 0; i < num_systems; i++) {
+      for (unsigned j = i + 1; j < num_systems; j++) {
+        bool i_depends_on_j = _systems[i]->dependsOn(_systems[j].get());
+        bool j_depends_on_i = _systems[j]->dependsOn(_systems[i].get());
+        if (i_depends_on_j && j_depends_on_i) {
+          throw std::exception("Two systems depend on each other.");
+        }
+        // Explicit dependencies decide the order, otherwise systems that conflict keep the order in which they were added.
+        if (i_depends_on_j) {
+          add_edge(j, i);
+        }
+        else if (j_depends_on_i || _systems[i]->conflictsWith(*_systems[j])) {
+          add_edge(i, j);
+        }
+      }
+    }
+    std::vector<unsigned> order;
+    std::vector<unsigned> num_predecessors(num_systems);
+    for (unsigned i = 0; i < num_systems; i++) {
+      num_predecessors[i] = static_cast<unsigned>(predecessors[i].size());
+    }
+    while (order.size() < num_systems) {
+      unsigned next = num_systems;
+      for (unsigned i = 0; i < num_systems && next == num_systems; i++) {
+        if (num_predecessors[i] == 0) {
+          next = i;
+        }
+      }
+      if (next == num_systems) {
+        throw std::exception("The dependencies between the systems contain a cycle.");
+      }
+      num_predecessors[next] = num_systems;
+      for (auto s : successors[next]) {
+        num_predecessors[s]--;
+      }
+      order.push_back(next);
+    }
+    _predecessors = std::move(predecessors);
+    _order = std::move(order);
+    for (const auto& s : _systems) {
+      s->_declarationsChanged = false;
+    }
+    _systemMicroSeconds.assign(num_systems, 0);
+    _jobs.resize(num_systems);
+  }
+  void Engine::updateSystem(unsigned index)
+  {
+    // The type name of the system has static storage duration, so it can serve as zone name.
+    PROFILE_ZONE(typeid(*_systems[index]).name());
+    Timing timing;
+    _systems[index]->update();
+    _systemMicroSeconds[index] = timing.duration<std::chrono::microseconds>();
+  }
+}
@@ -0,0 +1,65 @@
+#include <FrameArena.h>
+#include <JobSystem.h>
+#include <algorithm>
+
+namespace fly
+{
+  FrameArena::FrameArena(size_t initial_bytes_per_thread, unsigned num_threads) :
+    _numSubArenas(num_threads ? num_threads : JobSystem::getInstance().getNumThreads())
+  {
+    _subArenas = std::make_unique<SubArena[]>(_numSubArenas);
+    for (unsigned i = 0; i < _numSubArenas; i++) {
+      auto& sub_arena = _subArenas[i];
+      sub_arena._block = std::make_unique<char[]>(initial_bytes_per_thread);
+      sub_arena._blockSize = initial_bytes_per_thread;
+      sub_arena._ptr = sub_arena._block.get();
+      sub_arena._end = sub_arena._ptr + initial_bytes_per_thread;
+    }
+  }
+  FrameArena::~FrameArena() = default;
+  void FrameArena::reset()
+  {
+    _numHeapAllocations = 0;
+    for (unsigned i = 0; i < _numSubArenas; i++) {
+      auto& sub_arena = _subArenas[i];
+      if (sub_arena._overflowBlocks.size()) {
+        sub_arena._blockSize += sub_arena._overflowBytes;
+        sub_arena._overflowBlocks.clear();
+        sub_arena._overflowBytes = 0;
+        sub_arena._block = std::make_unique<char[]>(sub_arena._blockSize);
+        _numHeapAllocations++;
+      }
+      sub_arena._ptr = sub_arena._block.get();
+      sub_arena._end = sub_arena._ptr + sub_arena._blockSize;
+    }
+  }
+  unsigned FrameArena::getNumHeapAllocations() const
+  {
+    return _numHeapAllocations.load();
+  }
+  size_t FrameArena::getCapacity() const
+  {
+    size_t capacity = 0;
+    for (unsigned i = 0; i < _numSubArenas; i++) {
+      capacity += _subArenas[i]._blockSize + _subArenas[i]._overflowBytes;
+    }
+    return capacity;
+  }
+  unsigned FrameArena::threadIndex() const
+  {
+    return std::min(JobSystem::getInstance().getThreadIndex(), _numSubArenas - 1u);
+  }
+  void * FrameArena::allocateBlock(SubArena & sub_arena, size_t num_bytes, size_t alignment)
+  {
+    // At least double the memory of the sub-arena, so a frame that outgrows it needs few blocks.
+    size_t block_size = std::max(num_bytes + alignment, sub_arena._blockSize + sub_arena._overflowBytes);
+    sub_arena._overflowBlocks.push_back(std::make_unique<char[]>(block_size));
+    sub_arena._overflowBytes += block_size;
+    _numHeapAllocations++;
+    sub_arena._ptr = sub_arena._overflowBlocks.back().get();
+    sub_arena._end = sub_arena._ptr + block_size;
+    auto ptr = align(sub_arena._ptr, alignment);
+    sub_arena._ptr = ptr + num_bytes;
+    return ptr;
+  }
+}
\ No newline at end of file
@@ -359,6 +359,73 @@ namespace fly
   {
     return _multithreadedDetailCulling;
   }
+  void GraphicsSettings::setMultithreadedBVHTraversal(bool enabled)
+  {
+    _multithreadedBVHTraversal = enabled;
+  }
+  bool GraphicsSettings::getMultithreadedBVHTraversal() const
+  {
+    return _multithreadedBVHTraversal;
+  }
+  void GraphicsSettings::setMultithreadedCommandRecording(bool enabled)
+  {
+    _multithreadedCommandRecording = enabled;
+  }
+  bool GraphicsSettings::getMultithreadedCommandRecording() const
+  {
+    return _multithreadedCommandRecording;
+  }
+  void GraphicsSettings::setMultiDrawIndirect(bool enabled)
+  {
+    _multiDrawIndirect = enabled;
+    notifiyListeners([this](const std::shared_ptr<Listener>& l) {
+      l->multiDrawIndirectChanged(this);
+    });
+  }
+  bool GraphicsSettings::getMultiDrawIndirect() const
+  {
+    return _multiDrawIndirect;
+  }
+  void GraphicsSettings::setPipelinedRendering(bool enabled)
+  {
+    _pipelinedRendering = enabled;
+  }
+  bool GraphicsSettings::getPipelinedRendering() const
+  {
+    return _pipelinedRendering;
+  }
+  void GraphicsSettings::setOcclusionCulling(bool enabled)
+  {
+    _occlusionCulling = enabled;
+  }
+  bool GraphicsSettings::getOcclusionCulling() const
+  {
+    return _occlusionCulling;
+  }
+  void GraphicsSettings::setTemporalCulling(bool enabled)
+  {
+    _temporalCulling = enabled;
+  }
+  bool GraphicsSettings::getTemporalCulling() const
+  {
+    return _temporalCulling;
+  }
+  void GraphicsSettings::setTemporalCullingTolerance(float tolerance)
+  {
+    _temporalCullingTolerance = tolerance;
+  }
+  float GraphicsSettings::getTemporalCullingTolerance() const
+  {
+    return _temporalCullingTolerance;
+  }
+  void GraphicsSettings::setAsyncShaderRebuild(bool enabled)
+  {
+    _asyncShaderRebuild = enabled;
+  }
+  bool GraphicsSettings::getAsyncShaderRebuild() const
+  {
+    return _asyncShaderRebuild;
+  }
   void GraphicsSettings::setGodRays(bool enabled)
   {
     _godRays = enabled;
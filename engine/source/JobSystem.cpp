@@ -0,0 +1,213 @@
+#include <JobSystem.h>
+
+namespace fly
+{
+  namespace
+  {
+    thread_local const JobSystem* currentJobSystem = nullptr;
+    thread_local unsigned currentWorker = 0;
+  }
+  JobSystem::JobHandle::JobHandle(const std::shared_ptr<Job>& job) : _job(job)
+  {
+  }
+  bool JobSystem::JobHandle::isDone() const
+  {
+    return !_job || _job->_done.load();
+  }
+  JobSystem::JobSystem(unsigned num_workers) :
+    _numWorkers(num_workers ? num_workers : std::max(std::thread::hardware_concurrency(), 2u) - 1u)
+  {
+    for (unsigned i = 0; i <= _numWorkers; i++) {
+      _queues.push_back(std::make_unique<Queue>());
+    }
+    _workers.reserve(_numWorkers);
+    for (unsigned i = 0; i < _numWorkers; i++) {
+      _workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+    }
+  }
+  JobSystem::~JobSystem()
+  {
+    {
+      std::lock_guard<std::mutex> lock(_sleepMutex);
+      _stop = true;
+    }
+    _wakeUp.notify_all();
+    for (auto& w : _workers) {
+      w.join();
+    }
+  }
+  JobSystem & JobSystem::getInstance()
+  {
+    static JobSystem job_system;
+    return job_system;
+  }
+  unsigned JobSystem::getNumThreads() const
+  {
+    return _numWorkers + 1u;
+  }
+  unsigned JobSystem::getThreadIndex() const
+  {
+    return queueIndex();
+  }
+  JobSystem::JobHandle JobSystem::schedule(std::function<void()> func)
+  {
+    return schedule(std::move(func), nullptr, 0);
+  }
+  JobSystem::JobHandle JobSystem::schedule(std::function<void()> func, std::initializer_list<JobHandle> dependencies)
+  {
+    return schedule(std::move(func), dependencies.begin(), static_cast<unsigned>(dependencies.size()));
+  }
+  JobSystem::JobHandle JobSystem::schedule(std::function<void()> func, const JobHandle * dependencies, unsigned num_dependencies)
+  {
+    auto job = std::make_shared<Job>();
+    job->_func = std::move(func);
+    return schedule(job, dependencies, num_dependencies);
+  }
+  JobSystem::JobHandle JobSystem::scheduleOnMainThread(std::function<void()> func, const JobHandle * dependencies, unsigned num_dependencies)
+  {
+    auto job = std::make_shared<Job>();
+    job->_func = std::move(func);
+    job->_mainThread = true;
+    return schedule(job, dependencies, num_dependencies);
+  }
+  JobSystem::JobHandle JobSystem::schedule(const std::shared_ptr<Job>& job, const JobHandle * dependencies, unsigned num_dependencies)
+  {
+    job->_numDependencies += num_dependencies;
+    for (unsigned i = 0; i < num_dependencies; i++) {
+      const auto& dependency = dependencies[i]._job;
+      bool done = true;
+      if (dependency) {
+        std::lock_guard<std::mutex> lock(dependency->_mutex);
+        done = dependency->_done;
+        if (!done) {
+          dependency->_dependents.push_back(job);
+        }
+      }
+      if (done) {
+        job->_numDependencies--;
+      }
+    }
+    if (--job->_numDependencies == 0) {
+      push(job);
+    }
+    return JobHandle(job);
+  }
+  void JobSystem::wait(const JobHandle & handle)
+  {
+    unsigned index = queueIndex();
+    while (!handle.isDone()) {
+      if (auto job = pop(index)) {
+        execute(job);
+      }
+      else {
+        std::this_thread::yield();
+      }
+    }
+  }
+  void JobSystem::waitOnMainThread(const JobHandle & handle)
+  {
+    unsigned index = queueIndex();
+    while (!handle.isDone()) {
+      auto job = popMainThread();
+      if (!job) {
+        job = pop(index);
+      }
+      if (job) {
+        execute(job);
+      }
+      else {
+        std::this_thread::yield();
+      }
+    }
+  }
+  void JobSystem::workerLoop(unsigned index)
+  {
+    currentJobSystem = this;
+    currentWorker = index;
+    while (true) {
+      if (auto job = pop(index)) {
+        execute(job);
+      }
+      else {
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _wakeUp.wait(lock, [this]() {
+          return _stop || _numQueuedJobs.load() > 0;
+        });
+        if (_stop) {
+          return;
+        }
+      }
+    }
+  }
+  unsigned JobSystem::queueIndex() const
+  {
+    return currentJobSystem == this ? currentWorker : _numWorkers;
+  }
+  void JobSystem::push(const std::shared_ptr<Job>& job)
+  {
+    if (job->_mainThread) {
+      std::lock_guard<std::mutex> lock(_mainThreadQueue._mutex);
+      _mainThreadQueue._jobs.push_back(job);
+      return;
+    }
+    auto& queue = *_queues[queueIndex()];
+    {
+      std::lock_guard<std::mutex> lock(queue._mutex);
+      queue._jobs.push_back(job);
+    }
+    _numQueuedJobs++;
+    {
+      // Makes sure a worker that is about to sleep either sees the new job or gets the notification.
+      std::lock_guard<std::mutex> lock(_sleepMutex);
+    }
+    _wakeUp.notify_one();
+  }
+  std::shared_ptr<JobSystem::Job> JobSystem::pop(unsigned index)
+  {
+    unsigned num_queues = static_cast<unsigned>(_queues.size());
+    for (unsigned i = 0; i < num_queues; i++) {
+      auto& queue = *_queues[(index + i) % num_queues];
+      std::lock_guard<std::mutex> lock(queue._mutex);
+      if (queue._jobs.size()) {
+        std::shared_ptr<Job> job;
+        if (i == 0) {
+          job = std::move(queue._jobs.back());
+          queue._jobs.pop_back();
+        }
+        else {
+          job = std::move(queue._jobs.front());
+          queue._jobs.pop_front();
+        }
+        _numQueuedJobs--;
+        return job;
+      }
+    }
+    return nullptr;
+  }
+  std::shared_ptr<JobSystem::Job> JobSystem::popMainThread()
+  {
+    std::lock_guard<std::mutex> lock(_mainThreadQueue._mutex);
+    if (_mainThreadQueue._jobs.empty()) {
+      return nullptr;
+    }
+    auto job = std::move(_mainThreadQueue._jobs.front());
+    _mainThreadQueue._jobs.pop_front();
+    return job;
+  }
+  void JobSystem::execute(const std::shared_ptr<Job>& job)
+  {
+    job->_func();
+    job->_func = nullptr;
+    std::vector<std::shared_ptr<Job>> dependents;
+    {
+      std::lock_guard<std::mutex> lock(job->_mutex);
+      job->_done = true;
+      dependents.swap(job->_dependents);
+    }
+    for (const auto& d : dependents) {
+      if (--d->_numDependencies == 0) {
+        push(d);
+      }
+    }
+  }
+}
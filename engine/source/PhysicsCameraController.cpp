@@ -10,6 +10,8 @@ namespace fly
     _currentPos(camera->getPosition()),
     _previousPos(camera->getPosition())
   {
+    addWrite(this);
+    addWrite(camera.get());
   }
   void PhysicsCameraController::saveState()
   {
@@ -0,0 +1,182 @@
+#include <Profiler.h>
+#include <JobSystem.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+
+namespace fly
+{
+  namespace
+  {
+    void writeEscaped(std::ostream& os, const char* str)
+    {
+      for (; *str; str++) {
+        if (*str == '"' || *str == '\\') {
+          os << '\\';
+        }
+        os << *str;
+      }
+    }
+  }
+  thread_local Profiler::ThreadBuffer* Profiler::_currentThreadBuffer = nullptr;
+  Profiler::ThreadBuffer::ThreadBuffer(unsigned capacity, unsigned thread_index, const std::string& name) :
+    _slots(std::make_unique<Slot[]>(capacity)),
+    _capacity(capacity),
+    _threadIndex(thread_index),
+    _name(name)
+  {
+  }
+  Profiler::Profiler(unsigned zones_per_thread, unsigned max_frames) :
+    _zonesPerThread(zones_per_thread),
+    _frameBegins(max_frames),
+    _maxFrames(max_frames)
+  {
+  }
+  Profiler & Profiler::getInstance()
+  {
+    static Profiler profiler;
+    return profiler;
+  }
+  void Profiler::setEnabled(bool enabled)
+  {
+    _enabled = enabled;
+  }
+  bool Profiler::isEnabled() const
+  {
+    return _enabled.load(std::memory_order_relaxed);
+  }
+  void Profiler::markFrame()
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _frameBegins[_numFrames++ % _maxFrames] = now();
+  }
+  std::vector<Profiler::FrameRecord> Profiler::getFrames() const
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<FrameRecord> frames;
+    uint64_t first = _numFrames > _maxFrames ? _numFrames - _maxFrames : 0;
+    for (uint64_t i = first; i < _numFrames; i++) {
+      FrameRecord frame;
+      frame._beginNanoSeconds = _frameBegins[i % _maxFrames];
+      frame._endNanoSeconds = i + 1u < _numFrames ? _frameBegins[(i + 1u) % _maxFrames] : now();
+      frames.push_back(frame);
+    }
+    return frames;
+  }
+  std::vector<Profiler::ZoneRecord> Profiler::getZones() const
+  {
+    std::vector<ZoneRecord> zones;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      for (const auto& b : _threadBuffers) {
+        collectZones(*b, zones);
+      }
+    }
+    std::sort(zones.begin(), zones.end(), [](const ZoneRecord& a, const ZoneRecord& b) {
+      return a._beginNanoSeconds < b._beginNanoSeconds;
+    });
+    return zones;
+  }
+  std::vector<Profiler::ZoneRecord> Profiler::getZones(const FrameRecord & frame) const
+  {
+    auto zones = getZones();
+    zones.erase(std::remove_if(zones.begin(), zones.end(), [&frame](const ZoneRecord& z) {
+      return z._beginNanoSeconds < frame._beginNanoSeconds || z._beginNanoSeconds >= frame._endNanoSeconds;
+    }), zones.end());
+    return zones;
+  }
+  std::string Profiler::getThreadName(unsigned thread_index) const
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return thread_index < _threadBuffers.size() ? _threadBuffers[thread_index]->_name : std::string();
+  }
+  void Profiler::writeChromeTrace(std::ostream & os) const
+  {
+    auto zones = getZones();
+    auto frames = getFrames();
+    os << std::fixed << std::setprecision(3);
+    os << "{\"traceEvents\":[";
+    bool first = true;
+    auto separator = [&os, &first]() {
+      os << (first ? "\n" : ",\n");
+      first = false;
+    };
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      for (const auto& b : _threadBuffers) {
+        separator();
+        os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << b->_threadIndex << ",\"args\":{\"name\":\"";
+        writeEscaped(os, b->_name.c_str());
+        os << "\"}}";
+      }
+    }
+    for (const auto& f : frames) {
+      separator();
+      os << "{\"name\":\"Frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":0,\"ts\":" << f._beginNanoSeconds / 1000.0 << "}";
+    }
+    for (const auto& z : zones) {
+      separator();
+      os << "{\"name\":\"";
+      writeEscaped(os, z._name);
+      os << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << z._threadIndex << ",\"ts\":" << z._beginNanoSeconds / 1000.0
+        << ",\"dur\":" << (z._endNanoSeconds - z._beginNanoSeconds) / 1000.0 << "}";
+    }
+    os << "\n]}\n";
+  }
+  void Profiler::saveChromeTrace(const std::string & path) const
+  {
+    std::ofstream file(path);
+    if (!file) {
+      throw std::exception(("Could not open " + path).c_str());
+    }
+    writeChromeTrace(file);
+  }
+  uint64_t Profiler::now()
+  {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  }
+  Profiler::ThreadBuffer & Profiler::threadBuffer()
+  {
+    if (!_currentThreadBuffer) {
+      _currentThreadBuffer = &getInstance().registerThread();
+    }
+    return *_currentThreadBuffer;
+  }
+  Profiler::ThreadBuffer & Profiler::registerThread()
+  {
+    auto& job_system = JobSystem::getInstance();
+    auto job_system_index = job_system.getThreadIndex();
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto thread_index = static_cast<unsigned>(_threadBuffers.size());
+    auto name = job_system_index + 1u < job_system.getNumThreads() ? "Worker " + std::to_string(job_system_index) : "Thread " + std::to_string(thread_index);
+    _threadBuffers.push_back(std::make_unique<ThreadBuffer>(_zonesPerThread, thread_index, name));
+    return *_threadBuffers.back();
+  }
+  void Profiler::collectZones(const ThreadBuffer & buffer, std::vector<ZoneRecord>& zones) const
+  {
+    auto num_zones = buffer._numZones.load(std::memory_order_acquire);
+    auto first = num_zones > buffer._capacity ? num_zones - buffer._capacity : 0u;
+    auto num_before = zones.size();
+    for (auto i = first; i < num_zones; i++) {
+      const auto& slot = buffer._slots[i % buffer._capacity];
+      ZoneRecord zone;
+      zone._name = slot._name.load(std::memory_order_relaxed);
+      zone._beginNanoSeconds = slot._begin.load(std::memory_order_relaxed);
+      zone._endNanoSeconds = slot._end.load(std::memory_order_relaxed);
+      zone._depth = slot._depth.load(std::memory_order_relaxed);
+      zone._threadIndex = buffer._threadIndex;
+      zones.push_back(zone);
+    }
+    // The owning thread may have overwritten the oldest slots while they were read, those zones are dropped.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    auto num_zones_after = buffer._numZones.load(std::memory_order_relaxed);
+    auto first_valid = num_zones_after >= buffer._capacity ? num_zones_after - buffer._capacity + 1u : 0u;
+    if (first_valid > first) {
+      auto num_invalid = static_cast<size_t>(std::min(first_valid, num_zones) - first);
+      zones.erase(zones.begin() + num_before, zones.begin() + num_before + num_invalid);
+    }
+  }
+}
\ No newline at end of file
@@ -13,6 +13,10 @@
 
 namespace fly
 {
+  RenderingSystem::RenderingSystem()
+  {
+    setMainThreadOnly(true);
+  }
   RenderingSystem::~RenderingSystem()
   {}
 
@@ -0,0 +1,144 @@
+#include <ShaderDiskCache.h>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+namespace fly
+{
+  namespace
+  {
+    struct FileHeader
+    {
+      uint32_t _version;
+      uint32_t _format;
+      uint32_t _keySize;
+      uint32_t _padding;
+      uint64_t _dataSize;
+    };
+  }
+  ShaderDiskCache::ShaderDiskCache(const std::string & directory) :
+    _directory(directory)
+  {
+  }
+  bool ShaderDiskCache::loadSource(const std::string & key, std::string & source)
+  {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto it = _sources.find(key);
+      if (it != _sources.end()) {
+        source = it->second;
+        _hits++;
+        return true;
+      }
+    }
+    uint32_t format;
+    if (!read(key, ".glsl", format, source)) {
+      _misses++;
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    _sources[key] = source;
+    _hits++;
+    return true;
+  }
+  void ShaderDiskCache::storeSource(const std::string & key, const std::string & source)
+  {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _sources[key] = source;
+    }
+    write(key, ".glsl", 0, source.data(), source.size());
+  }
+  bool ShaderDiskCache::loadBinary(const std::string & key, unsigned & format, std::vector<char>& binary)
+  {
+    uint32_t file_format;
+    std::string data;
+    if (!read(key, ".bin", file_format, data)) {
+      _misses++;
+      return false;
+    }
+    format = file_format;
+    binary.assign(data.begin(), data.end());
+    _hits++;
+    return true;
+  }
+  void ShaderDiskCache::storeBinary(const std::string & key, unsigned format, const std::vector<char>& binary)
+  {
+    write(key, ".bin", format, binary.data(), binary.size());
+  }
+  const std::string & ShaderDiskCache::getDirectory() const
+  {
+    return _directory;
+  }
+  unsigned ShaderDiskCache::getHits() const
+  {
+    return _hits.load();
+  }
+  unsigned ShaderDiskCache::getMisses() const
+  {
+    return _misses.load();
+  }
+  uint64_t ShaderDiskCache::hash(const std::string & str)
+  {
+    uint64_t hash = 14695981039346656037ull;
+    for (auto c : str) {
+      hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    return hash;
+  }
+  std::string ShaderDiskCache::path(const std::string & key, const char * extension) const
+  {
+    std::stringstream ss;
+    ss << _directory << std::hex << hash(key) << extension;
+    return ss.str();
+  }
+  bool ShaderDiskCache::read(const std::string & key, const char * extension, uint32_t & format, std::string & data) const
+  {
+    std::ifstream is(path(key, extension), std::ios::binary);
+    FileHeader header;
+    if (!is || !is.read(reinterpret_cast<char*>(&header), sizeof header) || header._version != _fileVersion || header._keySize != key.size()) {
+      return false;
+    }
+    std::string file_key(header._keySize, '\0');
+    if (!is.read(&file_key[0], file_key.size()) || file_key != key) {
+      return false;
+    }
+    data.resize(static_cast<size_t>(header._dataSize));
+    if (data.size() && !is.read(&data[0], data.size())) {
+      return false;
+    }
+    format = header._format;
+    return true;
+  }
+  void ShaderDiskCache::write(const std::string & key, const char * extension, uint32_t format, const char * data, size_t size) const
+  {
+    // Written to a file of its own first, so concurrent readers and writers of the same key never see a partial file.
+    auto file = path(key, extension);
+    auto tmp_file = file + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    {
+      std::ofstream os(tmp_file, std::ios::binary);
+      if (!os) {
+        return;
+      }
+      FileHeader header = {};
+      header._version = _fileVersion;
+      header._format = format;
+      header._keySize = static_cast<uint32_t>(key.size());
+      header._dataSize = size;
+      os.write(reinterpret_cast<const char*>(&header), sizeof header);
+      os.write(key.data(), key.size());
+      os.write(data, size);
+      if (!os) {
+        os.close();
+        std::remove(tmp_file.c_str());
+        return;
+      }
+    }
+    std::remove(file.c_str());
+    if (std::rename(tmp_file.c_str(), file.c_str())) {
+      std::remove(tmp_file.c_str());
+    }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,278 @@
+#include <SoftwareOcclusionCuller.h>
+#include <AABB.h>
+#include <Sphere.h>
+#include <Mesh.h>
+#include <JobSystem.h>
+#include <xmmintrin.h>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace fly
+{
+  SoftwareOcclusionCuller::SoftwareOcclusionCuller(unsigned width, unsigned height) :
+    _width((std::max(width, 4u) + 3u) & ~3u),
+    _height(std::max(height, 1u))
+  {
+    Vec2u size(_width, _height);
+    while (true) {
+      _hiZSize.push_back(size);
+      _hiZ.push_back(std::vector<float>(size[0] * size[1], std::numeric_limits<float>::max()));
+      if (size[0] == 1 && size[1] == 1) {
+        break;
+      }
+      size = Vec2u((size[0] + 1u) / 2u, (size[1] + 1u) / 2u);
+    }
+  }
+  void SoftwareOcclusionCuller::addOccluder(const Mesh & mesh, const Mat4f & model_matrix)
+  {
+    unsigned offset = static_cast<unsigned>(_occluderVertices.size());
+    for (const auto& v : mesh.getVertices()) {
+      _occluderVertices.push_back((model_matrix * Vec4f(v._position, 1.f)).xyz());
+    }
+    for (auto i : mesh.getIndices()) {
+      _occluderIndices.push_back(offset + i);
+    }
+  }
+  void SoftwareOcclusionCuller::addOccluder(const std::vector<Vec3f>& positions, const std::vector<unsigned>& indices)
+  {
+    unsigned offset = static_cast<unsigned>(_occluderVertices.size());
+    _occluderVertices.insert(_occluderVertices.end(), positions.begin(), positions.end());
+    for (auto i : indices) {
+      _occluderIndices.push_back(offset + i);
+    }
+  }
+  void SoftwareOcclusionCuller::clearOccluders()
+  {
+    _occluderVertices.clear();
+    _occluderIndices.clear();
+  }
+  unsigned SoftwareOcclusionCuller::numOccluderTriangles() const
+  {
+    return static_cast<unsigned>(_occluderIndices.size() / 3u);
+  }
+  void SoftwareOcclusionCuller::rasterizeOccluders(const Mat4f & view_projection, ZNearMapping z_near_mapping)
+  {
+    _viewProjection = view_projection;
+    _nearPlaneW = z_near_mapping == ZNearMapping::ZERO ? 0.f : 1.f;
+    auto& job_system = JobSystem::getInstance();
+    unsigned num_threads = job_system.getNumThreads();
+    unsigned num_triangles = numOccluderTriangles();
+    unsigned num_tasks = std::max(std::min(num_threads, num_triangles / _minTrianglesPerTask), 1u);
+    unsigned triangles_per_task = (num_triangles + num_tasks - 1u) / num_tasks;
+    _screenTriangles.resize(num_tasks);
+    job_system.parallelFor(0, num_tasks, 1, [this, triangles_per_task, num_triangles](unsigned task_begin, unsigned task_end) {
+      for (unsigned i = task_begin; i < task_end; i++) {
+        unsigned begin = std::min(i * triangles_per_task, num_triangles);
+        unsigned end = std::min(begin + triangles_per_task, num_triangles);
+        transformTriangles(begin, end, _screenTriangles[i]);
+      }
+    });
+    unsigned num_bands = std::max(std::min(num_threads, _height / _minRowsPerBand), 1u);
+    unsigned rows_per_band = (_height + num_bands - 1u) / num_bands;
+    job_system.parallelFor(0, num_bands, 1, [this, rows_per_band](unsigned band_begin, unsigned band_end) {
+      for (unsigned i = band_begin; i < band_end; i++) {
+        unsigned y = std::min(i * rows_per_band, _height);
+        rasterizeBand(y, std::min(y + rows_per_band, _height));
+      }
+    });
+    buildHiZ();
+  }
+  bool SoftwareOcclusionCuller::isOccluded(const AABB & aabb) const
+  {
+    return isOccluded(aabb.getMin(), aabb.getMax());
+  }
+  bool SoftwareOcclusionCuller::isOccluded(const Sphere & sphere) const
+  {
+    return isOccluded(sphere.center() - sphere.radius(), sphere.center() + sphere.radius());
+  }
+  unsigned SoftwareOcclusionCuller::getWidth() const
+  {
+    return _width;
+  }
+  unsigned SoftwareOcclusionCuller::getHeight() const
+  {
+    return _height;
+  }
+  const std::vector<float>& SoftwareOcclusionCuller::getDepthBuffer() const
+  {
+    return _hiZ[0];
+  }
+  void SoftwareOcclusionCuller::transformTriangles(unsigned begin, unsigned end, std::vector<ScreenTriangle>& triangles) const
+  {
+    triangles.clear();
+    Vec4f clip[3];
+    for (unsigned i = begin; i < end; i++) {
+      for (unsigned j = 0; j < 3; j++) {
+        clip[j] = _viewProjection * Vec4f(_occluderVertices[_occluderIndices[i * 3u + j]], 1.f);
+      }
+      bool outside = false;
+      for (unsigned axis = 0; axis < 2 && !outside; axis++) {
+        outside = (clip[0][axis] > clip[0][3] && clip[1][axis] > clip[1][3] && clip[2][axis] > clip[2][3]) ||
+          (clip[0][axis] < -clip[0][3] && clip[1][axis] < -clip[1][3] && clip[2][axis] < -clip[2][3]);
+      }
+      if (!outside) {
+        clipAndAdd(clip, triangles);
+      }
+    }
+  }
+  void SoftwareOcclusionCuller::clipAndAdd(const Vec4f * clip, std::vector<ScreenTriangle>& triangles) const
+  {
+    Vec4f polygon[4];
+    unsigned num_vertices = 0;
+    for (unsigned i = 0; i < 3; i++) {
+      const auto& a = clip[i];
+      const auto& b = clip[(i + 1u) % 3u];
+      float dist_a = nearPlaneDistance(a);
+      float dist_b = nearPlaneDistance(b);
+      if (dist_a >= 0.f) {
+        polygon[num_vertices++] = a;
+      }
+      if ((dist_a >= 0.f) != (dist_b >= 0.f)) {
+        float t = dist_a / (dist_a - dist_b);
+        polygon[num_vertices++] = a + (b - a) * t;
+      }
+    }
+    if (num_vertices < 3) {
+      return;
+    }
+    Vec3f screen[4];
+    for (unsigned i = 0; i < num_vertices; i++) {
+      float w_inv = 1.f / polygon[i][3];
+      screen[i] = Vec3f((polygon[i][0] * w_inv * 0.5f + 0.5f) * _width, (polygon[i][1] * w_inv * 0.5f + 0.5f) * _height, polygon[i][2] * w_inv);
+    }
+    for (unsigned i = 1; i + 1u < num_vertices; i++) {
+      triangles.push_back({ { screen[0], screen[i], screen[i + 1u] } });
+    }
+  }
+  void SoftwareOcclusionCuller::rasterizeBand(unsigned y_begin, unsigned y_end)
+  {
+    auto& depth_buffer = _hiZ[0];
+    std::fill(depth_buffer.begin() + y_begin * _width, depth_buffer.begin() + y_end * _width, std::numeric_limits<float>::max());
+    for (const auto& triangles : _screenTriangles) {
+      for (const auto& t : triangles) {
+        rasterizeTriangle(t, y_begin, y_end);
+      }
+    }
+  }
+  void SoftwareOcclusionCuller::rasterizeTriangle(const ScreenTriangle & triangle, unsigned y_begin, unsigned y_end)
+  {
+    const Vec3f* v[3] = { &triangle._v[0], &triangle._v[1], &triangle._v[2] };
+    float area = ((*v[1])[0] - (*v[0])[0]) * ((*v[2])[1] - (*v[0])[1]) - ((*v[1])[1] - (*v[0])[1]) * ((*v[2])[0] - (*v[0])[0]);
+    if (std::abs(area) < 1e-8f) {
+      return;
+    }
+    if (area < 0.f) {
+      // Back faces are rasterized as well, so the winding order of the occluders doesn't matter.
+      std::swap(v[1], v[2]);
+      area = -area;
+    }
+    float min_x = std::min({ (*v[0])[0], (*v[1])[0], (*v[2])[0] });
+    float max_x = std::max({ (*v[0])[0], (*v[1])[0], (*v[2])[0] });
+    float min_y = std::min({ (*v[0])[1], (*v[1])[1], (*v[2])[1] });
+    float max_y = std::max({ (*v[0])[1], (*v[1])[1], (*v[2])[1] });
+    if (max_x < 0.f || min_x >= _width || max_y < y_begin || min_y >= y_end) {
+      return;
+    }
+    unsigned x_begin = static_cast<unsigned>(std::max(min_x, 0.f)) & ~3u;
+    unsigned x_end = std::min(static_cast<unsigned>(std::min(max_x, static_cast<float>(_width))) + 1u, _width);
+    unsigned row_begin = std::max(static_cast<unsigned>(std::max(min_y, 0.f)), y_begin);
+    unsigned row_end = std::min(static_cast<unsigned>(std::min(max_y, static_cast<float>(y_end))) + 1u, y_end);
+    // Edge i is opposite to vertex i, its edge function is positive inside the triangle and equals area at vertex i.
+    float a[3], b[3], c[3];
+    for (unsigned i = 0; i < 3; i++) {
+      const auto& p0 = *v[(i + 1u) % 3u];
+      const auto& p1 = *v[(i + 2u) % 3u];
+      a[i] = p0[1] - p1[1];
+      b[i] = p1[0] - p0[0];
+      c[i] = -a[i] * p0[0] - b[i] * p0[1];
+    }
+    float area_inv = 1.f / area;
+    float z_a = (a[0] * (*v[0])[2] + a[1] * (*v[1])[2] + a[2] * (*v[2])[2]) * area_inv;
+    float z_b = (b[0] * (*v[0])[2] + b[1] * (*v[1])[2] + b[2] * (*v[2])[2]) * area_inv;
+    float z_c = (c[0] * (*v[0])[2] + c[1] * (*v[1])[2] + c[2] * (*v[2])[2]) * area_inv;
+    __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    __m128 zero = _mm_setzero_ps();
+    auto& depth_buffer = _hiZ[0];
+    for (unsigned y = row_begin; y < row_end; y++) {
+      float py = y + 0.5f;
+      __m128 e_row[3];
+      for (unsigned i = 0; i < 3; i++) {
+        e_row[i] = _mm_set1_ps(b[i] * py + c[i]);
+      }
+      __m128 z_row = _mm_set1_ps(z_b * py + z_c);
+      float* row = depth_buffer.data() + y * _width;
+      for (unsigned x = x_begin; x < x_end; x += 4u) {
+        __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+        __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[0]), px), e_row[0]), zero);
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[1]), px), e_row[1]), zero));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[2]), px), e_row[2]), zero));
+        if (_mm_movemask_ps(inside)) {
+          __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(z_a), px), z_row);
+          __m128 depth = _mm_loadu_ps(row + x);
+          __m128 closer = _mm_min_ps(depth, z);
+          _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, depth)));
+        }
+      }
+    }
+  }
+  void SoftwareOcclusionCuller::buildHiZ()
+  {
+    for (size_t level = 1; level < _hiZ.size(); level++) {
+      const auto& src = _hiZ[level - 1u];
+      const auto& src_size = _hiZSize[level - 1u];
+      auto& dst = _hiZ[level];
+      const auto& dst_size = _hiZSize[level];
+      for (unsigned y = 0; y < dst_size[1]; y++) {
+        unsigned y0 = y * 2u;
+        unsigned y1 = std::min(y0 + 1u, src_size[1] - 1u);
+        for (unsigned x = 0; x < dst_size[0]; x++) {
+          unsigned x0 = x * 2u;
+          unsigned x1 = std::min(x0 + 1u, src_size[0] - 1u);
+          dst[y * dst_size[0] + x] = std::max(std::max(src[y0 * src_size[0] + x0], src[y0 * src_size[0] + x1]),
+            std::max(src[y1 * src_size[0] + x0], src[y1 * src_size[0] + x1]));
+        }
+      }
+    }
+  }
+  bool SoftwareOcclusionCuller::isOccluded(const Vec3f & bb_min, const Vec3f & bb_max) const
+  {
+    Vec2f screen_min(std::numeric_limits<float>::max());
+    Vec2f screen_max(std::numeric_limits<float>::lowest());
+    float z_min = std::numeric_limits<float>::max();
+    for (unsigned i = 0; i < 8; i++) {
+      Vec4f corner(i & 1u ? bb_max[0] : bb_min[0], i & 2u ? bb_max[1] : bb_min[1], i & 4u ? bb_max[2] : bb_min[2], 1.f);
+      auto clip = _viewProjection * corner;
+      if (nearPlaneDistance(clip) < 0.f) {
+        return false;
+      }
+      float w_inv = 1.f / clip[3];
+      Vec2f screen((clip[0] * w_inv * 0.5f + 0.5f) * _width, (clip[1] * w_inv * 0.5f + 0.5f) * _height);
+      screen_min = minimum(screen_min, screen);
+      screen_max = maximum(screen_max, screen);
+      z_min = std::min(z_min, clip[2] * w_inv);
+    }
+    if (screen_max[0] < 0.f || screen_min[0] >= _width || screen_max[1] < 0.f || screen_min[1] >= _height) {
+      return false;
+    }
+    unsigned x0 = static_cast<unsigned>(std::max(screen_min[0], 0.f));
+    unsigned x1 = static_cast<unsigned>(std::min(screen_max[0], _width - 1.f));
+    unsigned y0 = static_cast<unsigned>(std::max(screen_min[1], 0.f));
+    unsigned y1 = static_cast<unsigned>(std::min(screen_max[1], _height - 1.f));
+    // Select the finest level on which the screen rectangle covers at most 4x4 texels.
+    unsigned level = 0;
+    while (level + 1u < _hiZ.size() && ((x1 >> level) - (x0 >> level) > 3u || (y1 >> level) - (y0 >> level) > 3u)) {
+      level++;
+    }
+    const auto& hi_z = _hiZ[level];
+    unsigned width = _hiZSize[level][0];
+    for (unsigned y = y0 >> level; y <= y1 >> level; y++) {
+      for (unsigned x = x0 >> level; x <= x1 >> level; x++) {
+        if (hi_z[y * width + x] >= z_min) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+}
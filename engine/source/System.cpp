@@ -1,4 +1,5 @@
 #include "System.h"
+#include <algorithm>
 
 namespace fly
 {
@@ -12,4 +13,70 @@ namespace fly
   {
     _gameTimer = game_timer;
   }
-}
\ No newline at end of file
+  void System::addRead(void const * data)
+  {
+    _reads.push_back(data);
+    _declarationsChanged = true;
+  }
+  void System::addWrite(void const * data)
+  {
+    _writes.push_back(data);
+    _declarationsChanged = true;
+  }
+  void const * System::sceneData()
+  {
+    static const char scene_data = 0;
+    return &scene_data;
+  }
+  void System::addDependency(System const * system)
+  {
+    _dependencies.push_back(system);
+    _declarationsChanged = true;
+  }
+  void System::setMainThreadOnly(bool main_thread_only)
+  {
+    _mainThreadOnly = main_thread_only;
+    _declarationsChanged = true;
+  }
+  bool System::runsOnMainThread() const
+  {
+    return _mainThreadOnly || !declaresDataAccess();
+  }
+  bool System::conflictsWith(const System & other) const
+  {
+    if (!declaresDataAccess() || !other.declaresDataAccess()) {
+      return true;
+    }
+    auto accesses = [](const System& system, void const * data) {
+      return std::find(system._reads.begin(), system._reads.end(), data) != system._reads.end() ||
+        std::find(system._writes.begin(), system._writes.end(), data) != system._writes.end();
+    };
+    for (auto data : _writes) {
+      if (accesses(other, data)) {
+        return true;
+      }
+    }
+    for (auto data : other._writes) {
+      if (accesses(*this, data)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  bool System::dependsOn(System const * system) const
+  {
+    return std::find(_dependencies.begin(), _dependencies.end(), system) != _dependencies.end();
+  }
+  void System::setName(const std::string & name)
+  {
+    _name = name;
+  }
+  const std::string & System::getName() const
+  {
+    return _name;
+  }
+  bool System::declaresDataAccess() const
+  {
+    return _reads.size() || _writes.size();
+  }
+}
@@ -0,0 +1,335 @@
+#include <null/NullAPI.h>
+#include <Mesh.h>
+#include <GraphicsSettings.h>
+#include <limits>
+
+namespace fly
+{
+  NullAPI::NullAPI(const Vec4f& clear_color)
+  {
+    resetCounters();
+  }
+  NullAPI::~NullAPI()
+  {
+  }
+  ZNearMapping NullAPI::getZNearMapping() const
+  {
+    return ZNearMapping::MINUS_ONE;
+  }
+  void NullAPI::setViewport(const Vec2u & size) const
+  {
+    count(Call::SET_VIEWPORT);
+  }
+  void NullAPI::clearRendertarget(bool color, bool depth, bool stencil) const
+  {
+    count(Call::CLEAR_RENDERTARGET);
+  }
+  std::vector<NullAPI::IndirectInfo> NullAPI::indirectFromMeshData(const std::vector<MeshData>& mesh_data) const
+  {
+    std::vector<IndirectInfo> infos;
+    for (const auto& d : mesh_data) {
+      infos.push_back(IndirectInfo(d));
+    }
+    return infos;
+  }
+  void NullAPI::beginFrame() const
+  {
+    count(Call::BEGIN_FRAME);
+  }
+  void NullAPI::bindShader(Shader const * shader)
+  {
+    _activeShader = shader;
+    count(Call::BIND_SHADER);
+  }
+  void NullAPI::bindShadowmap(const Shadowmap & shadowmap) const
+  {
+    count(Call::BIND_SHADOWMAP);
+  }
+  void NullAPI::renderMesh(const MeshData & mesh_data) const
+  {
+    count(Call::RENDER_MESH);
+    _numTriangles += mesh_data.numTriangles();
+  }
+  void NullAPI::renderMesh(const MeshData & mesh_data, const Mat4f & model_matrix) const
+  {
+    renderMesh(mesh_data);
+  }
+  void NullAPI::renderMesh(const MeshData & mesh_data, const Mat4f & model_matrix, const Mat3f & model_matrix_inverse) const
+  {
+    renderMesh(mesh_data);
+  }
+  void NullAPI::renderMesh(const MeshData & mesh_data, const Mat4f & model_matrix, const WindParamsLocal & wind_params, const AABB & aabb) const
+  {
+    renderMesh(mesh_data);
+  }
+  void NullAPI::renderMesh(const MeshData & mesh_data, const Mat4f & model_matrix, const Mat3f & model_matrix_inverse, const WindParamsLocal & wind_params, const AABB & aabb) const
+  {
+    renderMesh(mesh_data);
+  }
+  void NullAPI::renderMesh(const MeshData & mesh_data, const Mat4f & model_matrix, const WindParamsLocal & wind_params, const Sphere & sphere) const
+  {
+    renderMesh(mesh_data);
+  }
+  void NullAPI::renderMesh(const MeshData & mesh_data, const Mat4f & model_matrix, const Mat3f & model_matrix_inverse, const WindParamsLocal & wind_params, const Sphere & sphere) const
+  {
+    renderMesh(mesh_data);
+  }
+  void NullAPI::renderMeshMVP(const MeshData & mesh_data, const Mat4f & mvp) const
+  {
+    renderMesh(mesh_data);
+  }
+  void NullAPI::renderBVs(const StackPOD<AABB const*>& aabbs, const Mat4f & transform, const Vec3f & col)
+  {
+    count(Call::RENDER_DEBUG);
+  }
+  void NullAPI::renderBVs(const StackPOD<Sphere const*>& spheres, const Mat4f & transform, const Vec3f & col)
+  {
+    count(Call::RENDER_DEBUG);
+  }
+  void NullAPI::renderDebugFrustum(const Mat4f & vp_debug_frustum, const Mat4f & vp)
+  {
+    count(Call::RENDER_DEBUG);
+  }
+  void NullAPI::prepareCulling(const std::array<Vec4f, 6>& frustum_planes, const Vec3f & cam_pos_world, float lod_range, float thresh)
+  {
+    bindShader(nullptr);
+  }
+  void NullAPI::prepareLod(const Vec3f & cam_pos_world, float lod_range, float thresh)
+  {
+    bindShader(nullptr);
+  }
+  void NullAPI::endCulling() const
+  {
+  }
+  void NullAPI::cullInstances(const StorageBuffer & aabb_buffer, unsigned num_instances, const StorageBuffer & visible_instances,
+    const IndirectBuffer & indirect_draw_buffer, std::vector<IndirectInfo>& info) const
+  {
+    count(Call::CULL_INSTANCES);
+    for (auto& i : info) {
+      i._primCount = 0;
+    }
+    if (info.size()) {
+      info.front()._primCount = num_instances;
+    }
+  }
+  void NullAPI::renderInstances(const StorageBuffer & visible_instance_buffer, const IndirectBuffer & indirect_draw_buffer,
+    const StorageBuffer & instance_data, const std::vector<IndirectInfo>& info, unsigned num_instances) const
+  {
+    count(Call::RENDER_INSTANCES);
+    for (const auto& i : info) {
+      _numTriangles += i._count / 3u * i._primCount;
+    }
+  }
+  bool NullAPI::multiDrawIndirectSupported() const
+  {
+    return true;
+  }
+  void NullAPI::setMultiDrawData(const StackPOD<InstanceData>& draw_data, const StackPOD<IndirectInfo>& indirect_info, MultiDrawBuffers & buffers) const
+  {
+    count(Call::SET_MULTI_DRAW_DATA);
+    buffers._drawData._size = draw_data.size() * sizeof(InstanceData);
+    buffers._indirectBuffer._size = indirect_info.size() * sizeof(IndirectInfo);
+  }
+  void NullAPI::renderMeshesIndirect(const MultiDrawBuffers & buffers, unsigned type, unsigned first_draw, unsigned num_draws) const
+  {
+    count(Call::RENDER_MESHES_INDIRECT);
+  }
+  void NullAPI::setRendertargets(const RendertargetStack & rtts, const Depthbuffer * depth_buffer)
+  {
+    count(Call::SET_RENDERTARGETS);
+  }
+  void NullAPI::setRendertargets(const RendertargetStack & rtts, const Depthbuffer * depth_buffer, unsigned depth_buffer_layer)
+  {
+    count(Call::SET_RENDERTARGETS);
+  }
+  void NullAPI::bindBackbuffer(unsigned id) const
+  {
+    count(Call::BIND_BACKBUFFER);
+  }
+  void NullAPI::ssr(const RTT & lighting_buffer, const RTT & view_space_normals, const Depthbuffer & depth_buffer, const Mat4f & projection_matrix, const Vec4f & blend_weight, RTT & lighting_buffer_copy)
+  {
+    count(Call::POST_PROCESSING);
+  }
+  void NullAPI::separableBlur(const RTT & in, const std::array<std::shared_ptr<RTT>, 2>& out, RendertargetStack & rtt_stack)
+  {
+    count(Call::POST_PROCESSING);
+  }
+  void NullAPI::renderGodRays(const Depthbuffer & depth_buffer, const RTT & lighting_buffer, const Vec2f & light_pos_uv)
+  {
+    count(Call::POST_PROCESSING);
+  }
+  void NullAPI::composite(const RTT & lighting_buffer, const GlobalShaderParams & params)
+  {
+    count(Call::POST_PROCESSING);
+  }
+  void NullAPI::composite(const RTT & lighting_buffer, const GlobalShaderParams & params, const RTT & dof_buffer, const Depthbuffer & depth_buffer)
+  {
+    count(Call::POST_PROCESSING);
+  }
+  void NullAPI::composite(const RTT & lighting_buffer, const GlobalShaderParams & params, const RTT & dof_buffer, const Depthbuffer & depth_buffer,
+    const RTT & god_ray_buffer, const Vec3f & god_ray_intensity)
+  {
+    count(Call::POST_PROCESSING);
+  }
+  void NullAPI::endFrame() const
+  {
+    count(Call::END_FRAME);
+  }
+  void NullAPI::setAnisotropy(unsigned anisotropy)
+  {
+  }
+  void NullAPI::enablePolygonOffset(float factor, float units) const
+  {
+    count(Call::SET_STATE);
+  }
+  void NullAPI::disablePolygonOffset() const
+  {
+    count(Call::SET_STATE);
+  }
+  void NullAPI::renderSkydome(const Mat4f & view_projection_matrix, const MeshData & mesh_data)
+  {
+    count(Call::RENDER_SKYDOME);
+  }
+  NullAPI::Texture* NullAPI::createTexture(const std::string & path)
+  {
+    return new Texture();
+  }
+  NullAPI::Shader* NullAPI::createShader(ShaderSource & vs, ShaderSource & fs, ShaderSource & gs)
+  {
+    auto key = vs._key + fs._key + gs._key;
+    if (_shaderDiskCache) {
+      unsigned format;
+      std::vector<char> binary;
+      if (!_shaderDiskCache->loadBinary(key, format, binary)) {
+        _shaderDiskCache->storeBinary(key, 0, std::vector<char>(key.begin(), key.end()));
+      }
+    }
+    return new Shader(key);
+  }
+  std::unique_ptr<NullAPI::RTT> NullAPI::createRenderToTexture(const Vec2u & size, TexFilter filter)
+  {
+    return std::make_unique<RTT>(Vec3u(size[0], size[1], 1u));
+  }
+  std::unique_ptr<NullAPI::Depthbuffer> NullAPI::createDepthbuffer(const Vec2u & size)
+  {
+    return std::make_unique<Depthbuffer>(Vec3u(size[0], size[1], 1u));
+  }
+  std::unique_ptr<NullAPI::Shadowmap> NullAPI::createShadowmap(const GraphicsSettings & settings)
+  {
+    auto shadow_map = std::make_unique<Shadowmap>();
+    resizeShadowmap(shadow_map.get(), settings);
+    return shadow_map;
+  }
+  NullAPI::IndirectBuffer NullAPI::createIndirectBuffer(const IndirectInfo & info) const
+  {
+    return createStorageBuffer(&info, 1);
+  }
+  NullAPI::IndirectBuffer NullAPI::createIndirectBuffer(const std::vector<IndirectInfo>& info) const
+  {
+    return createStorageBuffer(info.data(), info.size());
+  }
+  void NullAPI::resizeShadowmap(Shadowmap * shadow_map, const GraphicsSettings & settings)
+  {
+    shadow_map->_size = Vec3u(Vec2u(settings.getShadowMapSize()), static_cast<unsigned>(settings.getFrustumSplits().size()));
+  }
+  void NullAPI::createBlurShader(const GraphicsSettings & gs)
+  {
+  }
+  void NullAPI::createCompositeShader(const GraphicsSettings & gs)
+  {
+  }
+  void NullAPI::createScreenSpaceReflectionsShader(const GraphicsSettings & gs)
+  {
+  }
+  void NullAPI::createGodRayShader(const GraphicsSettings & gs)
+  {
+  }
+  void NullAPI::setShaderDiskCache(const std::string & directory)
+  {
+    _shaderDiskCache = directory.empty() ? nullptr : std::make_unique<ShaderDiskCache>(directory);
+  }
+  const ShaderDiskCache * NullAPI::getShaderDiskCache() const
+  {
+    return _shaderDiskCache.get();
+  }
+  const NullAPI::ShaderGenerator & NullAPI::getShaderGenerator() const
+  {
+    return _shaderGenerator;
+  }
+  NullAPI::Shader const *& NullAPI::getActiveShader()
+  {
+    return _activeShader;
+  }
+  unsigned NullAPI::getCount(Call call) const
+  {
+    return _counts[static_cast<size_t>(call)];
+  }
+  unsigned NullAPI::getNumTriangles() const
+  {
+    return _numTriangles;
+  }
+  void NullAPI::resetCounters()
+  {
+    _counts.fill(0);
+    _numTriangles = 0;
+  }
+  void NullAPI::setRecording(bool enabled)
+  {
+    _recording = enabled;
+  }
+  const StackPOD<NullAPI::Call>& NullAPI::getRecordedCalls() const
+  {
+    return _recordedCalls;
+  }
+  void NullAPI::clearRecordedCalls()
+  {
+    _recordedCalls.clear();
+  }
+  NullAPI::ShaderSource NullAPI::ShaderGenerator::createMeshVertexShaderSource(unsigned flags, const GraphicsSettings & settings, bool instanced) const
+  {
+    return createSource("vs", flags, settings, instanced);
+  }
+  NullAPI::ShaderSource NullAPI::ShaderGenerator::createMeshFragmentShaderSource(unsigned flags, const GraphicsSettings & settings, bool instanced) const
+  {
+    return createSource("fs", flags, settings, instanced);
+  }
+  NullAPI::ShaderSource NullAPI::ShaderGenerator::createMeshVertexShaderDepthSource(unsigned flags, const GraphicsSettings & settings, bool instanced) const
+  {
+    return createSource("vs_depth", flags, settings, instanced);
+  }
+  NullAPI::ShaderSource NullAPI::ShaderGenerator::createMeshFragmentShaderDepthSource(unsigned flags, const GraphicsSettings & settings) const
+  {
+    return createSource("fs_depth", flags, settings, false);
+  }
+  NullAPI::ShaderSource NullAPI::ShaderGenerator::createSource(const char * prefix, unsigned flags, const GraphicsSettings & settings, bool instanced)
+  {
+    std::string settings_key;
+    for (bool b : { settings.depthPrepassEnabled(), settings.gammaEnabled(), settings.getReliefMapping(), settings.getScreenSpaceReflections(),
+      settings.getShadows(), settings.getShadowsPCF() }) {
+      settings_key += b ? '1' : '0';
+    }
+    ShaderSource source;
+    source._key = std::string(prefix) + "_" + std::to_string(flags) + (instanced ? "_instanced" : "") + "_" + settings_key
+      + "_" + std::to_string(settings.getFrustumSplits().size());
+    return source;
+  }
+  NullAPI::MeshGeometryStorage::MeshGeometryStorage() :
+    _meshDataCache(SoftwareCache<std::shared_ptr<Mesh>, MeshData, const std::shared_ptr<Mesh>&>([this](
+      const std::shared_ptr<Mesh>& mesh) {
+    MeshData mesh_data;
+    mesh_data._count = static_cast<unsigned>(mesh->getIndices().size());
+    mesh_data._id = _numMeshes++;
+    mesh_data._firstIndex = _indices;
+    mesh_data._baseVertex = _baseVertex;
+    mesh_data._type = mesh->getVertices().size() - 1 <= static_cast<size_t>(std::numeric_limits<unsigned short>::max()) ? sizeof(unsigned short) : sizeof(unsigned int);
+    _indices += mesh_data._count;
+    _baseVertex += static_cast<unsigned>(mesh->getVertices().size());
+    return mesh_data;
+  }))
+  {
+  }
+  NullAPI::MeshData NullAPI::MeshGeometryStorage::addMesh(const std::shared_ptr<Mesh>& mesh)
+  {
+    return _meshDataCache.getOrCreate(mesh, mesh);
+  }
+}
\ No newline at end of file
@@ -0,0 +1,8 @@
+#include <null/NullAPI.h>
+#include <renderer/Renderer.h>
+
+namespace fly
+{
+  // Compiles every member of the renderer against the null API, so API independent code that breaks is noticed without a GPU.
+  template class Renderer<NullAPI, AABB>;
+}
\ No newline at end of file
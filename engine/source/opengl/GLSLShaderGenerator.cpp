@@ -31,6 +31,26 @@ uniform vec3 " + std::string(bbMax) + "; // AABB max xz\n" + std::string(noiseCo
   mat4 world_matrix_inverse_transpose;\n\
   uint index;  // Can be an index into a color array or an index into a texture array \n\
 };\n";
+    _multiDrawExtensionStr = "#extension GL_ARB_shader_draw_parameters : require\n";
+    // Per draw data of multi draw batches, the base instance of each indirect draw is its index into draw_data
+    _drawDataStr = _instanceDataStr + "layout (std430, binding = " + std::to_string(bufferBindingInstanceData) + ") readonly buffer draw_data_buffer \n\
+{\n\
+  InstanceData draw_data[];\n\
+};\n";
+  }
+  void GLSLShaderGenerator::setDiskCache(ShaderDiskCache * disk_cache)
+  {
+    _diskCache = disk_cache;
+  }
+  std::string GLSLShaderGenerator::variantKey(const std::string & key, unsigned flags, const GraphicsSettings & settings, bool instanced) const
+  {
+    std::string settings_key;
+    for (bool b : { settings.depthPrepassEnabled(), settings.gammaEnabled(), settings.getReliefMapping(), settings.getScreenSpaceReflections(),
+      settings.getShadows(), settings.getShadowsPCF() }) {
+      settings_key += b ? '1' : '0';
+    }
+    return key + "_" + std::to_string(flags) + (instanced ? "_i" : "") + "_" + settings_key + "_" + std::to_string(settings.getFrustumSplits().size())
+      + "_v" + std::to_string(version);
   }
   GLShaderSource GLSLShaderGenerator::createMeshVertexShaderSource(unsigned flags, const GraphicsSettings & settings, bool instanced)const
   {
@@ -41,10 +61,13 @@ uniform vec3 " + std::string(bbMax) + "; // AABB max xz\n" + std::string(noiseCo
     if (instanced) {
       key += "_instanced";
     }
+    if (flags & MeshRenderFlag::MR_MULTI_DRAW) {
+      key += "_multi_draw";
+    }
     key += ".glsl";
     GLShaderSource src;
     src._key = key;
-    src._source = createMeshVertexSource(flags, settings, instanced);
+    src._source = cachedSource(key, flags, settings, instanced, [&]() { return createMeshVertexSource(flags, settings, instanced); });
     src._type = GL_VERTEX_SHADER;
     return src;
   }
@@ -78,10 +101,13 @@ uniform vec3 " + std::string(bbMax) + "; // AABB max xz\n" + std::string(noiseCo
     if (instanced) {
       key += "_instanced";
     }
+    if (flags & MeshRenderFlag::MR_MULTI_DRAW) {
+      key += "_multi_draw";
+    }
     key += ".glsl";
     GLShaderSource src;
     src._key = key;
-    src._source = createMeshFragmentSource(flags, settings, instanced);
+    src._source = cachedSource(key, flags, settings, instanced, [&]() { return createMeshFragmentSource(flags, settings, instanced); });
     src._type = GL_FRAGMENT_SHADER;
     return src;
   }
@@ -94,10 +120,13 @@ uniform vec3 " + std::string(bbMax) + "; // AABB max xz\n" + std::string(noiseCo
     if (instanced) {
       key += "_instanced";
     }
+    if (flags & MeshRenderFlag::MR_MULTI_DRAW) {
+      key += "_multi_draw";
+    }
     key += ".glsl";
     GLShaderSource src;
     src._key = key;
-    src._source = createMeshVertexDepthSource(flags, settings, instanced);
+    src._source = cachedSource(key, flags, settings, instanced, [&]() { return createMeshVertexDepthSource(flags, settings, instanced); });
     src._type = GL_VERTEX_SHADER;
     return src;
   }
@@ -113,7 +142,7 @@ uniform vec3 " + std::string(bbMax) + "; // AABB max xz\n" + std::string(noiseCo
     key += ".glsl";
     GLShaderSource src;
     src._key = key;
-    src._source = createMeshGeometryDepthSource(flags, settings, instanced);
+    src._source = cachedSource(key, flags, settings, instanced, [&]() { return createMeshGeometryDepthSource(flags, settings, instanced); });
     src._type = GL_GEOMETRY_SHADER;
     return src;
   }
@@ -126,7 +155,7 @@ uniform vec3 " + std::string(bbMax) + "; // AABB max xz\n" + std::string(noiseCo
     key += ".glsl";
     GLShaderSource src;
     src._key = key;
-    src._source = createMeshFragmentDepthSource(flags, settings);
+    src._source = cachedSource(key, flags, settings, false, [&]() { return createMeshFragmentDepthSource(flags, settings); });
     src._type = GL_FRAGMENT_SHADER;
     return src;
   }
@@ -245,10 +274,14 @@ void main()\n\
   }
   std::string GLSLShaderGenerator::createMeshVertexSource(unsigned flags, const GraphicsSettings & settings, bool instanced) const
   {
-    std::string version = instanced ? "450" : "330";
+    bool multi_draw = (flags & MeshRenderFlag::MR_MULTI_DRAW) != 0;
+    std::string version = instanced || multi_draw ? "450" : "330";
     std::string shader_src;
-    shader_src += "#version " + version + "\n\
-layout(location = 0) in vec3 position;\n\
+    shader_src += "#version " + version + "\n";
+    if (multi_draw) {
+      shader_src += _multiDrawExtensionStr;
+    }
+    shader_src += "layout(location = 0) in vec3 position;\n\
 layout(location = 1) in vec3 normal;\n\
 layout(location = 2) in vec2 uv;\n\
 layout(location = 3) in vec3 tangent;\n\
@@ -279,6 +312,9 @@ uniform uint offs; \n\
 out vec3 " + std::string(diffuseColor) + ";\n\
 out mat3 " + std::string(modelMatrixInverse) + ";";
     }
+    if (multi_draw) {
+      shader_src += _drawDataStr + "out mat3 " + std::string(modelMatrixInverse) + ";\n";
+    }
     if (settings.depthPrepassEnabled()) {
       shader_src += "invariant gl_Position; \n";
     }
@@ -290,7 +326,7 @@ out mat3 " + std::string(modelMatrixInverse) + ";";
     if (instanced) {
       shader_src += "  uint instance_id = instances[gl_InstanceID + offs]; \n";
     }
-    shader_src += "  pos_world = (" + (instanced ? std::string("instance_data[instance_id].world_matrix") : std::string("M")) + " * vec4(position, 1.f)).xyz;\n";
+    shader_src += "  pos_world = (" + (instanced ? std::string("instance_data[instance_id].world_matrix") : multi_draw ? std::string("draw_data[gl_BaseInstanceARB].world_matrix") : std::string("M")) + " * vec4(position, 1.f)).xyz;\n";
     if (flags & MeshRenderFlag::MR_WIND) {
       shader_src += _windCodeString;
     }
@@ -305,14 +341,21 @@ out mat3 " + std::string(modelMatrixInverse) + ";";
     if (instanced) {
       shader_src += "  " + std::string(modelMatrixInverse) + " = mat3(instance_data[instance_id].world_matrix_inverse_transpose);\n";
     }
+    if (multi_draw) {
+      shader_src += "  " + std::string(modelMatrixInverse) + " = mat3(draw_data[gl_BaseInstanceARB].world_matrix_inverse_transpose);\n";
+    }
     shader_src += "}\n";
     return shader_src;
   }
   std::string GLSLShaderGenerator::createMeshVertexDepthSource(unsigned flags, const GraphicsSettings & settings, bool instanced) const
   {
-    std::string version = instanced ? "450" : "330";
-    std::string shader_src = "#version " + version + "\n\
-layout(location = 0) in vec3 position;\n\
+    bool multi_draw = (flags & MeshRenderFlag::MR_MULTI_DRAW) != 0;
+    std::string version = instanced || multi_draw ? "450" : "330";
+    std::string shader_src = "#version " + version + "\n";
+    if (multi_draw) {
+      shader_src += _multiDrawExtensionStr;
+    }
+    shader_src += "layout(location = 0) in vec3 position;\n\
 layout(location = 2) in vec2 uv;\n";
     if (settings.depthPrepassEnabled()) {
       shader_src += "invariant gl_Position; \n";
@@ -333,9 +376,12 @@ layout (std430, binding = " + std::to_string(bufferBindingVisibleInstances) + ")
 uniform uint offs; \n\
 out mat3 " + std::string(modelMatrixInverse) + ";\n";
     }
+    if (multi_draw) {
+      shader_src += _drawDataStr;
+    }
     shader_src += "void main()\n\
 {\n";
-    shader_src += "  vec4 pos_world = " + (instanced ? std::string("instance_data[instances[gl_InstanceID + offs]].world_matrix") : std::string("M")) + " * vec4(position, 1.f);\n";
+    shader_src += "  vec4 pos_world = " + (instanced ? std::string("instance_data[instances[gl_InstanceID + offs]].world_matrix") : multi_draw ? std::string("draw_data[gl_BaseInstanceARB].world_matrix") : std::string("M")) + " * vec4(position, 1.f);\n";
     if (flags & MeshRenderFlag::MR_WIND) {
       shader_src += _windCodeString;
     }
@@ -369,7 +415,8 @@ void main() \n\
   }
   std::string GLSLShaderGenerator::createMeshFragmentSource(unsigned flags, const GraphicsSettings& settings, bool instanced) const
   {
-    std::string version = instanced ? "450" : "330";
+    bool multi_draw = (flags & MeshRenderFlag::MR_MULTI_DRAW) != 0;
+    std::string version = instanced || multi_draw ? "450" : "330";
     bool tangent_space = (flags & MR_NORMAL_MAP) || (flags & MR_HEIGHT_MAP);
     std::string shader_src = "#version " + version + " \n\
 layout(location = 0) out vec3 fragmentColor;\n";
@@ -405,7 +452,7 @@ uniform float " + std::string(diffuseConstant) + ";\n\
 uniform float " + std::string(specularConstant) + ";\n\
 uniform float " + std::string(specularExponent) + ";\n\
 uniform float " + std::string(gamma) + ";\n" +
-(instanced ? std::string("in") : std::string("uniform")) + " mat3 " + std::string(modelMatrixInverse) + ";\n\
+(instanced || multi_draw ? std::string("in") : std::string("uniform")) + " mat3 " + std::string(modelMatrixInverse) + ";\n\
 uniform mat3 " + std::string(viewInverse) + ";\n\
 uniform vec4 " + std::string(viewMatrixThirdRow) + ";\n\
 in vec3 normal_local;\n\
@@ -55,6 +55,7 @@ namespace fly
   }
   void GLShaderProgram::link()
   {
+    GL_CHECK(glProgramParameteri(_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
     GL_CHECK(glLinkProgram(_id));
     GLint linkStatus;
     GL_CHECK(glGetProgramiv(_id, GL_LINK_STATUS, &linkStatus));
@@ -81,7 +82,31 @@ namespace fly
       GL_CHECK(glDetachShader(_id, s._id));
       GL_CHECK(glDeleteShader(s._id));
     }
-
+    initUniforms();
+  }
+  bool GLShaderProgram::linkBinary(GLenum format, const std::vector<char>& binary, const std::vector<GLShaderSource>& sources)
+  {
+    GL_CHECK(glProgramBinary(_id, format, binary.data(), static_cast<GLsizei>(binary.size())));
+    GLint link_status;
+    GL_CHECK(glGetProgramiv(_id, GL_LINK_STATUS, &link_status));
+    if (link_status != GL_TRUE) {
+      return false;
+    }
+    _sources = sources;
+    initUniforms();
+    return true;
+  }
+  void GLShaderProgram::getBinary(GLenum & format, std::vector<char>& binary) const
+  {
+    GLint length = 0;
+    GL_CHECK(glGetProgramiv(_id, GL_PROGRAM_BINARY_LENGTH, &length));
+    binary.resize(length);
+    if (length) {
+      GL_CHECK(glGetProgramBinary(_id, length, nullptr, &format, binary.data()));
+    }
+  }
+  void GLShaderProgram::initUniforms()
+  {
     GLint num_uniforms;
     GL_CHECK(glGetProgramInterfaceiv(_id, GL_UNIFORM, GL_ACTIVE_RESOURCES, &num_uniforms));
     int buf_size;
@@ -10,6 +10,18 @@ namespace fly
   GLTexture::GLTexture(GLuint id, GLenum target) : _id(id), _target(target)
   {
   }
+  void GLTexture::querySize()
+  {
+    GLint width, height, depth, internal_format;
+    GL_CHECK(glGetTexLevelParameteriv(_target, 0, GL_TEXTURE_WIDTH, &width));
+    GL_CHECK(glGetTexLevelParameteriv(_target, 0, GL_TEXTURE_HEIGHT, &height));
+    GL_CHECK(glGetTexLevelParameteriv(_target, 0, GL_TEXTURE_DEPTH, &depth));
+    GL_CHECK(glGetTexLevelParameteriv(_target, 0, GL_TEXTURE_INTERNAL_FORMAT, &internal_format));
+    _width = width;
+    _height = height;
+    _depth = depth;
+    _internalFormat = internal_format;
+  }
   GLTexture::GLTexture(const GLTexture & other) : 
     _target(other._target)
   {
@@ -85,6 +97,25 @@ namespace fly
   {
     return _target;
   }
+  size_t GLTexture::sizeInBytes() const
+  {
+    size_t num_pixels = static_cast<size_t>(_width) * _height * _depth;
+    switch (_internalFormat) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: return num_pixels / 2u;
+    case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+    case GL_R8: return num_pixels;
+    case GL_RG8:
+    case GL_R16F: return num_pixels * 2u;
+    case GL_RG32F:
+    case GL_RGBA16:
+    case GL_RGBA16F: return num_pixels * 8u;
+    case GL_RGB32F: return num_pixels * 12u;
+    case GL_RGBA32F: return num_pixels * 16u;
+    default: return num_pixels * 4u;
+    }
+  }
   GLTexture::~GLTexture()
   {
     GL_CHECK(glDeleteTextures(1, &_id));
@@ -218,6 +218,21 @@ namespace fly
       GL_CHECK(glDrawElementsIndirect(GL_TRIANGLES, info[i]._type, reinterpret_cast<void*>(i * sizeof(IndirectInfo))));
     }
   }
+  bool OpenGLAPI::multiDrawIndirectSupported() const
+  {
+    return GLEW_ARB_multi_draw_indirect && GLEW_ARB_shader_draw_parameters;
+  }
+  void OpenGLAPI::setMultiDrawData(const StackPOD<InstanceData>& draw_data, const StackPOD<IndirectInfo>& indirect_info, MultiDrawBuffers& buffers) const
+  {
+    buffers._drawData.setData(draw_data.begin(), draw_data.size(), GL_STREAM_DRAW);
+    buffers._indirectBuffer.setData(indirect_info.begin(), indirect_info.size(), GL_STREAM_DRAW);
+  }
+  void OpenGLAPI::renderMeshesIndirect(const MultiDrawBuffers& buffers, GLenum type, unsigned first_draw, unsigned num_draws) const
+  {
+    buffers._drawData.bindBase(GLSLShaderGenerator::bufferBindingInstanceData);
+    buffers._indirectBuffer.bind(GL_DRAW_INDIRECT_BUFFER);
+    GL_CHECK(glMultiDrawElementsIndirect(GL_TRIANGLES, type, reinterpret_cast<void*>(first_draw * sizeof(IndirectInfo)), num_draws, sizeof(IndirectInfo)));
+  }
   void OpenGLAPI::setRendertargets(const RendertargetStack& rtts, const Depthbuffer* depth_buffer)
   {
     setColorBuffers(rtts);
@@ -350,7 +365,10 @@ namespace fly
   {
     auto tex = SOIL_load_OGL_texture(path.c_str(), SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_MIPMAPS | SOIL_FLAG_TEXTURE_REPEATS | SOIL_FLAG_COMPRESS_TO_DXT);
     if (tex) {
-      return new OpenGLAPI::Texture(tex, GL_TEXTURE_2D);
+      auto texture = new OpenGLAPI::Texture(tex, GL_TEXTURE_2D);
+      texture->bind();
+      texture->querySize();
+      return texture;
     }
     else {
       throw std::exception((std::string("Could not create texture ") + path).c_str());
@@ -360,10 +378,30 @@ namespace fly
   OpenGLAPI::Shader* OpenGLAPI::createShader(OpenGLAPI::ShaderSource& vs, OpenGLAPI::ShaderSource& fs, OpenGLAPI::ShaderSource& gs)
   {
     auto ret = new Shader();
+    bool cache_binary = _shaderDiskCache && _driverKey.size();
+    std::string key;
+    if (cache_binary) {
+      key = _driverKey + "_" + std::to_string(ShaderDiskCache::hash(vs._source + fs._source + gs._source));
+      unsigned format;
+      std::vector<char> binary;
+      std::vector<ShaderSource> sources = { vs, fs };
+      if (gs._key != "") { sources.push_back(gs); }
+      if (_shaderDiskCache->loadBinary(key, format, binary) && ret->linkBinary(format, binary, sources)) {
+        return ret;
+      }
+    }
     ret->add(vs);
     if (gs._key != "") { ret->add(gs); }
     ret->add(fs);
     ret->link();
+    if (cache_binary) {
+      GLenum format;
+      std::vector<char> binary;
+      ret->getBinary(format, binary);
+      if (binary.size()) {
+        _shaderDiskCache->storeBinary(key, format, binary);
+      }
+    }
     return ret;
   }
   OpenGLAPI::Shader OpenGLAPI::createComputeShader(OpenGLAPI::ShaderSource & source)
@@ -458,6 +496,30 @@ namespace fly
   //{
   //  return _skydomeShaderDesc;
   //}
+  void OpenGLAPI::setShaderDiskCache(const std::string & directory)
+  {
+    _shaderGenerator.setDiskCache(nullptr);
+    _shaderDiskCache = nullptr;
+    _driverKey.clear();
+    if (directory.empty()) {
+      return;
+    }
+    _shaderDiskCache = std::make_unique<ShaderDiskCache>(directory);
+    _shaderGenerator.setDiskCache(_shaderDiskCache.get());
+    GLint num_binary_formats = 0;
+    GL_CHECK(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_binary_formats));
+    if (num_binary_formats) {
+      _driverKey = std::string(reinterpret_cast<const char*>(glGetString(GL_VENDOR))) + "_" + reinterpret_cast<const char*>(glGetString(GL_RENDERER))
+        + "_" + reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    }
+    else {
+      std::cout << "OpenGLAPI::setShaderDiskCache(): Program binaries are not supported, only generated sources are cached" << std::endl;
+    }
+  }
+  const ShaderDiskCache * OpenGLAPI::getShaderDiskCache() const
+  {
+    return _shaderDiskCache.get();
+  }
   const OpenGLAPI::ShaderGenerator& OpenGLAPI::getShaderGenerator() const
   {
     return _shaderGenerator;
@@ -506,6 +568,7 @@ namespace fly
       const std::shared_ptr<Mesh>& mesh) {
     MeshData mesh_data;
     mesh_data._count = static_cast<GLsizei>(mesh->getIndices().size());
+    mesh_data._id = _numMeshes++;
     mesh_data._baseVertex = static_cast<GLint>(_baseVertex);
     mesh_data._indices = reinterpret_cast<GLvoid*>(_indices);
     _baseVertex += mesh->getVertices().size();
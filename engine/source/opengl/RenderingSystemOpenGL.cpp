@@ -23,6 +23,7 @@
 #include <Material.h>
 #include <Billboard.h>
 #include <Terrain.h>
+#include <JobSystem.h>
 #include <opengl/GLShaderInterface.h>
 
 namespace fly
@@ -2071,7 +2072,7 @@ namespace fly
     if (_textures[path] == nullptr) {
       std::ifstream is(path);
       if (is.good() && !_textureFutures.count(path)) {
-        _textureFutures[path] = std::async(std::launch::async, [path, this]() {
+        _textureFutures[path] = JobSystem::getInstance().async([path, this]() {
           AsyncTextureResult result;
           result._data = SOIL_load_image(path.c_str(), &result._width, &result._height, &result._channels, SOIL_LOAD_AUTO);
           return result;
@@ -13,6 +13,9 @@ namespace fly
     _world(std::make_unique<btDiscreteDynamicsWorld>(_collisionDispatcher.get(), _iBroadphase.get(), _solver.get(), _collisionConfig.get()))
   {
     _world->setGravity(btVector3(0.f, -10.f, 0.f));
+    addWrite(_world.get());
+    // The motion states of the rigid bodies are written during the simulation step, the renderer reads them through the entities.
+    addWrite(sceneData());
   }
   void Bullet3PhysicsSystem::setSimulationSubsteps(int steps)
   {
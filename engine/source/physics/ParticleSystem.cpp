@@ -1,4 +1,5 @@
 #include <physics/ParticleSystem.h>
+#include <JobSystem.h>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/transform.hpp>
@@ -33,22 +34,29 @@ namespace fly
       _emit = time + _desc._emitInterval;
     }
 
-    for (int i = static_cast<int>(_particles.size() - 1); i >= 0; i--) {
-      auto& p = _particles[i];
-      if (time >= p._birth && time <= p._birth + _desc._lifeTime) {
-        auto acceleration = (p._impulse + _desc._gravity) / _desc._mass;
-        p._velocity += acceleration * delta_time;
-        p._position += p._velocity * delta_time;
-        p._impulse *= 0.f;
-        if (_desc._randomImpulses && random() < _desc._impulseProbability) {
-          p._impulse = _desc._impulseStrength * (glm::vec3(randomScaleBiased(), randomScaleBiased(), randomScaleBiased()));
+    // Particles are emitted at the front, so expired particles are always at the back.
+    while (_particles.size() && time > _particles.back()._birth + _desc._lifeTime) {
+      _particles.pop_back();
+    }
+    unsigned seed = _gen();
+    JobSystem::getInstance().parallelFor(0, static_cast<unsigned>(_particles.size()), _minParticlesPerJob, [this, time, delta_time, seed](unsigned begin, unsigned end) {
+      // Each range draws its random impulses from its own generator, _gen is not thread safe.
+      std::mt19937 gen(seed + begin);
+      std::uniform_real_distribution<float> dist(0.f, 1.f);
+      for (unsigned i = begin; i < end; i++) {
+        auto& p = _particles[i];
+        if (time >= p._birth) {
+          auto acceleration = (p._impulse + _desc._gravity) / _desc._mass;
+          p._velocity += acceleration * delta_time;
+          p._position += p._velocity * delta_time;
+          p._impulse *= 0.f;
+          if (_desc._randomImpulses && dist(gen) < _desc._impulseProbability) {
+            p._impulse = _desc._impulseStrength * (glm::vec3(dist(gen), dist(gen), dist(gen)) * 2.f - 1.f);
+          }
+          p._age = (time - p._birth) / _desc._lifeTime;
         }
-        p._age = (time - p._birth) / _desc._lifeTime;
-      }
-      else if (time > p._birth + _desc._lifeTime) {
-        _particles.erase(_particles.begin() + i);
       }
-    }
+    });
   }
   void ParticleSystem::getParticleTransformations(std::vector<Mat4f>& transformations) const
   {
@@ -130,6 +130,20 @@ private:
   static void getMTCulling(void* value, void* client_data);
   static void setMTDetailCulling(const void* value, void* client_data);
   static void getMTDetailCulling(void* value, void* client_data);
+  static void setMTBVHTraversal(const void* value, void* client_data);
+  static void getMTBVHTraversal(void* value, void* client_data);
+  static void setMTCommandRecording(const void* value, void* client_data);
+  static void getMTCommandRecording(void* value, void* client_data);
+  static void setMultiDrawIndirect(const void* value, void* client_data);
+  static void getMultiDrawIndirect(void* value, void* client_data);
+  static void setPipelinedRendering(const void* value, void* client_data);
+  static void getPipelinedRendering(void* value, void* client_data);
+  static void setOcclusionCulling(const void* value, void* client_data);
+  static void getOcclusionCulling(void* value, void* client_data);
+  static void setTemporalCulling(const void* value, void* client_data);
+  static void getTemporalCulling(void* value, void* client_data);
+  static void setAsyncShaderRebuild(const void* value, void* client_data);
+  static void getAsyncShaderRebuild(void* value, void* client_data);
   template<typename T> static T* cast(void* data){return reinterpret_cast<T*>(data);}
   template<typename T> static const T* cast(const void* data) { return reinterpret_cast<const T*>(data); }
 };
@@ -125,6 +125,7 @@ private:
   const char* _sceneMeshGroupingName = "Scene mesh grouping time";
   const char* _shadowMapGroupingName = "Shadow map grouping time";
   const char* _rendererIdleTimeName = "Renderer idle time";
+  const char* _frameArenaAllocationsName = "Frame arena heap allocations";
 
   std::string formatNumber(unsigned number);
 };
@@ -19,6 +19,13 @@ AntWrapper::AntWrapper(TwBar* bar, fly::GraphicsSettings* gs, fly::OpenGLAPI* ap
 
   TwAddVarCB(bar, "Multithreaded culling", TwType::TW_TYPE_BOOLCPP, setMTCulling, getMTCulling, gs, nullptr);
   TwAddVarCB(bar, "Multithreaded detail culling", TwType::TW_TYPE_BOOLCPP, setMTDetailCulling, getMTDetailCulling, gs, nullptr);
+  TwAddVarCB(bar, "Multithreaded BVH traversal", TwType::TW_TYPE_BOOLCPP, setMTBVHTraversal, getMTBVHTraversal, gs, nullptr);
+  TwAddVarCB(bar, "Multithreaded command recording", TwType::TW_TYPE_BOOLCPP, setMTCommandRecording, getMTCommandRecording, gs, nullptr);
+  TwAddVarCB(bar, "Multi draw indirect", TwType::TW_TYPE_BOOLCPP, setMultiDrawIndirect, getMultiDrawIndirect, gs, nullptr);
+  TwAddVarCB(bar, "Pipelined rendering", TwType::TW_TYPE_BOOLCPP, setPipelinedRendering, getPipelinedRendering, gs, nullptr);
+  TwAddVarCB(bar, "Occlusion culling", TwType::TW_TYPE_BOOLCPP, setOcclusionCulling, getOcclusionCulling, gs, nullptr);
+  TwAddVarCB(bar, "Temporal culling", TwType::TW_TYPE_BOOLCPP, setTemporalCulling, getTemporalCulling, gs, nullptr);
+  TwAddVarCB(bar, "Async shader rebuild", TwType::TW_TYPE_BOOLCPP, setAsyncShaderRebuild, getAsyncShaderRebuild, gs, nullptr);
   TwAddVarCB(bar, "Shadows", TwType::TW_TYPE_BOOLCPP, setShadows, getShadows, gs, nullptr);
   TwAddVarCB(bar, "Shadows PCF", TwType::TW_TYPE_BOOLCPP, setPCF, getPCF, gs, nullptr);
   TwAddVarCB(bar, "Max shadow cast distance", TwType::TW_TYPE_FLOAT, setMaxShadowCastDistance, getMaxShadowCastDistance, dl, "step = 0.5f");
@@ -523,4 +530,74 @@ void AntWrapper::setMTDetailCulling(const void * value, void * client_data)
 void AntWrapper::getMTDetailCulling(void * value, void * client_data)
 {
   *cast<bool>(value) = cast<fly::GraphicsSettings>(client_data)->getMultithreadedDetailCulling();
+}
+
+void AntWrapper::setMTBVHTraversal(const void * value, void * client_data)
+{
+  cast<fly::GraphicsSettings>(client_data)->setMultithreadedBVHTraversal(*cast<bool>(value));
+}
+
+void AntWrapper::getMTBVHTraversal(void * value, void * client_data)
+{
+  *cast<bool>(value) = cast<fly::GraphicsSettings>(client_data)->getMultithreadedBVHTraversal();
+}
+
+void AntWrapper::setMTCommandRecording(const void * value, void * client_data)
+{
+  cast<fly::GraphicsSettings>(client_data)->setMultithreadedCommandRecording(*cast<bool>(value));
+}
+
+void AntWrapper::getMTCommandRecording(void * value, void * client_data)
+{
+  *cast<bool>(value) = cast<fly::GraphicsSettings>(client_data)->getMultithreadedCommandRecording();
+}
+
+void AntWrapper::setMultiDrawIndirect(const void * value, void * client_data)
+{
+  cast<fly::GraphicsSettings>(client_data)->setMultiDrawIndirect(*cast<bool>(value));
+}
+
+void AntWrapper::getMultiDrawIndirect(void * value, void * client_data)
+{
+  *cast<bool>(value) = cast<fly::GraphicsSettings>(client_data)->getMultiDrawIndirect();
+}
+
+void AntWrapper::setPipelinedRendering(const void * value, void * client_data)
+{
+  cast<fly::GraphicsSettings>(client_data)->setPipelinedRendering(*cast<bool>(value));
+}
+
+void AntWrapper::getPipelinedRendering(void * value, void * client_data)
+{
+  *cast<bool>(value) = cast<fly::GraphicsSettings>(client_data)->getPipelinedRendering();
+}
+
+void AntWrapper::setOcclusionCulling(const void * value, void * client_data)
+{
+  cast<fly::GraphicsSettings>(client_data)->setOcclusionCulling(*cast<bool>(value));
+}
+
+void AntWrapper::getOcclusionCulling(void * value, void * client_data)
+{
+  *cast<bool>(value) = cast<fly::GraphicsSettings>(client_data)->getOcclusionCulling();
+}
+
+void AntWrapper::setTemporalCulling(const void * value, void * client_data)
+{
+  cast<fly::GraphicsSettings>(client_data)->setTemporalCulling(*cast<bool>(value));
+}
+
+void AntWrapper::getTemporalCulling(void * value, void * client_data)
+{
+  *cast<bool>(value) = cast<fly::GraphicsSettings>(client_data)->getTemporalCulling();
+}
+
+void AntWrapper::setAsyncShaderRebuild(const void * value, void * client_data)
+{
+  cast<fly::GraphicsSettings>(client_data)->setAsyncShaderRebuild(*cast<bool>(value));
+}
+
+void AntWrapper::getAsyncShaderRebuild(void * value, void * client_data)
+{
+  *cast<bool>(value) = cast<fly::GraphicsSettings>(client_data)->getAsyncShaderRebuild();
 }
\ No newline at end of file
@@ -13,6 +13,7 @@
 #include <random>
 #include <CamSpeedSystem.h>
 #include <PhysicsCameraController.h>
+#include <Profiler.h>
 
 using API = fly::OpenGLAPI;
 using BV = fly::AABB;
@@ -32,8 +33,6 @@ void GLWidget::initializeGL()
   _renderer = std::make_shared<fly::Renderer<API, BV>>(&_graphicsSettings);
   _graphicsSettings.addListener(_renderer);
   _engine.addSystem(_renderer);
-  _camSpeedSytem = std::make_shared<fly::CamSpeedSystem<API, BV>>(*_renderer, _physicsCC);
-  _engine.addSystem(_camSpeedSytem);
 
 #if PHYSICS
   _physicsSystem = std::make_shared<fly::Bullet3PhysicsSystem>();
@@ -51,6 +50,7 @@ void GLWidget::initializeGL()
 #if RENDERER_STATS
   TwAddButton(_bar, _rendererCPUTimeName, nullptr, nullptr, nullptr);
   TwAddButton(_bar, _rendererIdleTimeName, nullptr, nullptr, nullptr);
+  TwAddButton(_bar, _frameArenaAllocationsName, nullptr, nullptr, nullptr);
   TwAddSeparator(_bar, "Shadow stats", nullptr);
   TwAddButton(_bar, _renderedMeshesShadowName, nullptr, nullptr, nullptr);
   TwAddButton(_bar, _renderedTrianglesShadowName, nullptr, nullptr, nullptr);
@@ -171,6 +171,10 @@ void GLWidget::keyReleaseEvent(QKeyEvent * e)
   if (e->key() == Qt::Key::Key_R) {
     _renderer->setDebugCamera(_renderer->getDebugCamera() == nullptr ? _debugCamera : nullptr);
   }
+  if (e->key() == Qt::Key::Key_T) {
+    fly::Profiler::getInstance().saveChromeTrace("trace.json");
+    std::cout << "Saved the latest frames to trace.json" << std::endl;
+  }
 }
 
 void GLWidget::mousePressEvent(QMouseEvent * e)
@@ -276,6 +280,7 @@ void GLWidget::updateStats()
   TwSetParam(_bar, _sceneMeshGroupingName, "label", TwParamValueType::TW_PARAM_CSTRING, 1, ("Scene mesh grouping:" + formatNumber(stats._sceneMeshGroupingMicroSeconds)).c_str());
 
   TwSetParam(_bar, _rendererIdleTimeName, "label", TwParamValueType::TW_PARAM_CSTRING, 1, ("Renderer idle:" + formatNumber(stats._rendererIdleTimeMicroSeconds)).c_str());
+  TwSetParam(_bar, _frameArenaAllocationsName, "label", TwParamValueType::TW_PARAM_CSTRING, 1, ("Frame arena allocations:" + formatNumber(stats._frameArenaHeapAllocations)).c_str());
 #endif
 }
 
@@ -419,6 +424,8 @@ void GLWidget::initGame()
       }
       index++;
     }
+    // The walls and floors of the atrium hide most of the scene from inside.
+    _renderer->addLargeMeshesAsOccluders(sponza_model->getMeshes(), transform, fly::AABB(sponza_model->getAABB(), transform.getModelMatrix()).size() * 0.2f, 4096u);
 #endif
 #if TOWERS
   }
@@ -531,7 +538,6 @@ void GLWidget::initGame()
   _graphicsSettings.setDofNear(-1.f);
   _graphicsSettings.setMultithreadedCulling(true);
   _graphicsSettings.setMultithreadedDetailCulling(true);
-  _engine.removeSystem(_camSpeedSytem);
   float spec = 128.f;
   /*auto model = importer->loadModel("../tinyrenderer/obj/african_head/african_head.obj");
   std::vector<std::shared_ptr<fly::StaticMeshRenderable<fly::OpenGLAPI, fly::AABB>>> tiny_meshes;
@@ -780,6 +786,10 @@ void GLWidget::initGame()
   _camController = std::make_unique<fly::CameraController>(_camera, 100.f);
   _physicsCC = std::make_shared<fly::PhysicsCameraController>(_camera);
   _engine.addSystem(_physicsCC);
+  _camSpeedSytem = std::make_shared<fly::CamSpeedSystem<API, BV>>(*_renderer, _physicsCC);
+#if !(TINY_RENDERER_MODELS)
+  _engine.addSystem(_camSpeedSytem);
+#endif
   std::cout << "Init game took " << init_game_timing.duration<std::chrono::milliseconds>() << " milliseconds." << std::endl;
   _renderer->buildBVH();
 }